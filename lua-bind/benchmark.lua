@@ -1,4 +1,10 @@
-lskiplist = require "lskiplist"
+--[[
+usage: lua benchmark.lua [size] [binding]
+binding:
+	comp	lskiplist with comp function in lua (default)
+	score	lskiplist compare with score
+	ffi	lskiplist_ffi compare with score, luajit only
+]]
 
 function comp(a, b, scoreA, scoreB, pdiff)
 	if scoreA ~= scoreB then
@@ -18,7 +24,7 @@ function benchmark(f, ...)
 	return os.clock() - s
 end
 
-local sl = lskiplist.new(comp)
+local sl
 
 function insert(len)
 	for i=1, len do
@@ -66,6 +72,15 @@ end
 
 function main(args)
 	local map_len = tonumber(args and args[1]) or 1e5
+	local binding = args and args[2] or "comp"
+	if binding == "ffi" then
+		sl = require("lskiplist_ffi").new()
+	elseif binding == "score" then
+		sl = require("lskiplist").new()
+	else
+		sl = require("lskiplist").new(comp)
+	end
+	printf("binding=%s", binding)
 	for i = 1, map_len do
 		map[i] = math.random()
 	end
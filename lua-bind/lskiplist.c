@@ -20,6 +20,9 @@
 # ifndef lua_getuservalue
 #  define lua_getuservalue(L, n) lua_getfenv(L, n)
 # endif
+# ifndef lua_rawlen
+#  define lua_rawlen(L, n) lua_objlen(L, n)
+# endif
 #endif
 
 #define EPSILON 1e-15
@@ -30,6 +33,19 @@
 #define CLASS_SKIPLIST "cls{skiplist}"
 #define CHECK_SL(L, n) ((sl_t *)luaL_checkudata(L, n, CLASS_SKIPLIST))
 
+#define CLASS_CURSOR "cls{skiplist_cursor}"
+#define CHECK_CURSOR(L, n) ((slCursor_t *)luaL_checkudata(L, n, CLASS_CURSOR))
+
+/* deadline index of sl:expire_at, a sl_t ordered by (deadline, node) */
+#define CLASS_EXPIRE "cls{skiplist_expire}"
+#define EXPIRE_BATCH 64
+
+/* default buckets of sl:histogram */
+#define HIST_BUCKETS 256
+
+/* score ordered lists compare in C, see lua__new */
+#define IS_BY_SCORE(sl) ((sl)->comp == compByScore || (sl)->comp == compByScoreDesc)
+
 /**
  * #define SL_ALWAYS_FETCH 1
  */
@@ -37,7 +53,7 @@
 #ifndef SL_ALWAYS_FETCH
 
 #define SL_COMP_INIT(L, slIdx, top, sl) do {     \
-	if (sl->comp == compByScore) break;      \
+	if (IS_BY_SCORE(sl)) break;              \
 	top = lua_gettop(L);                     \
 	lua_getuservalue(L, slIdx);              \
 	lua_getfield(L, -1, "value_map");        \
@@ -45,7 +61,7 @@
 } while (0);
 
 #define SL_COMP_FINAL(L, top, sl) do {             \
-	if (sl->comp == compByScore) break;        \
+	if (IS_BY_SCORE(sl)) break;                \
 	lua_settop(L, top);                        \
 } while (0);
 
@@ -91,25 +107,55 @@ static slNode_t *luac__get_node(lua_State *L, int sl_idx, int node_idx)
 	return NULL;
 }
 
-static int compByScore(slNode_t *nodeA, slNode_t *nodeB, sl_t *sl, void *ctx)
+/**
+ * drop the deadline of node if any, uv_idx is the uservalue of sl
+ */
+static void luac__unexpire(lua_State *L, int uv_idx, slNode_t *node)
 {
-	ptrdiff_t diff;
-	double score_diff;
-	int asec = sl->udata == NULL ? 1 : -1;
-
-	score_diff = nodeA->score - nodeB->score;
-	if (fabs(score_diff) > EPSILON) {
-		if (score_diff * asec < 0)
-			return -1;
-		else
-			return 1;
+	int top = lua_gettop(L);
+	sl_t *expire;
+	slNode_t *enode;
+	lua_getfield(L, uv_idx, "expire");
+	if ((expire = lua_touserdata(L, -1)) != NULL) {
+		lua_getfield(L, uv_idx, "expire_map");	/*expire, expire_map*/
+		lua_pushlightuserdata(L, (void *)node);
+		lua_rawget(L, -2);
+		if ((enode = lua_touserdata(L, -1)) != NULL) {
+			slDeleteNode(expire, enode, NULL, NULL);
+			lua_pushlightuserdata(L, (void *)node);
+			lua_pushnil(L);
+			lua_rawset(L, -4);
+		}
 	}
-	diff = (const char *)nodeA - (const char *)nodeB;
+	lua_settop(L, top);
+}
+
+static int compByUdata(slNode_t *nodeA, slNode_t *nodeB)
+{
+	/* udata is the node itself, see lua__insert; a cursor key has only udata */
+	ptrdiff_t diff = (const char *)nodeA->udata - (const char *)nodeB->udata;
 	if (diff == 0)
 		return 0;
 	return diff > 0 ? 1 : -1;
 }
 
+static int compByScore(slNode_t *nodeA, slNode_t *nodeB, sl_t *sl, void *ctx)
+{
+	double score_diff = nodeA->score - nodeB->score;
+	if (fabs(score_diff) > EPSILON)
+		return score_diff < 0 ? -1 : 1;
+	return compByUdata(nodeA, nodeB);
+}
+
+/* desc lists order natively instead of flipping every comparison */
+static int compByScoreDesc(slNode_t *nodeA, slNode_t *nodeB, sl_t *sl, void *ctx)
+{
+	double score_diff = nodeA->score - nodeB->score;
+	if (fabs(score_diff) > EPSILON)
+		return score_diff > 0 ? -1 : 1;
+	return compByUdata(nodeA, nodeB);
+}
+
 static int compInLua(slNode_t *nodeA, slNode_t *nodeB, sl_t *sl, void *ctx)
 {
 	lua_State *L = ctx;
@@ -120,7 +166,7 @@ static int compInLua(slNode_t *nodeA, slNode_t *nodeB, sl_t *sl, void *ctx)
 	int offset = 0;
 	double retf;
 
-	diff = (const char *)nodeA - (const char *)nodeB;
+	diff = (const char *)nodeA->udata - (const char *)nodeB->udata;
 	if (diff == 0)
 		return 0;
 	else
@@ -138,10 +184,10 @@ static int compInLua(slNode_t *nodeA, slNode_t *nodeB, sl_t *sl, void *ctx)
 		return luaL_error(L, "function not found! type=%s, value=%s,top=%d", typename, lua_tostring(L, -1), top);
 	}
 #endif
-		lua_pushlightuserdata(L, nodeA);
+		lua_pushlightuserdata(L, nodeA->udata);
 		lua_rawget(L, -3 - offset);		/*value_map, comp_func, valueA*/
 
-		lua_pushlightuserdata(L, nodeB);
+		lua_pushlightuserdata(L, nodeB->udata);
 		lua_rawget(L, -4 - offset);		/*value_map, comp_func, valueA, valueB*/
 
 	lua_pushnumber(L, nodeA->score);
@@ -168,9 +214,18 @@ static int compInLua(slNode_t *nodeA, slNode_t *nodeB, sl_t *sl, void *ctx)
 	return ret;
 }
 
+static slNode_t *luac__create_node(sl_t *sl, double score)
+{
+	int level = slRandomLevel();
+	if (sl->sum)
+		return slCreateSumNode(level, NULL, score);
+	return slCreateNode(level, NULL, score);
+}
+
 static int lua__new(lua_State *L)
 {
 	sl_t *sl;
+	int sum = lua_toboolean(L, 2);
 
 	if (lua_isnone(L, 1))
 		lua_pushnil(L);
@@ -178,16 +233,20 @@ static int lua__new(lua_State *L)
 		luaL_argcheck(L, 0, 1, "compare function|boolean<true for desc, false or nil for asec>");
 		return 0;
 	}
+	lua_settop(L, 1);
 
 	sl = (sl_t *)lua_newuserdata(L, sizeof(sl_t));
-	slInit(sl);
+	if (sum)
+		slInitSum(sl);
+	else
+		slInit(sl);
 
 	if (lua_isfunction(L, 1)) {
 		sl->comp = compInLua;
 	} else {
-		sl->comp = compByScore;
-		sl->udata = lua_toboolean(L, 1) ? sl : NULL;
+		sl->comp = lua_toboolean(L, 1) ? compByScoreDesc : compByScore;
 	}
+	sl->udata = NULL;
 
 	luaL_getmetatable(L, CLASS_SKIPLIST);
 	lua_setmetatable(L, -2);
@@ -219,7 +278,6 @@ static int lua__insert(lua_State *L)
 	double score;
 	sl_t *sl;
 	slNode_t *node;
-	int level;
 	int cur = 0;
 	
 	sl = CHECK_SL(L, 1);
@@ -228,8 +286,7 @@ static int lua__insert(lua_State *L)
 	if (node != NULL)
 		return luaL_error(L, "value exists");
 
-	level = slRandomLevel();
-	if ((node = slCreateNode(level, NULL, score)) == NULL)
+	if ((node = luac__create_node(sl, score)) == NULL)
 		return luaL_error(L, "no memory in lua__insert");
 
 	node->udata = node;
@@ -255,7 +312,6 @@ static int lua__insert(lua_State *L)
 
 static int lua__update(lua_State *L)
 {
-	int level;
 	double score;
 	int cur = 0;
 	sl_t *sl = CHECK_SL(L, 1);
@@ -270,6 +326,7 @@ static int lua__update(lua_State *L)
 		}
 
 		lua_getuservalue(L, 1);
+		luac__unexpire(L, lua_gettop(L), node);
 
 		lua_getfield(L, -1, "node_map");
 		lua_pushvalue(L, 2);
@@ -297,8 +354,7 @@ static int lua__update(lua_State *L)
 		}
 		node->score = score;
 	} else {
-		level = slRandomLevel();
-		if ((node = slCreateNode(level, NULL, score)) == NULL) {
+		if ((node = luac__create_node(sl, score)) == NULL) {
 			return luaL_error(L, "no memory in lua__update");
 		}
 		node->udata = node;
@@ -362,6 +418,7 @@ static int lua__delete(lua_State *L)
 	}
 
 	lua_getuservalue(L, 1);
+	luac__unexpire(L, lua_gettop(L), node);
 
 	lua_getfield(L, -1, "node_map");
 	lua_pushvalue(L, 2);
@@ -453,6 +510,8 @@ static int lua__get_by_rank(lua_State *L)
 	slNode_t *node;
 	sl_t *sl = CHECK_SL(L, 1);
 	int rank = luaL_checkinteger(L, 2);
+	if (rank < 0)
+		rank += (int)sl->size + 1;	/* -1 for the last */
 	if (rank <= 0 || rank > sl->size) {
 		lua_pushnil(L);
 		lua_pushliteral(L, "err index");
@@ -483,6 +542,8 @@ static int lua__del_by_rank(lua_State *L)
 	double score;
 	sl_t *sl = CHECK_SL(L, 1);
 	int rank = luaL_checkinteger(L, 2);
+	if (rank < 0)
+		rank += (int)sl->size + 1;	/* -1 for the last */
 	if (rank <= 0 || rank > sl->size) {
 		lua_pushnil(L);
 		lua_pushliteral(L, "err index");
@@ -499,6 +560,7 @@ static int lua__del_by_rank(lua_State *L)
 		return 0;
 	score = node->score;
 	lua_getuservalue(L, 1);
+	luac__unexpire(L, lua_gettop(L), node);
 	lua_getfield(L, -1, "value_map");
 	lua_pushlightuserdata(L, (void *)node);
 	lua_rawget(L, -2);
@@ -577,17 +639,17 @@ static int lua__score_range(lua_State *L)
 	return 3;
 }
 
+/**
+ * walks from the node to the tail, no comparison: cheap for the top of
+ * an ascending board, and no comp_func call on any list
+ */
 static int lua__rank_of(lua_State *L)
 {
 	int rank = 0;
 	sl_t *sl = CHECK_SL(L, 1);
-	int cur = 0;
 	slNode_t *node = luac__get_node(L, 1, 2);
-	if (node != NULL) {
-		SL_COMP_INIT(L, 1, cur, sl);
-		rank = slGetRank(sl, node, L);
-		SL_COMP_FINAL(L, cur, sl);
-	}
+	if (node != NULL)
+		rank = (int)sl->size - slGetRevRank(sl, node) + 1;
 	lua_pushinteger(L, rank);
 	return 1;
 }
@@ -658,6 +720,8 @@ static void deleteCb(void *udata, void *ctx)
 	int top = lua_gettop(L);
 	/* node->udata = node, see lua__insert */ 
 
+	luac__unexpire(L, 4, udata);
+
 	/*sl, min, max, uservalue, value_map, node_map, udata(node)*/
 	lua_pushlightuserdata(L, udata);
 
@@ -694,6 +758,413 @@ static int lua__del_rank_range(lua_State *L)
 	return 1;
 }
 
+static int lua__sum_by_rank_range(lua_State *L)
+{
+	sl_t *sl = CHECK_SL(L, 1);
+	int rankMin = luaL_optinteger(L, 2, 1);
+	int rankMax = luaL_optinteger(L, 3, sl->size);
+	lua_pushnumber(L, slSumByRankRange(sl, rankMin, rankMax));
+	return 1;
+}
+
+static int lua__sum_by_score_range(lua_State *L)
+{
+	int count = 0;
+	double sum;
+	sl_t *sl = CHECK_SL(L, 1);
+	double min = luaL_checknumber(L, 2);
+	double max = luaL_optnumber(L, 3, DBL_MAX);
+	luaL_argcheck(L, min <= max, 3, "max should greater or equal than min");
+	sum = slSumByScoreRange(sl, min, max, &count);
+	lua_pushnumber(L, sum);
+	lua_pushinteger(L, count);
+	return 2;
+}
+
+/**
+ * histogram(min, max[, buckets]), histogram() drops it
+ */
+static int lua__histogram(lua_State *L)
+{
+	sl_t *sl = CHECK_SL(L, 1);
+	double min;
+	double max;
+	int buckets;
+	if (lua_isnoneornil(L, 2)) {
+		slSetHistogram(sl, 0.0, 0.0, 0);
+		return 0;
+	}
+	min = luaL_checknumber(L, 2);
+	max = luaL_checknumber(L, 3);
+	buckets = luaL_optinteger(L, 4, HIST_BUCKETS);
+	luaL_argcheck(L, min < max, 3, "max should greater than min");
+	luaL_argcheck(L, buckets > 0, 4, "buckets should greater than 0");
+	if (slSetHistogram(sl, min, max, buckets) != 0)
+		return luaL_error(L, "no memory in lua__histogram");
+	return 0;
+}
+
+/**
+ * the rank score would take in the order of sl, and the error bound;
+ * a desc list counts the scores above
+ */
+static int lua__approx_rank(lua_State *L)
+{
+	sl_t *sl = CHECK_SL(L, 1);
+	double score = luaL_checknumber(L, 2);
+	int err = 0;
+	int rank;
+	if (sl->hist == NULL)
+		return luaL_error(L, "no histogram, call histogram(min, max) first");
+	rank = slApproxRank(sl, score, &err);
+	if (sl->comp == compByScoreDesc)
+		rank = (int)sl->size - rank + 2;
+	lua_pushinteger(L, rank);
+	lua_pushinteger(L, err);
+	return 2;
+}
+
+/**
+ * percent of members ranked before score, in [0, 100]
+ */
+static int lua__approx_percentile(lua_State *L)
+{
+	sl_t *sl = CHECK_SL(L, 1);
+	double score = luaL_checknumber(L, 2);
+	double pct;
+	if (sl->hist == NULL)
+		return luaL_error(L, "no histogram, call histogram(min, max) first");
+	pct = slApproxPercentile(sl, score);
+	if (sl->comp == compByScoreDesc && sl->size != 0)
+		pct = 100.0 - pct;
+	lua_pushnumber(L, pct);
+	return 1;
+}
+
+static void luac__set_op_counters(lua_State *L, const char *field, unsigned long *arr)
+{
+	lua_createtable(L, 0, SL_OP_MAX);
+	lua_pushnumber(L, arr[SL_OP_INSERT]);
+	lua_setfield(L, -2, "insert");
+	lua_pushnumber(L, arr[SL_OP_DELETE]);
+	lua_setfield(L, -2, "delete");
+	lua_pushnumber(L, arr[SL_OP_RANK]);
+	lua_setfield(L, -2, "rank_of");
+	lua_pushnumber(L, arr[SL_OP_BY_RANK]);
+	lua_setfield(L, -2, "get_by_rank");
+	lua_pushnumber(L, arr[SL_OP_BY_SCORE]);
+	lua_setfield(L, -2, "score_range");
+	lua_setfield(L, -2, field);
+}
+
+static int lua__stats(lua_State *L)
+{
+	int i;
+	struct slStats_s stats;
+	sl_t *sl = CHECK_SL(L, 1);
+	slGetStats(sl, &stats);
+
+	lua_createtable(L, 0, 16);
+	lua_pushinteger(L, stats.size);
+	lua_setfield(L, -2, "size");
+	lua_pushinteger(L, stats.level);
+	lua_setfield(L, -2, "level");
+
+	lua_createtable(L, stats.level, 0);
+	for (i = 0; i < stats.level; i++) {
+		lua_pushinteger(L, stats.levelHist[i]);
+		lua_rawseti(L, -2, i + 1);
+	}
+	lua_setfield(L, -2, "level_hist");
+
+	lua_pushnumber(L, stats.nodeBytes);
+	lua_setfield(L, -2, "node_bytes");
+	lua_pushnumber(L, stats.towerBytes);
+	lua_setfield(L, -2, "tower_bytes");
+	lua_pushnumber(L, stats.avgHeight);
+	lua_setfield(L, -2, "avg_height");
+
+	if (stats.countersEnabled) {
+		unsigned long ops = 0;
+		unsigned long visited = 0;
+		for (i = 0; i < SL_OP_MAX; i++) {
+			ops += stats.counters.ops[i];
+			visited += stats.counters.visited[i];
+		}
+		lua_pushnumber(L, stats.counters.comparisons);
+		lua_setfield(L, -2, "comparisons");
+		lua_pushnumber(L, stats.counters.inserts);
+		lua_setfield(L, -2, "inserts");
+		lua_pushnumber(L, stats.counters.deletes);
+		lua_setfield(L, -2, "deletes");
+		luac__set_op_counters(L, "ops", stats.counters.ops);
+		luac__set_op_counters(L, "visited", stats.counters.visited);
+		lua_pushnumber(L, stats.counters.maxDescent);
+		lua_setfield(L, -2, "max_descent");
+		lua_pushnumber(L, ops == 0 ? 0.0 : (double)visited / ops);
+		lua_setfield(L, -2, "avg_descent");
+	}
+	return 1;
+}
+
+/**
+ * sl:expire_at(data, deadline), deadline nil to clear;
+ * the deadline index and expire_map (node_ptr -> deadline node) are made
+ * on first use
+ */
+static int lua__expire_at(lua_State *L)
+{
+	sl_t *sl = CHECK_SL(L, 1);
+	slNode_t *node = luac__get_node(L, 1, 2);
+	sl_t *expire;
+	slNode_t *enode;
+	slNode_t *p;
+	double deadline;
+	(void)sl;
+	if (node == NULL) {
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+	lua_settop(L, 3);
+	lua_getuservalue(L, 1);			/*idx = 4*/
+	if (lua_isnil(L, 3)) {
+		luac__unexpire(L, 4, node);
+		lua_pushboolean(L, 1);
+		return 1;
+	}
+	deadline = luaL_checknumber(L, 3);
+	lua_getfield(L, 4, "expire");
+	if ((expire = lua_touserdata(L, -1)) == NULL) {
+		lua_pop(L, 1);
+		expire = (sl_t *)lua_newuserdata(L, sizeof(sl_t));
+		slInit(expire);
+		expire->udata = NULL;
+		luaL_getmetatable(L, CLASS_EXPIRE);
+		lua_setmetatable(L, -2);
+		lua_pushvalue(L, -1);
+		lua_setfield(L, 4, "expire");
+		lua_newtable(L);
+		lua_setfield(L, 4, "expire_map");
+	}
+	lua_getfield(L, 4, "expire_map");	/*idx = 6*/
+	lua_pushlightuserdata(L, (void *)node);
+	lua_rawget(L, 6);
+	if ((enode = lua_touserdata(L, -1)) != NULL) {
+		slDeleteNode(expire, enode, NULL, &p);
+		enode->score = deadline;
+	} else {
+		/* udata orders equal deadlines by node, see internalComp */
+		if ((enode = slCreateNode(slRandomLevel(), node, deadline)) == NULL)
+			return luaL_error(L, "no memory in lua__expire_at");
+		lua_pushlightuserdata(L, (void *)node);
+		lua_pushlightuserdata(L, (void *)enode);
+		lua_rawset(L, 6);
+	}
+	slInsertNode(expire, enode, NULL);
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+/**
+ * sl:expire(now[, budget]), delete members whose deadline <= now,
+ * at most budget, return the list of their data;
+ * batches are cut off the deadline index by slExpire and swept out of sl
+ * by slDeleteNodes
+ */
+static int lua__expire(lua_State *L)
+{
+	sl_t *sl = CHECK_SL(L, 1);
+	double now = luaL_checknumber(L, 2);
+	int budget = luaL_optinteger(L, 3, INT_MAX);
+	slNode_t *due[EXPIRE_BATCH];
+	slNode_t *nodes[EXPIRE_BATCH];
+	slNode_t *p;
+	sl_t *expire;
+	int removed = 0;
+	int cur = 0;
+	int ret;
+	int n;
+	int i;
+	lua_settop(L, 3);
+	lua_getuservalue(L, 1);			/*idx = 4*/
+	lua_getfield(L, 4, "value_map");	/*idx = 5*/
+	lua_getfield(L, 4, "node_map");		/*idx = 6*/
+	lua_getfield(L, 4, "expire_map");	/*idx = 7*/
+	lua_getfield(L, 4, "expire");		/*idx = 8*/
+	lua_newtable(L);			/*idx = 9*/
+	if ((expire = lua_touserdata(L, 8)) == NULL)
+		return 1;
+	while (removed < budget) {
+		n = budget - removed < EXPIRE_BATCH ? budget - removed : EXPIRE_BATCH;
+		if ((n = slExpire(expire, now, n, due)) == 0)
+			break;
+		for (i = 0; i < n; i++) {
+			nodes[i] = due[i]->udata;
+			lua_pushlightuserdata(L, (void *)nodes[i]);
+			lua_pushnil(L);
+			lua_rawset(L, 7);
+			slFreeNode(due[i], NULL, NULL);
+		}
+		SL_COMP_INIT(L, 1, cur, sl);
+		if (slSortNodes(sl, nodes, n, L) == 0) {
+			ret = slDeleteNodes(sl, nodes, n, L) == n ? 0 : -1;
+		} else {
+			for (i = 0, ret = 0; i < n; i++)
+				ret |= slDeleteNode(sl, nodes[i], L, &p);
+		}
+		SL_COMP_FINAL(L, cur, sl);
+		if (ret != 0) {
+			return luaL_error(L, "compare function implementation maybe error in %s:%d", __FUNCTION__, __LINE__);
+		}
+		for (i = 0; i < n; i++) {
+			lua_pushlightuserdata(L, (void *)nodes[i]);
+			lua_rawget(L, 5);
+			lua_pushvalue(L, -1);
+			lua_pushnil(L);
+			lua_rawset(L, 6);
+			lua_rawseti(L, 9, removed + i + 1);
+
+			lua_pushlightuserdata(L, (void *)nodes[i]);
+			lua_pushnil(L);
+			lua_rawset(L, 5);
+			slFreeNode(nodes[i], NULL, NULL);
+		}
+		removed += n;
+	}
+	return 1;
+}
+
+static int lua__expire_gc(lua_State *L)
+{
+	sl_t *expire = (sl_t *)luaL_checkudata(L, 1, CLASS_EXPIRE);
+	slDestroy(expire, NULL, NULL);
+	return 0;
+}
+
+/**
+ * the uservalue of a cursor holds sl, value_map, comp_func like the one
+ * of sl, so SL_COMP_INIT works on index 1, and value of the last node
+ */
+static int lua__cursor(lua_State *L)
+{
+	sl_t *sl = CHECK_SL(L, 1);
+	int rank = luaL_optinteger(L, 2, 0);
+	int reverse = lua_toboolean(L, 3);
+	slCursor_t *c;
+	lua_settop(L, 3);
+	c = (slCursor_t *)lua_newuserdata(L, sizeof(slCursor_t));
+	slCursorInit(c, sl, rank, reverse);
+	luaL_getmetatable(L, CLASS_CURSOR);
+	lua_setmetatable(L, -2);
+
+	lua_createtable(L, 0, 4);
+		lua_pushvalue(L, 1);
+		lua_setfield(L, -2, "sl");
+
+		lua_getuservalue(L, 1);
+		lua_getfield(L, -1, "value_map");
+		lua_setfield(L, -3, "value_map");
+		lua_getfield(L, -1, "comp_func");
+		lua_setfield(L, -3, "comp_func");
+		lua_pop(L, 1);
+	lua_setuservalue(L, -2);
+	return 1;
+}
+
+/**
+ * cursor at 1; push value, score, rank of the next node, or nothing
+ */
+static int luac__cursor_step(lua_State *L, slCursor_t *c)
+{
+	int top = lua_gettop(L);
+	int cur = 0;
+	int pinned = 0;
+	void *key = c->key;
+	sl_t *sl = c->sl;
+	slNode_t *node;
+
+	lua_getuservalue(L, 1);
+	lua_getfield(L, -1, "value_map");	/*uv, value_map*/
+	if (c->node != NULL && c->version != sl->version && sl->comp == compInLua) {
+		/* the re-seek key may be deleted, comp_func still needs its value */
+		lua_pushlightuserdata(L, key);
+		lua_rawget(L, -2);
+		if (lua_isnil(L, -1)) {
+			pinned = 1;
+			lua_pushlightuserdata(L, key);
+			lua_getfield(L, -4, "value");
+			lua_rawset(L, -4);
+		}
+		lua_pop(L, 1);
+	}
+	SL_COMP_INIT(L, 1, cur, sl);
+	node = slCursorNext(c, L);
+	SL_COMP_FINAL(L, cur, sl);
+	if (pinned) {
+		lua_pushlightuserdata(L, key);
+		lua_pushnil(L);
+		lua_rawset(L, -3);
+	}
+	if (node == NULL) {
+		lua_settop(L, top);
+		return 0;
+	}
+	lua_pushlightuserdata(L, (void *)node);
+	lua_rawget(L, -2);
+	lua_pushvalue(L, -1);
+	lua_setfield(L, -4, "value");
+	lua_replace(L, top + 1);
+	lua_settop(L, top + 1);
+	lua_pushnumber(L, node->score);
+	lua_pushinteger(L, c->rank);
+	return 3;
+}
+
+static int lua__cursor_next(lua_State *L)
+{
+	slCursor_t *c = CHECK_CURSOR(L, 1);
+	lua_settop(L, 1);
+	return luac__cursor_step(L, c);
+}
+
+static int lua__cursor_page(lua_State *L)
+{
+	slCursor_t *c = CHECK_CURSOR(L, 1);
+	int n = luaL_checkinteger(L, 2);
+	int i;
+	luaL_argcheck(L, n >= 0, 2, "count >= 0 required");
+	lua_settop(L, 1);
+	lua_createtable(L, n, 0);
+	for (i = 1; i <= n; i++) {
+		if (luac__cursor_step(L, c) == 0)
+			break;
+		lua_pop(L, 2);
+		lua_rawseti(L, 2, i);
+	}
+	return 1;
+}
+
+static int lua__cursor_rank(lua_State *L)
+{
+	slCursor_t *c = CHECK_CURSOR(L, 1);
+	lua_pushinteger(L, c->node == NULL ? 0 : c->rank);
+	return 1;
+}
+
+static int opencls__cursor(lua_State *L)
+{
+	luaL_Reg lmethods[] = {
+		{"next", lua__cursor_next},
+		{"page", lua__cursor_page},
+		{"rank", lua__cursor_rank},
+		{NULL, NULL},
+	};
+	luaL_newmetatable(L, CLASS_CURSOR);
+	luaL_newlib(L, lmethods);
+	lua_setfield(L, -2, "__index");
+	return 1;
+}
+
 static int opencls__skiplist(lua_State *L)
 {
 	luaL_Reg lmethods[] = {
@@ -712,6 +1183,15 @@ static int opencls__skiplist(lua_State *L)
 		{"prev", lua__prev},
 		{"size", lua__size},
 		{"rank_pairs", lua__rank_pairs},
+		{"stats", lua__stats},
+		{"sum_by_rank_range", lua__sum_by_rank_range},
+		{"sum_by_score_range", lua__sum_by_score_range},
+		{"cursor", lua__cursor},
+		{"expire_at", lua__expire_at},
+		{"expire", lua__expire},
+		{"histogram", lua__histogram},
+		{"approx_rank", lua__approx_rank},
+		{"approx_percentile", lua__approx_percentile},
 		{NULL, NULL},
 	};
 	luaL_newmetatable(L, CLASS_SKIPLIST);
@@ -729,13 +1209,82 @@ static int opencls__skiplist(lua_State *L)
 	return 1;
 }
 
+/**
+ * lskiplist.merge_range({sl1, sl2, ...}, rankMin, rankMax)
+ * data and scores of the merged rank range, lists compare with score
+ * in the same direction
+ */
+static int lua__merge_range(lua_State *L)
+{
+	sl_t *lists[SL_MERGE_MAX];
+	slMerge_t m;
+	slNode_t *node;
+	int n;
+	int i;
+	int list;
+	int rankMin = luaL_optinteger(L, 2, 1);
+	int rankMax;
+	size_t total = 0;
+
+	luaL_checktype(L, 1, LUA_TTABLE);
+	n = (int)lua_rawlen(L, 1);
+	luaL_argcheck(L, n >= 1 && n <= SL_MERGE_MAX, 1, "1 to 64 skiplists");
+	lua_settop(L, 3);
+	luaL_checkstack(L, n + 4, "too many skiplists");
+	/* value_map of every list at 4 + i */
+	for (i = 0; i < n; i++) {
+		lua_rawgeti(L, 1, i + 1);
+		lists[i] = (sl_t *)lua_touserdata(L, -1);
+		if (lists[i] == NULL || !lua_getmetatable(L, -1))
+			return luaL_error(L, "merge_range: item %d is not a skiplist", i + 1);
+		luaL_getmetatable(L, CLASS_SKIPLIST);
+		if (!lua_rawequal(L, -1, -2))
+			return luaL_error(L, "merge_range: item %d is not a skiplist", i + 1);
+		lua_pop(L, 2);
+		if (!IS_BY_SCORE(lists[i]) || lists[i]->comp != lists[0]->comp)
+			return luaL_error(L, "merge_range: skiplists must compare with score in one direction");
+		total += lists[i]->size;
+		lua_getuservalue(L, -1);
+		lua_getfield(L, -1, "value_map");
+		lua_replace(L, -3);
+		lua_pop(L, 1);
+	}
+	rankMax = luaL_optinteger(L, 3, (int)total);
+	if (total == 0) {
+		lua_createtable(L, 0, 0);
+		lua_createtable(L, 0, 0);
+		return 2;
+	}
+	if (rankMin <= 0 || rankMin > rankMax)
+		return luaL_error(L, "range error!");
+	if ((size_t)rankMax > total)
+		rankMax = (int)total;
+
+	lua_createtable(L, rankMax >= rankMin ? rankMax - rankMin + 1 : 0, 0);
+	lua_createtable(L, rankMax >= rankMin ? rankMax - rankMin + 1 : 0, 0);
+	slMergeInit(&m, lists, n, rankMin, L);
+	for (i = 1; i <= rankMax - rankMin + 1 && (node = slMergeNext(&m, &list)) != NULL; i++) {
+		lua_pushlightuserdata(L, (void *)node);
+		lua_rawget(L, 4 + list);
+		lua_rawseti(L, -3, i);
+		lua_pushnumber(L, node->score);
+		lua_rawseti(L, -2, i);
+	}
+	return 2;
+}
+
 int luaopen_lskiplist(lua_State* L)
 {
 	luaL_Reg lfuncs[] = {
 		{"new", lua__new},
+		{"merge_range", lua__merge_range},
 		{NULL, NULL},
 	};
 	opencls__skiplist(L);
+	opencls__cursor(L);
+	luaL_newmetatable(L, CLASS_EXPIRE);
+	lua_pushcfunction(L, lua__expire_gc);
+	lua_setfield(L, -2, "__gc");
 	luaL_newlib(L, lfuncs);
 	lua_pushnumber(L, EPSILON);
 	lua_setfield(L, -2, "EPSILON");
@@ -0,0 +1,391 @@
+--[[
+luajit ffi binding of skiplist, with the plain methods of lskiplist:
+insert, update, delete, exists, get_by_rank, del_by_rank,
+del_by_rank_range, rank_of, rank_range, get_score, score_range, next,
+prev, size and rank_pairs. stats, sums, cursor, expire, histogram and
+merge_range are only in lskiplist.
+
+nodes are read directly through ffi, and range queries fill cdata
+arrays via slGetRankRange/slGetScoreRange, so that hot loops can be
+compiled by the jit instead of calling into lua_CFunction.
+
+only score ordering is supported here, lskiplist_ffi.new(comp_func)
+falls back to lskiplist for a custom compare function.
+
+usage:
+	local lskiplist = require "lskiplist_ffi"
+	local sl = lskiplist.new()	-- asec
+	local sl = lskiplist.new(true)	-- desc
+]]
+
+local ffi = require "ffi"
+
+ffi.cdef[[
+typedef struct slNode_s slNode_t;
+typedef struct skiplist_s sl_t;
+
+typedef void (*slFreeCb)(void *udata, void *ctx);
+typedef int (*slCompareCb)(slNode_t *nodeA, slNode_t *nodeB, sl_t *sl, void *ctx);
+
+struct levelNode_s {
+	slNode_t *next;
+	size_t span;
+};
+
+struct slNode_s {
+	double score;
+	void *udata;
+	slNode_t *prev;
+	int levelSize;
+	int levelCap;
+	struct levelNode_s level[1];
+};
+
+struct slNodeMax_s {
+	double score;
+	void *udata;
+	slNode_t *prev;
+	int levelSize;
+	int levelCap;
+	struct levelNode_s level[32];
+};
+
+struct skiplist_s {
+	struct slNodeMax_s head;
+	slNode_t *tail;
+	int level;
+	size_t size;
+	slCompareCb comp;
+	void *udata;
+	size_t cap;
+	int sum;
+	int det;
+	int embed;
+	int lazy;
+	int borrowed;
+	double headSum[32];
+	unsigned long version;
+	void *hist;
+	void *compact;
+};
+
+int slRandomLevel(void);
+slNode_t * slCreateNode(int level, void *udata, double score);
+void slFreeNode(slNode_t *node, slFreeCb freeCb, void *ctx);
+sl_t *slCreate(void);
+void slFree(sl_t *sl, slFreeCb freeCb, void *ctx);
+void slInsertNode(sl_t *sl, slNode_t *node, void *ctx);
+int slGetRank(sl_t *sl, slNode_t *node, void *ctx);
+slNode_t * slGetNodeByRank(sl_t *sl, int rank);
+int slDeleteNode(sl_t *sl, slNode_t *node, void *ctx, slNode_t **pNode);
+int slDeleteByRankRange(sl_t *sl, int rankMin, int rankMax, slFreeCb freeCb, void *ctx);
+int slGetRankRange(sl_t *sl, int rankMin, int rankMax,
+		   void **udataArr, double *scoreArr, int sz);
+int slGetScoreRange(sl_t *sl, double min, double max,
+		    int *pRankMin, int *pRankMax,
+		    void **udataArr, double *scoreArr, int sz);
+]]
+
+local C = ffi.load(assert(package.searchpath("lskiplist", package.cpath),
+			  "lskiplist.so not found in package.cpath"))
+
+local M = {}
+M.EPSILON = 1e-15
+
+-- private keys, tables can not collide with user data
+local K_SL, K_NODES, K_VALUES, K_SIGN, K_ID = {}, {}, {}, {}, {}
+
+local cast = ffi.cast
+local intptr_t = ffi.typeof("intptr_t")
+local voidp_t = ffi.typeof("void *")
+local pnode_t = ffi.typeof("slNode_t *[1]")
+local prank_t = ffi.typeof("int [2]")
+
+local buf_sz = 0
+local udata_buf, score_buf
+
+local function reserve(n)
+	if n > buf_sz then
+		buf_sz = n
+		udata_buf = ffi.new("void *[?]", n)
+		score_buf = ffi.new("double [?]", n)
+	end
+end
+
+local function id_of(node)
+	return tonumber(cast(intptr_t, node.udata))
+end
+
+local function free_sl(sl)
+	C.slFree(sl, nil, nil)
+end
+
+local methods = {}
+local mt = {}
+
+function M.new(comp)
+	if type(comp) == "function" then
+		return require("lskiplist").new(comp)
+	end
+	if comp ~= nil and type(comp) ~= "boolean" then
+		error("compare function|boolean<true for desc, false or nil for asec>", 2)
+	end
+	local sl = C.slCreate()
+	if sl == nil then
+		error("no memory in new")
+	end
+	return setmetatable({
+		[K_SL] = ffi.gc(sl, free_sl),
+		[K_NODES] = {},		-- k = lua_value, value = node
+		[K_VALUES] = {},	-- k = node id, value = lua_value
+		[K_SIGN] = comp and -1 or 1,
+		[K_ID] = 0,
+	}, mt)
+end
+
+local function unlink(self, v, node)
+	self[K_NODES][v] = nil
+	self[K_VALUES][id_of(node)] = nil
+end
+
+function methods:insert(v, score)
+	local nodes = self[K_NODES]
+	if v == nil then
+		error("number|string|table|udata required!", 2)
+	end
+	if nodes[v] ~= nil then
+		error("value exists", 2)
+	end
+	local id = self[K_ID] + 1
+	local node = C.slCreateNode(C.slRandomLevel(), cast(voidp_t, id),
+				    (score or 0.0) * self[K_SIGN])
+	if node == nil then
+		error("no memory in insert")
+	end
+	self[K_ID] = id
+	nodes[v] = node
+	self[K_VALUES][id] = v
+	C.slInsertNode(self[K_SL], node, nil)
+	return node
+end
+
+function methods:delete(v)
+	local node = self[K_NODES][v]
+	if node == nil then
+		return
+	end
+	unlink(self, v, node)
+	if C.slDeleteNode(self[K_SL], node, nil, nil) ~= 0 then
+		error("delete error")
+	end
+	return true
+end
+
+function methods:update(v, score)
+	local node = self[K_NODES][v]
+	if score == nil then
+		if node ~= nil then
+			methods.delete(self, v)
+		end
+		return
+	end
+	if node == nil then
+		return methods.insert(self, v, score)
+	end
+	local sl = self[K_SL]
+	local pnode = pnode_t()
+	if C.slDeleteNode(sl, node, nil, pnode) ~= 0 then
+		error("update error")
+	end
+	node.score = score * self[K_SIGN]
+	C.slInsertNode(sl, node, nil)
+	return node
+end
+
+function methods:exists(v)
+	return self[K_NODES][v] ~= nil
+end
+
+function methods:size()
+	return tonumber(self[K_SL].size)
+end
+
+function methods:get_score(v)
+	local node = self[K_NODES][v]
+	if node == nil then
+		return
+	end
+	return node.score * self[K_SIGN]
+end
+
+function methods:get_by_rank(rank)
+	local sl = self[K_SL]
+	if rank < 0 then
+		rank = rank + tonumber(sl.size) + 1	-- -1 for the last
+	end
+	if rank <= 0 or rank > sl.size then
+		return nil, "err index"
+	end
+	local node = C.slGetNodeByRank(sl, rank)
+	if node == nil then
+		return
+	end
+	return self[K_VALUES][id_of(node)], node.score * self[K_SIGN]
+end
+
+function methods:del_by_rank(rank)
+	local sl = self[K_SL]
+	if rank < 0 then
+		rank = rank + tonumber(sl.size) + 1	-- -1 for the last
+	end
+	if rank <= 0 or rank > sl.size then
+		return nil, "err index"
+	end
+	local node = C.slGetNodeByRank(sl, rank)
+	if node == nil then
+		return
+	end
+	local v, score = self[K_VALUES][id_of(node)], node.score * self[K_SIGN]
+	methods.delete(self, v)
+	return v, score
+end
+
+function methods:del_by_rank_range(min, max)
+	local sl = self[K_SL]
+	local size = tonumber(sl.size)
+	max = max or min
+	if not (1 <= min and min <= max and min <= size) then
+		error("bad argument #2 to 'del_by_rank_range' (min [1, size])", 2)
+	end
+	if not (1 <= max and min <= max and max <= size) then
+		error("bad argument #3 to 'del_by_rank_range' (max [1, size])", 2)
+	end
+	local cnt = max - min + 1
+	reserve(cnt)
+	local n = C.slGetRankRange(sl, min, max, udata_buf, nil, cnt)
+	local nodes, values = self[K_NODES], self[K_VALUES]
+	for i = 0, n - 1 do
+		local id = tonumber(cast(intptr_t, udata_buf[i]))
+		nodes[values[id]] = nil
+		values[id] = nil
+	end
+	return C.slDeleteByRankRange(sl, min, max, nil, nil)
+end
+
+function methods:rank_of(v)
+	local node = self[K_NODES][v]
+	if node == nil then
+		return 0
+	end
+	return C.slGetRank(self[K_SL], node, nil)
+end
+
+function methods:rank_range(min, max)
+	local sl = self[K_SL]
+	local size = tonumber(sl.size)
+	min = min or 1
+	max = max or size
+	if size == 0 then
+		return {}
+	end
+	if min <= 0 or min > max or max > size then
+		error("range error!", 2)
+	end
+	local cnt = max - min + 1
+	reserve(cnt)
+	local n = C.slGetRankRange(sl, min, max, udata_buf, nil, cnt)
+	local values = self[K_VALUES]
+	local list = {}
+	for i = 0, n - 1 do
+		list[i + 1] = values[tonumber(cast(intptr_t, udata_buf[i]))]
+	end
+	return list
+end
+
+function methods:score_range(min, max)
+	max = max or math.huge
+	if not (min < max) then
+		error("bad argument #3 to 'score_range' (max should greater or equal than min)", 2)
+	end
+	local sl = self[K_SL]
+	local sign = self[K_SIGN]
+	if sign < 0 then
+		min, max = -max, -min
+	end
+	local ranks = prank_t()
+	C.slGetScoreRange(sl, min, max, ranks, ranks + 1, nil, nil, 0)
+	local rankMin, rankMax = ranks[0], ranks[1]
+	if rankMin > rankMax then
+		return
+	end
+	local cnt = rankMax - rankMin + 1
+	reserve(cnt)
+	local n = C.slGetScoreRange(sl, min, max, nil, nil, udata_buf, nil, cnt)
+	local values = self[K_VALUES]
+	local list = {}
+	for i = 0, n - 1 do
+		list[i + 1] = values[tonumber(cast(intptr_t, udata_buf[i]))]
+	end
+	return list, rankMin, rankMax
+end
+
+function methods:next(v)
+	local node = self[K_NODES][v]
+	if node == nil then
+		return
+	end
+	local next = node.level[0].next
+	if next == nil then
+		return
+	end
+	return self[K_VALUES][id_of(next)]
+end
+
+function methods:prev(v)
+	local node = self[K_NODES][v]
+	if node == nil then
+		return
+	end
+	local prev = node.prev
+	if prev == nil then
+		return
+	end
+	return self[K_VALUES][id_of(prev)]
+end
+
+function methods:rank_pairs(min, max)
+	local sl = self[K_SL]
+	local size = tonumber(sl.size)
+	min = min or 1
+	max = max or size
+	if min < 1 or min > max or max > size then
+		error(string.format("range error! range should be[1, %d],but[%d, %d]",
+				    size, min, max), 2)
+	end
+	local values, sign = self[K_VALUES], self[K_SIGN]
+	local node = C.slGetNodeByRank(sl, min)
+	local rank = min
+	return function()
+		if rank > max or node == nil then
+			return
+		end
+		local cur = node
+		local r = rank
+		node = cur.level[0].next
+		rank = rank + 1
+		return r, values[id_of(cur)], cur.score * sign
+	end
+end
+
+mt.__index = function(self, k)
+	local m = methods[k]
+	if m ~= nil then
+		return m
+	end
+	return methods.get_score(self, k)
+end
+mt.__newindex = methods.update
+-- #sl needs a luajit built with LUAJIT_ENABLE_LUA52COMPAT
+mt.__len = methods.size
+
+return M
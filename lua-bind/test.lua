@@ -218,6 +218,94 @@ function test.rank_pairs()
 	end
 end
 
+function test.sum()
+	local list = {2, 5, 1, 3, 9, 7, 6, 8, 4}
+	for _, sum in pairs({true, false}) do
+		local sl = lskiplist.new(nil, sum)
+		for _, i in pairs(list) do
+			sl:insert(i, i * 10)
+		end
+		sl:update(5, 55)
+		sl:delete(9)
+		sl:del_by_rank(1)
+		print("sum", sum, "top3", sl:sum_by_rank_range(1, 3))
+		print("sum", sum, "rank 2-5", sl:sum_by_rank_range(2, 5))
+		print("sum", sum, "score 30-60", sl:sum_by_score_range(30, 60))
+	end
+end
+
+function test.cursor()
+	local sl = new()
+	for _, reverse in pairs({false, true}) do
+		local c = sl:cursor(nil, reverse)
+		print("cursor", reverse, "page", table.concat(c:page(3), ", "), "rank", c:rank())
+		sl:delete(reverse and 6 or 4)
+		sl:insert(reverse and 5.5 or 3.5, reverse and 55 or 35)
+		for v, score, rank in c.next, c do
+			print("cursor", reverse, rank, v, score)
+		end
+	end
+end
+
+function test.expire()
+	local sl = new()
+	for i = 1, 9 do
+		sl:expire_at(i, 100 + i % 3)
+	end
+	sl:expire_at(3, nil)
+	sl:delete(4)
+	print("expire 101, budget 2", table.concat(sl:expire(101, 2), ", "))
+	print("expire 101", table.concat(sl:expire(101), ", "))
+	print("expire 102", table.concat(sl:expire(102), ", "))
+	dump(sl, "expire")
+end
+
+function test.approx_rank()
+	for _, desc in pairs({false, true}) do
+		local sl = lskiplist.new(desc)
+		sl:histogram(0, 1000, 10)
+		for i = 1, 100 do
+			sl:insert(i, i * 10)
+		end
+		sl:update(50, 995)
+		sl:del_by_rank(1)
+		for _, score in pairs({0, 250, 500, 995, 2000}) do
+			local rank, err = sl:approx_rank(score)
+			print("approx_rank", desc, score, rank, err, sl:approx_percentile(score))
+		end
+	end
+end
+
+function test.merge_range()
+	local boards = {}
+	for b = 1, 3 do
+		boards[b] = lskiplist.new(true)
+		for i = 1, 10 do
+			boards[b]:insert(b * 100 + i, (i * 7 + b * 3) % 50)
+		end
+	end
+	local values, scores = lskiplist.merge_range(boards, 1, 10)
+	for i, v in ipairs(values) do
+		print("merge_range top10", i, v, scores[i])
+	end
+	values, scores = lskiplist.merge_range(boards, 25, 40)
+	print("merge_range 25-40", table.concat(values, ", "))
+end
+
+function test.rev_rank()
+	local sl = lskiplist.new(true)
+	for i = 1, 20 do
+		sl:insert(i, i % 7)
+	end
+	for _, rank in pairs({1, 2, 19, 20, -1, -2, -20, -21, 21}) do
+		print("get_by_rank", rank, sl:get_by_rank(rank))
+	end
+	for _, v in pairs({1, 7, 14, 20}) do
+		print("rank_of", v, sl:rank_of(v))
+	end
+	dump(sl, "rev_rank")
+end
+
 function main()
 	local sl = test.insert()
 	dump(sl, "insert")
@@ -269,6 +357,24 @@ function main()
 
 	print("===============")
 	test.rank_pairs()
+
+	print("===============")
+	test.sum()
+
+	print("===============")
+	test.cursor()
+
+	print("===============")
+	test.expire()
+
+	print("===============")
+	test.approx_rank()
+
+	print("===============")
+	test.merge_range()
+
+	print("===============")
+	test.rev_rank()
 end
 
 main()
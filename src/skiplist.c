@@ -3,6 +3,7 @@
 #include <stddef.h>
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 #include "skiplist.h"
 
 #define ENABLE_SL_DEBUG 0
@@ -12,10 +13,82 @@
 # define DLOG(...)
 #endif
 
+#if SL_ENABLE_STATS
+# define SL_COMP(sl, a, b, ctx) ((sl)->counters.comparisons++, (sl)->comp(a, b, sl, ctx))
+# define SL_HOP_DECL unsigned long hops = 0;
+# define SL_HOP() (hops++)
+# define SL_HOP_DONE(sl, op) slCountOp(sl, op, hops)
+# define SL_COUNT(sl, field, n) ((sl)->counters.field += (n))
+#else
+# define SL_COMP(sl, a, b, ctx) ((sl)->comp(a, b, sl, ctx))
+# define SL_HOP_DECL
+# define SL_HOP() ((void)0)
+# define SL_HOP_DONE(sl, op) ((void)0)
+# define SL_COUNT(sl, field, n) ((void)0)
+#endif
 
 static void slInitNode(slNode_t *node, int level, void *udata, double score);
 static int internalComp(slNode_t *nodeA, slNode_t *nodeB, sl_t *sl, void *ctx);
+static int internalCompDesc(slNode_t *nodeA, slNode_t *nodeB, sl_t *sl, void *ctx);
 static void slDeleteNodeUpdate(sl_t *sl, slNode_t *node, slNode_t **update);
+static void slSumLink(sl_t *sl, slNode_t *node, slNode_t **update, double *sum);
+static void slCompactFree(sl_t *sl);
+
+#if SL_ENABLE_STATS
+static void slCountOp(sl_t *sl, int op, unsigned long hops)
+{
+	sl->counters.ops[op]++;
+	sl->counters.visited[op] += hops;
+	if (hops > sl->counters.maxDescent)
+		sl->counters.maxDescent = hops;
+}
+#endif
+
+/*
+ * lazy spans, see slSetLazySpans: a span of 0 on a link that has a next
+ * node is dirty, readers fix it from the level below on first use
+ */
+#define SL_SPAN(sl, p, i) ((p)->level[i].span != 0 || !(sl)->lazy \
+		? (p)->level[i].span : slSpanFix(p, i))
+
+static size_t slSpanFix(slNode_t *p, int i)
+{
+	slNode_t *q = p->level[i].next;
+	slNode_t *x;
+	size_t span = 0;
+	if (q == NULL || i == 0)
+		return p->level[i].span;
+	for (x = p; x != q; x = x->level[i - 1].next)
+		span += x->level[i - 1].span != 0 ? x->level[i - 1].span : slSpanFix(x, i - 1);
+	p->level[i].span = span;
+	return span;
+}
+
+#define SL_HIST(sl, score, delta) do { \
+	if ((sl)->hist != NULL) \
+		slHistAdd((sl)->hist, score, delta); \
+} while (0)
+
+static int slHistBucket(struct slHist_s *h, double score)
+{
+	double x = (score - h->min) * h->scale;
+	if (!(x >= 0.0))
+		return 0;
+	if (x >= h->buckets)
+		return h->buckets - 1;
+	return (int)x;
+}
+
+/* counts are unsigned, a delta of -1 wraps around like a subtraction */
+static void slHistAdd(struct slHist_s *h, double score, int delta)
+{
+	int b = slHistBucket(h, score);
+	size_t d = (size_t)delta;
+	h->count[b] += d;
+	h->size += d;
+	for (b++; b <= h->buckets; b += b & -b)
+		h->tree[b] += d;
+}
 
 int slRandomLevel()
 {
@@ -39,13 +112,41 @@ static int internalComp(slNode_t *nodeA, slNode_t *nodeB, sl_t *sl, void *ctx)
 	return d < 0 ? -1 : 1;
 }
 
+/* score descending, equal scores like internalComp */
+static int internalCompDesc(slNode_t *nodeA, slNode_t *nodeB, sl_t *sl, void *ctx)
+{
+	if (nodeA->score != nodeB->score)
+		return nodeA->score - nodeB->score > 0 ? -1 : 1;
+	return internalComp(nodeA, nodeB, sl, ctx);
+}
+
 void slInit(sl_t *sl)
 {
 	sl->level = 1;
 	sl->size = 0;
+	sl->version = 0;
 	sl->tail = NULL;
+	sl->cap = 0;
+	sl->sum = 0;
+	sl->det = 0;
+	sl->embed = 0;
+	sl->lazy = 0;
+	sl->borrowed = 0;
+	sl->hist = NULL;
+	sl->compact = NULL;
+	memset(sl->headSum, 0, sizeof(sl->headSum));
 	sl->comp = internalComp;
 	slInitNode(SL_HEAD(sl), SKIPLIST_MAXLEVEL, NULL, DBL_MIN);
+	slResetCounters(sl);
+}
+
+void slResetCounters(sl_t *sl)
+{
+#if SL_ENABLE_STATS
+	memset(&sl->counters, 0, sizeof(sl->counters));
+#else
+	(void)sl;
+#endif
 }
 
 sl_t * slCreate()
@@ -59,6 +160,141 @@ sl_t * slCreate()
 	return sl;
 }
 
+void slInitSum(sl_t *sl)
+{
+	slInit(sl);
+	sl->sum = 1;
+}
+
+sl_t * slCreateSum()
+{
+	sl_t *sl = slCreate();
+	if (sl != NULL)
+		sl->sum = 1;
+	return sl;
+}
+
+int slSetDeterministic(sl_t *sl, int det)
+{
+	if (sl->size != 0 || det < 0 || det == 1 || det > SKIPLIST_MAXLEVEL ||
+	    (det && (sl->sum || sl->lazy)))
+		return -1;
+	sl->det = det;
+	return 0;
+}
+
+int slSetDescending(sl_t *sl, int desc)
+{
+	if (sl->size != 0)
+		return -1;
+	sl->comp = desc ? internalCompDesc : internalComp;
+	return 0;
+}
+
+int slSetLazySpans(sl_t *sl, int lazy)
+{
+	slNode_t *p;
+	int i;
+	if (lazy && (sl->sum || sl->det))
+		return -1;
+	if (sl->lazy && !lazy) {
+		/* bottom up, so the level below is exact when a link is fixed */
+		for (i = 1; i < sl->level; i++) {
+			for (p = SL_HEAD(sl); p->level[i].next != NULL; p = p->level[i].next)
+				SL_SPAN(sl, p, i);
+		}
+	}
+	sl->lazy = lazy != 0;
+	return 0;
+}
+
+int slSetEmbedded(sl_t *sl, int embed)
+{
+	if (sl->size != 0)
+		return -1;
+	sl->embed = embed != 0;
+	return 0;
+}
+
+int slSetHistogram(sl_t *sl, double min, double max, int buckets)
+{
+	struct slHist_s *h;
+	slNode_t *node;
+	int b;
+	int up;
+	if (buckets <= 0) {
+		free(sl->hist);
+		sl->hist = NULL;
+		return 0;
+	}
+	if (!(min < max))
+		return -1;
+	h = malloc(sizeof(*h) + sizeof(size_t) * (2 * (size_t)buckets + 1));
+	if (h == NULL)
+		return -1;
+	h->min = min;
+	h->scale = buckets / (max - min);
+	h->buckets = buckets;
+	h->size = sl->size;
+	h->count = (size_t *)(h + 1);
+	h->tree = h->count + buckets;
+	memset(h->count, 0, sizeof(size_t) * (2 * (size_t)buckets + 1));
+	for (node = SL_FIRST(sl); node != NULL; node = SL_NEXT(node))
+		h->count[slHistBucket(h, node->score)]++;
+	/* build the tree in place, every slot adds itself to its parent */
+	for (b = 1; b <= buckets; b++) {
+		h->tree[b] += h->count[b - 1];
+		up = b + (b & -b);
+		if (up <= buckets)
+			h->tree[up] += h->tree[b];
+	}
+	free(sl->hist);
+	sl->hist = h;
+	return 0;
+}
+
+/**
+ * estimate of the scores < score, the exact count is within
+ * [prefix, prefix + count[b]] of the bucket b of score
+ */
+static double slHistBelow(struct slHist_s *h, double score, size_t *pErr)
+{
+	int b = slHistBucket(h, score);
+	double x = (score - h->min) * h->scale - b;
+	size_t below = 0;
+	int i;
+	if (!(x >= 0.0))
+		x = 0.0;
+	else if (x > 1.0)
+		x = 1.0;
+	for (i = b; i > 0; i -= i & -i)
+		below += h->tree[i];
+	*pErr = h->count[b];
+	return below + x * h->count[b];
+}
+
+int slApproxRank(sl_t *sl, double score, int *pErr)
+{
+	size_t err;
+	double below;
+	if (sl->hist == NULL)
+		return 0;
+	below = slHistBelow(sl->hist, score, &err);
+	if (pErr != NULL)
+		*pErr = (int)err;
+	return (int)(below + 0.5) + 1;
+}
+
+double slApproxPercentile(sl_t *sl, double score)
+{
+	size_t err;
+	if (sl->hist == NULL)
+		return -1.0;
+	if (sl->hist->size == 0)
+		return 0.0;
+	return slHistBelow(sl->hist, score, &err) * 100.0 / sl->hist->size;
+}
+
 slCompareCb slSetCompareCb(sl_t *sl, slCompareCb comp)
 {
 	slCompareCb old = sl->comp;
@@ -72,8 +308,11 @@ void slDestroy(sl_t *sl, slFreeCb freeCb, void *ctx)
 	slNode_t *next;
 	for (node = SL_FIRST(sl); node != NULL; node = next) {
 		next = node->level[0].next;
-		slFreeNode(node, freeCb, ctx);
+		slReleaseNode(sl, node, freeCb, ctx);
 	}
+	free(sl->hist);
+	sl->hist = NULL;
+	slCompactFree(sl);
 }
 
 void slFree(sl_t *sl, slFreeCb freeCb, void *ctx)
@@ -89,6 +328,7 @@ static void slInitNode(slNode_t *node, int level, void *udata, double score)
 	node->udata = udata;
 	node->prev = NULL;
 	node->levelSize = level;
+	node->levelCap = level;
 	for (i = 0; i < level; i++) {
 		node->level[i].next = NULL;
 		node->level[i].span = 0;
@@ -106,6 +346,20 @@ finished:
 	return node;
 }
 
+slNode_t * slCreateSumNode(int level, void *udata, double score)
+{
+	int i;
+	size_t node_sz = sizeof(slNode_t) + sizeof(struct levelNode_s) * (level - 1)
+			+ sizeof(double) * level;
+	slNode_t *node = malloc(node_sz);
+	if (node == NULL)
+		return NULL;
+	slInitNode(node, level, udata, score);
+	for (i = 0; i < level; i++)
+		((double *)&node->level[level])[i] = 0.0;
+	return node;
+}
+
 void slFreeNode(slNode_t *node, slFreeCb freeCb, void *ctx)
 {
 	if (freeCb != NULL) {
@@ -114,27 +368,327 @@ void slFreeNode(slNode_t *node, slFreeCb freeCb, void *ctx)
 	free(node);
 }
 
-void slInsertNode(sl_t *sl, slNode_t *node, void *ctx)
+void *slCreateEmbedded(sl_t *sl, size_t offset, int level, double score)
+{
+	size_t node_sz = sizeof(slNode_t) + sizeof(struct levelNode_s) * (level - 1);
+	char *obj;
+	slNode_t *node;
+	int i;
+	if (sl->sum)
+		node_sz += sizeof(double) * level;
+	if ((obj = malloc(offset + node_sz)) == NULL)
+		return NULL;
+	node = (slNode_t *)(obj + offset);
+	slInitNode(node, level, obj, score);
+	if (sl->sum) {
+		for (i = 0; i < level; i++)
+			SL_SUM(sl, node)[i] = 0.0;
+	}
+	return obj;
+}
+
+void slFreeEmbedded(slNode_t *node, slFreeCb freeCb, void *ctx)
+{
+	void *obj = node->udata;
+	if (freeCb != NULL)
+		freeCb(obj, ctx);
+	free(obj);
+}
+
+/*
+ * compaction, see slCompact: moved nodes are carved in list order out
+ * of chunks, a chunk is freed when its last node leaves sl
+ */
+#define SL_CHUNK_BYTES 65536
+#define SL_CHUNK_ALIGN(n) (((n) + sizeof(double) - 1) / sizeof(double) * sizeof(double))
+
+struct slChunk_s {
+	size_t live;	/* nodes of it still owned by sl */
+	size_t nodes;	/* nodes handed out */
+	size_t used;	/* bytes handed out */
+	size_t cap;
+	double mem[1];
+};
+
+struct slCompact_s {
+	size_t rank;			/* where the next call goes on */
+	struct slChunk_s **chunks;	/* by address */
+	int n;
+	int cap;
+	struct slChunk_s *fill;		/* moved nodes go here */
+};
+
+static struct slChunk_s *slChunkOf(struct slCompact_s *cp, const void *p)
+{
+	const char *c = p;
+	int lo = 0;
+	int hi = cp->n - 1;
+	while (lo <= hi) {
+		int mid = (lo + hi) / 2;
+		struct slChunk_s *k = cp->chunks[mid];
+		const char *base = (const char *)k->mem;
+		if (c < base)
+			hi = mid - 1;
+		else if (c >= base + k->cap)
+			lo = mid + 1;
+		else
+			return k;
+	}
+	return NULL;
+}
+
+static void slChunkDrop(struct slCompact_s *cp, struct slChunk_s *k)
+{
+	int i;
+	for (i = 0; cp->chunks[i] != k; i++)
+		;
+	memmove(cp->chunks + i, cp->chunks + i + 1, sizeof(*cp->chunks) * (cp->n - i - 1));
+	cp->n--;
+	free(k);
+}
+
+static slNode_t *slChunkAlloc(struct slCompact_s *cp, size_t bytes)
+{
+	struct slChunk_s *k = cp->fill;
+	char *p;
+	int i;
+	if (k == NULL || k->used + bytes > k->cap) {
+		size_t cap = bytes > SL_CHUNK_BYTES ? bytes : SL_CHUNK_BYTES;
+		if (cp->n == cp->cap) {
+			int n = cp->cap == 0 ? 16 : cp->cap * 2;
+			struct slChunk_s **chunks = realloc(cp->chunks, sizeof(*chunks) * n);
+			if (chunks == NULL)
+				return NULL;
+			cp->chunks = chunks;
+			cp->cap = n;
+		}
+		if ((k = malloc(offsetof(struct slChunk_s, mem) + cap)) == NULL)
+			return NULL;
+		k->live = 0;
+		k->nodes = 0;
+		k->used = 0;
+		k->cap = cap;
+		for (i = cp->n; i > 0 && (const char *)cp->chunks[i - 1] > (const char *)k; i--)
+			cp->chunks[i] = cp->chunks[i - 1];
+		cp->chunks[i] = k;
+		cp->n++;
+		if (cp->fill != NULL && cp->fill->live == 0)
+			slChunkDrop(cp, cp->fill);
+		cp->fill = k;
+	}
+	p = (char *)k->mem + k->used;
+	k->used += bytes;
+	k->nodes++;
+	k->live++;
+	return (slNode_t *)(void *)p;
+}
+
+static void slCompactFree(sl_t *sl)
+{
+	struct slCompact_s *cp = sl->compact;
+	int i;
+	if (cp == NULL)
+		return;
+	for (i = 0; i < cp->n; i++)
+		free(cp->chunks[i]);
+	free(cp->chunks);
+	free(cp);
+	sl->compact = NULL;
+}
+
+/* 1 if nodes of sl sit in chunks, they must not move to another list */
+static int slHasChunks(sl_t *sl)
+{
+	return sl->compact != NULL && sl->compact->n > 0;
+}
+
+void slReleaseNode(sl_t *sl, slNode_t *node, slFreeCb freeCb, void *ctx)
+{
+	struct slChunk_s *k;
+	if (sl->embed) {
+		slFreeEmbedded(node, freeCb, ctx);
+		return;
+	}
+	if (sl->compact == NULL || (k = slChunkOf(sl->compact, node)) == NULL) {
+		slFreeNode(node, freeCb, ctx);
+		return;
+	}
+	if (freeCb != NULL)
+		freeCb(node->udata, ctx);
+	if (--k->live > 0)
+		return;
+	if (k == sl->compact->fill) {
+		/* keep filling it from the start */
+		k->nodes = 0;
+		k->used = 0;
+	} else {
+		slChunkDrop(sl->compact, k);
+	}
+}
+
+/*
+ * deterministic mode, see slSetDeterministic
+ *
+ * the gap under a at level i is the run of nodes of height i between a,
+ * the head or a node taller than i, and a->level[i].next.
+ */
+#define SL_DET_GAP_MAX 3
+/* gaps are scanned this far at most, longer ones only come from bulk builds */
+#define SL_DET_GAP_SCAN 8
+
+static int slDetGap(slNode_t *a, int i, slNode_t **gap)
+{
+	slNode_t *end = a->level[i].next;
+	slNode_t *p;
+	int g = 0;
+	for (p = a->level[i - 1].next; p != end && g < SL_DET_GAP_SCAN; p = p->level[i - 1].next)
+		gap[g++] = p;
+	return g;
+}
+
+/**
+ * grow m, of height i in the gap under a, into level i
+ */
+static void slDetPromote(sl_t *sl, slNode_t *a, int i, slNode_t *m)
+{
+	slNode_t *p;
+	size_t d = 0;
+	for (p = a; p != m; p = p->level[i - 1].next)
+		d += p->level[i - 1].span;
+	m->level[i].next = a->level[i].next;
+	m->level[i].span = a->level[i].span - d;
+	a->level[i].next = m;
+	a->level[i].span = d;
+	m->levelSize = i + 1;
+	if (i >= sl->level)
+		sl->level = i + 1;
+}
+
+/**
+ * shrink m, of height i + 1 and next to a at level i, out of level i
+ */
+static void slDetDemote(slNode_t *a, int i, slNode_t *m)
+{
+	a->level[i].span += m->level[i].span;
+	a->level[i].next = m->level[i].next;
+	m->levelSize = i;
+}
+
+/**
+ * promote a node out of the gap under a at level i if it is overfull,
+ * from the middle outwards, leaving one node on each side at least
+ * return 1 if promoted
+ */
+static int slDetSplit(sl_t *sl, slNode_t *a, int i)
+{
+	slNode_t *gap[SL_DET_GAP_SCAN];
+	int g;
+	int k;
+	if (i >= SKIPLIST_MAXLEVEL)
+		return 0;
+	g = slDetGap(a, i, gap);
+	if (g <= SL_DET_GAP_MAX)
+		return 0;
+	for (k = 0; k < g - 2; k++) {
+		int j = g / 2 + (k % 2 == 0 ? k / 2 : -(k + 1) / 2);
+		if (gap[j]->levelCap > i) {
+			slDetPromote(sl, a, i, gap[j]);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * node was linked at height 1 after update[]
+ */
+static void slDetInsertFix(sl_t *sl, slNode_t **update)
+{
+	int i;
+	for (i = 1; i < SKIPLIST_MAXLEVEL; i++) {
+		if (!slDetSplit(sl, i < sl->level ? update[i] : SL_HEAD(sl), i))
+			break;
+	}
+}
+
+/**
+ * a node of height h was unlinked after update[]: the gaps it split
+ * below h are merged, the gap it was in at level h lost a node
+ */
+static void slDetDeleteFix(sl_t *sl, slNode_t **update, int h)
+{
+	slNode_t *gap[SL_DET_GAP_SCAN];
+	slNode_t *a;
+	slNode_t *b;
+	int i;
+	for (i = 1; i < h; i++)
+		slDetSplit(sl, update[i], i);
+	/* an emptied gap takes in a neighbour of height i + 1,
+	 * which may empty the gap above */
+	for (i = h; i < sl->level; i++) {
+		a = update[i];
+		if (slDetGap(a, i, gap) > 0)
+			break;
+		b = a->level[i].next;
+		if (b != NULL && b->levelSize == i + 1) {
+			slDetDemote(a, i, b);
+		} else if (a != SL_HEAD(sl) && a->levelSize == i + 1) {
+			b = a;
+			a = i + 1 < sl->level ? update[i + 1] : SL_HEAD(sl);
+			while (a->level[i].next != b)
+				a = a->level[i].next;
+			slDetDemote(a, i, b);
+		} else {
+			break;
+		}
+		if (slDetSplit(sl, a, i))
+			break;
+	}
+	while (sl->level > 1 && sl->head.level[sl->level - 1].next == NULL)
+		sl->level--;
+	slDetSplit(sl, SL_HEAD(sl), sl->level);
+}
+
+/**
+ * the search starts at update[sl->level - 1], ordered before node, whose
+ * rank and score sum are rank[] and sum[] at that level;
+ * leaves the path to node in update[], rank[] and sum[]
+ */
+static void slInsertFrom(sl_t *sl, slNode_t *node, slNode_t **update,
+			 int *rank, double *sum, void *ctx)
 {
 	int level;
-	slNode_t *update[SKIPLIST_MAXLEVEL];
 	slNode_t *p;
-	int rank[SKIPLIST_MAXLEVEL];
 	int i;
-	p = SL_HEAD(sl);
+	SL_HOP_DECL
+	if (sl->det) {
+		/* a shorter node leaves gaps that nothing can split */
+		assert(node->levelCap >= sl->det);
+		node->levelSize = 1;
+	}
+	p = update[sl->level - 1];
 	for (i = sl->level - 1; i >= 0; i--) {
-        	rank[i] = i == (sl->level-1) ? 0 : rank[i+1];
+		if (i != sl->level - 1) {
+			rank[i] = rank[i + 1];
+			sum[i] = sum[i + 1];
+		}
 		while (p->level[i].next != NULL
-			&& (sl->comp(p->level[i].next, node, sl, ctx) < 0)) {
-			rank[i] += p->level[i].span;
+			&& (SL_COMP(sl, p->level[i].next, node, ctx) < 0)) {
+			if (!sl->lazy)
+				rank[i] += p->level[i].span;
+			if (sl->sum)
+				sum[i] += SL_SUM(sl, p)[i];
 			p = p->level[i].next;
+			SL_HOP();
 		}
 		update[i] = p;
 	}
+	SL_HOP_DONE(sl, SL_OP_INSERT);
 	level = node->levelSize;
 	if (level > sl->level) {
 		for (i = sl->level; i < level; i++) {
 			rank[i] = 0;
+			sum[i] = 0.0;
 			update[i] = SL_HEAD(sl);
 			update[i]->level[i].span = sl->size;
 		}
@@ -144,18 +698,93 @@ void slInsertNode(sl_t *sl, slNode_t *node, void *ctx)
 		node->level[i].next = update[i]->level[i].next;
 		update[i]->level[i].next = node;
 
+		if (sl->lazy) {
+			/* no rank on the way down, both halves are dirty above level 0 */
+			node->level[i].span = i == 0;
+			update[i]->level[i].span = i == 0;
+			continue;
+		}
         	node->level[i].span = update[i]->level[i].span - (rank[0] - rank[i]);
 		update[i]->level[i].span = rank[0] - rank[i] + 1;
 	}
 	for (i = level; i < sl->level; i++) {
-		update[i]->level[i].span++;
+		if (!sl->lazy || update[i]->level[i].span != 0)
+			update[i]->level[i].span++;
 	}
+	if (sl->sum)
+		slSumLink(sl, node, update, sum);
 	node->prev = (update[0] == SL_HEAD(sl)) ? NULL : update[0];
 	if (node->level[0].next)
 		node->level[0].next->prev = node;
 	else
 		sl->tail = node;
 	sl->size++;
+	sl->version++;
+	SL_COUNT(sl, inserts, 1);
+	SL_HIST(sl, node->score, 1);
+	if (sl->det)
+		slDetInsertFix(sl, update);
+}
+
+void slInsertNode(sl_t *sl, slNode_t *node, void *ctx)
+{
+	slNode_t *update[SKIPLIST_MAXLEVEL];
+	int rank[SKIPLIST_MAXLEVEL];
+	double sum[SKIPLIST_MAXLEVEL];	/* like rank, on a sum list */
+	update[sl->level - 1] = SL_HEAD(sl);
+	rank[sl->level - 1] = 0;
+	sum[sl->level - 1] = 0.0;
+	slInsertFrom(sl, node, update, rank, sum, ctx);
+}
+
+void slInsertNodes(sl_t *sl, slNode_t **nodes, int n, void *ctx)
+{
+	slNode_t *update[SKIPLIST_MAXLEVEL];
+	int rank[SKIPLIST_MAXLEVEL];
+	double sum[SKIPLIST_MAXLEVEL];
+	int i;
+	int j;
+	if (sl->det) {
+		/* fixups move nodes around update[], one descent per node */
+		for (j = 0; j < n; j++)
+			slInsertNode(sl, nodes[j], ctx);
+		return;
+	}
+	for (i = 0; i < SKIPLIST_MAXLEVEL; i++) {
+		update[i] = SL_HEAD(sl);
+		rank[i] = 0;
+		sum[i] = 0.0;
+	}
+	for (j = 0; j < n; j++) {
+		slNode_t *node = nodes[j];
+		int r;
+		double s;
+		slInsertFrom(sl, node, update, rank, sum, ctx);
+		/* the next node is ordered after this one, start from it */
+		r = rank[0] + 1;
+		s = sum[0] + node->score;
+		for (i = 0; i < node->levelSize; i++) {
+			update[i] = node;
+			rank[i] = r;
+			sum[i] = s;
+		}
+	}
+}
+
+/**
+ * sum[i] is the score sum from the head to update[i], like rank[i]
+ */
+static void slSumLink(sl_t *sl, slNode_t *node, slNode_t **update, double *sum)
+{
+	int i;
+	double *nodeSum = SL_SUM(sl, node);
+	for (i = 0; i < node->levelSize; i++) {
+		double *updateSum = SL_SUM(sl, update[i]);
+		nodeSum[i] = updateSum[i] - (sum[0] - sum[i]);
+		updateSum[i] = sum[0] - sum[i] + node->score;
+	}
+	for (i = node->levelSize; i < sl->level; i++)
+		SL_SUM(sl, update[i])[i] += node->score;
 }
 
 static void slDeleteNodeUpdate(sl_t *sl, slNode_t *node, slNode_t **update)
@@ -164,10 +793,18 @@ static void slDeleteNodeUpdate(sl_t *sl, slNode_t *node, slNode_t **update)
 	slNode_t *header;
 	for (i = 0; i < sl->level; i++) {
 		if (update[i]->level[i].next == node) {
-			update[i]->level[i].span += node->level[i].span - 1;
+			if (sl->sum)
+				SL_SUM(sl, update[i])[i] += SL_SUM(sl, node)[i] - node->score;
+			if (sl->lazy && (update[i]->level[i].span == 0 || node->level[i].span == 0))
+				update[i]->level[i].span = 0;
+			else
+				update[i]->level[i].span += node->level[i].span - 1;
 			update[i]->level[i].next = node->level[i].next;
 		} else {
-			update[i]->level[i].span -= 1;
+			if (sl->sum)
+				SL_SUM(sl, update[i])[i] -= node->score;
+			if (!sl->lazy || update[i]->level[i].span != 0)
+				update[i]->level[i].span -= 1;
 		}
 	}
 	if (node->level[0].next != NULL) {
@@ -179,6 +816,11 @@ static void slDeleteNodeUpdate(sl_t *sl, slNode_t *node, slNode_t **update)
 	while(sl->level > 1 && header->level[sl->level-1].next == NULL)
 		sl->level--;
 	sl->size--;
+	sl->version++;
+	SL_COUNT(sl, deletes, 1);
+	SL_HIST(sl, node->score, -1);
+	if (sl->det)
+		slDetDeleteFix(sl, update, node->levelSize);
 }
 
 /**
@@ -191,14 +833,17 @@ int slDeleteNode(sl_t *sl, slNode_t *node, void *ctx, slNode_t **pNode)
 	slNode_t *next;
 
 	slNode_t *update[SKIPLIST_MAXLEVEL];
+	SL_HOP_DECL
 	p = SL_HEAD(sl);
 	for (i = sl->level - 1; i >= 0; i--) {
 		while (p->level[i].next != NULL &&
-		       sl->comp(p->level[i].next, node, sl, ctx) < 0) {
+		       SL_COMP(sl, p->level[i].next, node, ctx) < 0) {
 			p = p->level[i].next;
+			SL_HOP();
 		}
 		update[i] = p;
 	}
+	SL_HOP_DONE(sl, SL_OP_DELETE);
 	next = p->level[0].next;
 	if (next != node) {
 		DLOG("delete error,p=%p,node=%p,next=%p\n", (void *)p, (void *)node, (void *)next);
@@ -209,25 +854,49 @@ int slDeleteNode(sl_t *sl, slNode_t *node, void *ctx, slNode_t **pNode)
 	if (pNode != NULL)
 		*pNode = p;
 	else
-		slFreeNode(p, NULL, NULL);
+		slReleaseNode(sl, p, NULL, NULL);
 	return 0;
 }
 
+/*
+ * a descent from the head makes a couple of hops per level,
+ * ranks this close to the tail are nearer along SL_PREV
+ */
+#define SL_TAIL_WALK(sl) ((size_t)(sl)->level * 2)
+
+static slNode_t *slWalkBack(sl_t *sl, size_t n)
+{
+	slNode_t *p = sl->tail;
+	SL_HOP_DECL
+	while (n-- > 0) {
+		p = SL_PREV(p);
+		SL_HOP();
+	}
+	SL_HOP_DONE(sl, SL_OP_BY_RANK);
+	return p;
+}
+
 slNode_t * slGetNodeByRank(sl_t *sl, int rank)
 {
 	int traversed = 0;
 	slNode_t *p;
 	int i;
+	SL_HOP_DECL
+	if (rank >= 1 && (size_t)rank <= sl->size && sl->size - rank < SL_TAIL_WALK(sl))
+		return slWalkBack(sl, sl->size - rank);
 	p = SL_HEAD(sl);
 	for (i = sl->level - 1; i >= 0; i--) {
-		while (p->level[i].next != NULL && p->level[i].span + traversed <= rank) {
-			traversed += p->level[i].span;
+		while (p->level[i].next != NULL && SL_SPAN(sl, p, i) + traversed <= rank) {
+			traversed += SL_SPAN(sl, p, i);
 			p = p->level[i].next;
+			SL_HOP();
 		}
 		if (traversed == rank) {
+			SL_HOP_DONE(sl, SL_OP_BY_RANK);
 			return p;
 		}
 	}
+	SL_HOP_DONE(sl, SL_OP_BY_RANK);
 	return NULL;
 }
 
@@ -237,65 +906,179 @@ int slGetNodesRankRange(sl_t *sl,
 {
 	int n = 0;
 	slNode_t *p;
+	if (sz <= 0)
+		return 0;
 	SL_FOREACH_RANGE(sl, rankMin, rankMax, p, n) {
 		nodeArr[n] = p;
 		if (n + 1 >= sz)
-			break;
+			return n + 1;
 	}
 	return n;
 }
 
-int slGetSize(sl_t *sl)
+int slGetRankRange(sl_t *sl,
+		   int rankMin, int rankMax,
+		   void **udataArr, double *scoreArr, int sz)
 {
-	return sl->size;
+	int n = 0;
+	slNode_t *p;
+	if (sz <= 0 || rankMin < 1 || rankMin > rankMax)
+		return 0;
+	SL_FOREACH_RANGE(sl, rankMin, rankMax, p, n) {
+		if (n >= sz)
+			break;
+		if (udataArr != NULL)
+			udataArr[n] = p->udata;
+		if (scoreArr != NULL)
+			scoreArr[n] = p->score;
+	}
+	return n;
 }
 
-int slGetRank(sl_t *sl, slNode_t *node, void *ctx)
+int slGetScoreRange(sl_t *sl,
+		    double min, double max,
+		    int *pRankMin, int *pRankMax,
+		    void **udataArr, double *scoreArr, int sz)
 {
-	int traversed = 0;
-	slNode_t *p;
 	int i;
-	if (node == NULL)
-		return 0;
+	int n;
+	int rankMin = 0;
+	int rankMax = 0;
+	slNode_t *p;
+	slNode_t *first;
+	SL_HOP_DECL
+
+	/* rank of the last node whose score < min */
 	p = SL_HEAD(sl);
 	for (i = sl->level - 1; i >= 0; i--) {
 		while (p->level[i].next != NULL &&
-			sl->comp(p->level[i].next, node, sl, ctx) <= 0) {
-			traversed += p->level[i].span;
+		       p->level[i].next->score < min) {
+			rankMin += SL_SPAN(sl, p, i);
 			p = p->level[i].next;
+			SL_HOP();
 		}
-		if (sl->comp(p, node, sl, ctx) == 0) {
-			return traversed;
+	}
+	first = p->level[0].next;
+
+	/* rank of the last node whose score <= max */
+	p = SL_HEAD(sl);
+	for (i = sl->level - 1; i >= 0; i--) {
+		while (p->level[i].next != NULL &&
+		       p->level[i].next->score <= max) {
+			rankMax += SL_SPAN(sl, p, i);
+			p = p->level[i].next;
+			SL_HOP();
 		}
 	}
-	return 0;
+	SL_HOP_DONE(sl, SL_OP_BY_SCORE);
+	rankMin++;
+	if (pRankMin != NULL)
+		*pRankMin = rankMin;
+	if (pRankMax != NULL)
+		*pRankMax = rankMax;
+	for (p = first, n = 0; p != NULL && n < sz && n <= rankMax - rankMin; p = SL_NEXT(p), n++) {
+		if (udataArr != NULL)
+			udataArr[n] = p->udata;
+		if (scoreArr != NULL)
+			scoreArr[n] = p->score;
+	}
+	return n;
 }
 
-int slDeleteByRankRange(sl_t *sl, int rankMin, int rankMax, slFreeCb freeCb, void *ctx)
+int slGetSize(sl_t *sl)
+{
+	return sl->size;
+}
+
+slNode_t * slGetNodeByRevRank(sl_t *sl, int revRank)
+{
+	if (revRank < 1 || (size_t)revRank > sl->size)
+		return NULL;
+	return slGetNodeByRank(sl, (int)sl->size - revRank + 1);
+}
+
+int slGetRevRank(sl_t *sl, slNode_t *node)
+{
+	size_t revRank = 1;
+	slNode_t *p = node;
+	int i;
+	SL_HOP_DECL
+	/* the tallest link that has a next, up the towers then down to the tail */
+	for (;;) {
+		for (i = p->levelSize - 1; i >= 0 && p->level[i].next == NULL; i--)
+			;
+		if (i < 0)
+			break;
+		revRank += SL_SPAN(sl, p, i);
+		p = p->level[i].next;
+		SL_HOP();
+	}
+	SL_HOP_DONE(sl, SL_OP_RANK);
+	return (int)revRank;
+}
+
+int slGetRank(sl_t *sl, slNode_t *node, void *ctx)
+{
+	int traversed = 0;
+	slNode_t *p;
+	int i;
+	SL_HOP_DECL
+	if (node == NULL)
+		return 0;
+	p = SL_HEAD(sl);
+	for (i = sl->level - 1; i >= 0; i--) {
+		while (p->level[i].next != NULL &&
+			SL_COMP(sl, p->level[i].next, node, ctx) <= 0) {
+			traversed += SL_SPAN(sl, p, i);
+			p = p->level[i].next;
+			SL_HOP();
+		}
+		if (p != SL_HEAD(sl) && SL_COMP(sl, p, node, ctx) == 0) {
+			SL_HOP_DONE(sl, SL_OP_RANK);
+			return traversed;
+		}
+	}
+	SL_HOP_DONE(sl, SL_OP_RANK);
+	return 0;
+}
+
+int slDeleteByRankRange(sl_t *sl, int rankMin, int rankMax, slFreeCb freeCb, void *ctx)
 {
 	slNode_t *update[SKIPLIST_MAXLEVEL], *node;
 	int traversed = 0;
 	int removed = 0;
 	int i;
+	SL_HOP_DECL
 
 	assert(1 <= rankMin && rankMin <= rankMax && rankMin <= sl->size);
 	assert(1 <= rankMax && rankMin <= rankMax && rankMax <= sl->size);
 
+	if (sl->det) {
+		/* fixups relink around update[], one descent per node */
+		for (; removed <= rankMax - rankMin; removed++) {
+			slDeleteNode(sl, slGetNodeByRank(sl, rankMin), ctx, &node);
+			slReleaseNode(sl, node, freeCb, ctx);
+		}
+		return removed;
+	}
+
 	node = SL_HEAD(sl);
 	for (i = sl->level-1; i >= 0; i--) {
-		while (node->level[i].next && (traversed + node->level[i].span) < rankMin) {
-			traversed += node->level[i].span;
+		while (node->level[i].next && (traversed + SL_SPAN(sl, node, i)) < rankMin) {
+			traversed += SL_SPAN(sl, node, i);
 			node = node->level[i].next;
+			SL_HOP();
 		}
 		update[i] = node;
 	}
+	SL_HOP_DONE(sl, SL_OP_DELETE);
 
 	traversed++;
 	node = node->level[0].next;
 	while (node && traversed <= rankMax) {
 		slNode_t *next = node->level[0].next;
-		slDeleteNode(sl, node, NULL, update);
-		slFreeNode(node, freeCb, ctx);
+		slDeleteNodeUpdate(sl, node, update);
+		slReleaseNode(sl, node, freeCb, ctx);
 		removed++;
 		traversed++;
 		node = next;
@@ -303,6 +1086,709 @@ int slDeleteByRankRange(sl_t *sl, int rankMin, int rankMax, slFreeCb freeCb, voi
 	return removed;
 }
 
+/**
+ * unlink the last node and return it
+ */
+static slNode_t *slUnlinkTail(sl_t *sl)
+{
+	slNode_t *update[SKIPLIST_MAXLEVEL];
+	slNode_t *node = sl->tail;
+	slNode_t *p;
+	size_t traversed = 0;
+	int i;
+	if (node->levelSize == 1 && !sl->det) {
+		/* only level 0 points to it, and the span of the last link
+		 * of a level is never read, so prev is all we need */
+		p = node->prev != NULL ? node->prev : SL_HEAD(sl);
+		p->level[0].next = NULL;
+		sl->tail = node->prev;
+		sl->size--;
+		sl->version++;
+		SL_COUNT(sl, deletes, 1);
+		SL_HIST(sl, node->score, -1);
+		return node;
+	}
+	/* taller towers: find the predecessors by rank, no comparison */
+	p = SL_HEAD(sl);
+	for (i = sl->level - 1; i >= 0; i--) {
+		while (p->level[i].next != NULL && traversed + SL_SPAN(sl, p, i) < sl->size) {
+			traversed += SL_SPAN(sl, p, i);
+			p = p->level[i].next;
+		}
+		update[i] = p;
+	}
+	slDeleteNodeUpdate(sl, node, update);
+	return node;
+}
+
+size_t slSetCapacity(sl_t *sl, size_t cap, slFreeCb freeCb, void *ctx)
+{
+	size_t removed = 0;
+	sl->cap = cap;
+	while (cap > 0 && sl->size > cap) {
+		slReleaseNode(sl, slUnlinkTail(sl), freeCb, ctx);
+		removed++;
+	}
+	return removed;
+}
+
+int slInsertCapped(sl_t *sl, slNode_t *node, void *ctx, slNode_t **pEvicted)
+{
+	slNode_t *evicted = NULL;
+	if (pEvicted != NULL)
+		*pEvicted = NULL;
+	if (sl->cap > 0 && sl->size >= sl->cap) {
+		/* full, anything ordered after the tail would be evicted at once */
+		if (SL_COMP(sl, node, SL_LAST(sl), ctx) >= 0)
+			return 1;
+		evicted = slUnlinkTail(sl);
+	}
+	slInsertNode(sl, node, ctx);
+	if (evicted == NULL)
+		return 0;
+	if (pEvicted != NULL)
+		*pEvicted = evicted;
+	else
+		slReleaseNode(sl, evicted, NULL, NULL);
+	return 0;
+}
+
+int slBuildSorted(sl_t *sl, slNode_t **nodes, int n)
+{
+	slNode_t *last[SKIPLIST_MAXLEVEL];
+	size_t lastRank[SKIPLIST_MAXLEVEL];
+	double lastSum[SKIPLIST_MAXLEVEL];
+	double sum = 0.0;
+	slNode_t *prev = NULL;
+	int i;
+	int j;
+	if (sl->size != 0)
+		return -1;
+	for (j = 0; j < SKIPLIST_MAXLEVEL; j++) {
+		last[j] = SL_HEAD(sl);
+		lastRank[j] = 0;
+		lastSum[j] = 0.0;
+	}
+	for (i = 0; i < n; i++) {
+		slNode_t *node = nodes[i];
+		sum += node->score;
+		SL_HIST(sl, node->score, 1);
+		for (j = 0; j < node->levelSize; j++) {
+			last[j]->level[j].next = node;
+			last[j]->level[j].span = i + 1 - lastRank[j];
+			if (sl->sum)
+				SL_SUM(sl, last[j])[j] = sum - lastSum[j];
+			last[j] = node;
+			lastRank[j] = i + 1;
+			lastSum[j] = sum;
+		}
+		if (node->levelSize > sl->level)
+			sl->level = node->levelSize;
+		node->prev = prev;
+		prev = node;
+	}
+	for (j = 0; j < SKIPLIST_MAXLEVEL; j++) {
+		last[j]->level[j].next = NULL;
+		last[j]->level[j].span = n - lastRank[j];
+		if (sl->sum)
+			SL_SUM(sl, last[j])[j] = sum - lastSum[j];
+	}
+	sl->tail = prev;
+	sl->size = n;
+	sl->version++;
+	SL_COUNT(sl, inserts, n);
+	return 0;
+}
+
+/**
+ * update[i] = last node at level i within the first rank nodes,
+ * rank[i] and sum[i] its rank and score prefix sum
+ */
+static void slFindRank(sl_t *sl, size_t r, slNode_t **update, size_t *rank, double *sum)
+{
+	slNode_t *p = SL_HEAD(sl);
+	size_t traversed = 0;
+	double s = 0.0;
+	int i;
+	for (i = SKIPLIST_MAXLEVEL - 1; i >= sl->level; i--) {
+		update[i] = p;
+		rank[i] = 0;
+		sum[i] = 0.0;
+	}
+	for (i = sl->level - 1; i >= 0; i--) {
+		while (p->level[i].next != NULL && traversed + SL_SPAN(sl, p, i) <= r) {
+			traversed += SL_SPAN(sl, p, i);
+			if (sl->sum)
+				s += SL_SUM(sl, p)[i];
+			p = p->level[i].next;
+		}
+		update[i] = p;
+		rank[i] = traversed;
+		sum[i] = s;
+	}
+}
+
+static void slShrinkLevel(sl_t *sl)
+{
+	while (sl->level > 1 && sl->head.level[sl->level - 1].next == NULL)
+		sl->level--;
+}
+
+int slSplitAtRank(sl_t *sl, int rank, sl_t *out)
+{
+	slNode_t *update[SKIPLIST_MAXLEVEL];
+	size_t rankArr[SKIPLIST_MAXLEVEL];
+	double sum[SKIPLIST_MAXLEVEL];
+	slNode_t *first;
+	size_t r;
+	int i;
+	if (out->size != 0 || out->sum != sl->sum || out->embed != sl->embed ||
+	    out->lazy != sl->lazy || slHasChunks(sl))
+		return -1;
+	out->comp = sl->comp;
+	r = rank < 0 ? 0 : (size_t)rank;
+	if (r >= sl->size)
+		return 0;
+	slFindRank(sl, r, update, rankArr, sum);
+	for (i = 0; i < sl->level; i++) {
+		slNode_t *p = update[i];
+		out->head.level[i].next = p->level[i].next;
+		out->head.level[i].span = SL_SPAN(sl, p, i) - (r - rankArr[i]);
+		if (sl->sum)
+			out->headSum[i] = SL_SUM(sl, p)[i] - (sum[0] - sum[i]);
+		p->level[i].next = NULL;
+		p->level[i].span = 0;
+	}
+	first = out->head.level[0].next;
+	first->prev = NULL;
+	if (sl->hist != NULL || out->hist != NULL) {
+		slNode_t *node;
+		for (node = first; node != NULL; node = SL_NEXT(node)) {
+			SL_HIST(sl, node->score, -1);
+			SL_HIST(out, node->score, 1);
+		}
+	}
+	out->tail = sl->tail;
+	out->size = sl->size - r;
+	out->level = sl->level;
+	sl->tail = r == 0 ? NULL : update[0];
+	sl->size = r;
+	sl->version++;
+	out->version++;
+	slShrinkLevel(sl);
+	slShrinkLevel(out);
+	return 0;
+}
+
+int slConcat(sl_t *a, sl_t *b, void *ctx)
+{
+	slNode_t *bHead = SL_HEAD(b);
+	slNode_t *update[SKIPLIST_MAXLEVEL];
+	size_t rank[SKIPLIST_MAXLEVEL];
+	double sum[SKIPLIST_MAXLEVEL];
+	int level;
+	int i;
+	if (a->sum != b->sum || a->embed != b->embed || a->lazy != b->lazy ||
+	    a->det != b->det || slHasChunks(b))
+		return -1;
+	if (b->size == 0)
+		return 0;
+	if (a->size != 0 && SL_COMP(a, SL_LAST(a), SL_FIRST(b), ctx) >= 0)
+		return -1;
+	if (a->hist != NULL || b->hist != NULL) {
+		slNode_t *node;
+		for (node = SL_FIRST(b); node != NULL; node = SL_NEXT(node)) {
+			SL_HIST(a, node->score, 1);
+			SL_HIST(b, node->score, -1);
+		}
+	}
+	slFindRank(a, a->size, update, rank, sum);
+	level = a->level > b->level ? a->level : b->level;
+	/* top down, a dirty span of b's head is fixed from the level below */
+	for (i = level - 1; i >= 0; i--) {
+		slNode_t *p = update[i];
+		p->level[i].next = b->head.level[i].next;
+		p->level[i].span = a->size - rank[i] + SL_SPAN(b, bHead, i);
+		if (a->sum)
+			SL_SUM(a, p)[i] = sum[0] - sum[i] + b->headSum[i];
+		b->head.level[i].next = NULL;
+		b->head.level[i].span = 0;
+		b->headSum[i] = 0.0;
+	}
+	update[0]->level[0].next->prev = a->size == 0 ? NULL : update[0];
+	a->tail = b->tail;
+	a->size += b->size;
+	a->version++;
+	b->version++;
+	a->level = level;
+	b->tail = NULL;
+	b->size = 0;
+	b->level = 1;
+	return 0;
+}
+
+int slDeleteNodes(sl_t *sl, slNode_t **nodes, int n, void *ctx)
+{
+	slNode_t *update[SKIPLIST_MAXLEVEL];
+	slNode_t *p;
+	int removed = 0;
+	int i;
+	int j;
+	if (sl->det) {
+		/* fixups relink around update[], one descent per node */
+		for (j = 0; j < n; j++)
+			removed += slDeleteNode(sl, nodes[j], ctx, &p) == 0;
+		return removed;
+	}
+	for (i = 0; i < SKIPLIST_MAXLEVEL; i++)
+		update[i] = SL_HEAD(sl);
+	for (j = 0; j < n; j++) {
+		SL_HOP_DECL
+		/* the path to the last node is still in front of this one */
+		p = update[sl->level - 1];
+		for (i = sl->level - 1; i >= 0; i--) {
+			while (p->level[i].next != NULL &&
+			       SL_COMP(sl, p->level[i].next, nodes[j], ctx) < 0) {
+				p = p->level[i].next;
+				SL_HOP();
+			}
+			update[i] = p;
+		}
+		SL_HOP_DONE(sl, SL_OP_DELETE);
+		if (p->level[0].next != nodes[j])
+			continue;
+		slDeleteNodeUpdate(sl, nodes[j], update);
+		removed++;
+	}
+	return removed;
+}
+
+int slExpire(sl_t *sl, double now, int budget, slNode_t **nodeArr)
+{
+	slNode_t *update[SKIPLIST_MAXLEVEL];
+	size_t rank[SKIPLIST_MAXLEVEL];
+	double sum[SKIPLIST_MAXLEVEL];
+	slNode_t *head = SL_HEAD(sl);
+	slNode_t *p;
+	size_t k = 0;
+	int i;
+	int n;
+	SL_HOP_DECL
+	if (budget <= 0)
+		return 0;
+	/* count the due nodes, at most budget */
+	p = head;
+	for (i = sl->level - 1; i >= 0; i--) {
+		while (p->level[i].next != NULL && p->level[i].next->score <= now &&
+		       k + SL_SPAN(sl, p, i) <= (size_t)budget) {
+			k += SL_SPAN(sl, p, i);
+			p = p->level[i].next;
+			SL_HOP();
+		}
+	}
+	SL_HOP_DONE(sl, SL_OP_BY_SCORE);
+	if (k == 0)
+		return 0;
+	for (p = SL_FIRST(sl), n = 0; n < (int)k; p = SL_NEXT(p), n++)
+		nodeArr[n] = p;
+	if (sl->det) {
+		for (i = 0; i < SKIPLIST_MAXLEVEL; i++)
+			update[i] = head;
+		for (n = 0; n < (int)k; n++)
+			slDeleteNodeUpdate(sl, nodeArr[n], update);
+		return n;
+	}
+	/* cut the prefix [1, k] off the head along one search path */
+	slFindRank(sl, k, update, rank, sum);
+	for (i = 0; i < sl->level; i++) {
+		p = update[i];
+		if (p == head) {
+			head->level[i].span -= k;
+			if (sl->sum)
+				sl->headSum[i] -= sum[0];
+			continue;
+		}
+		head->level[i].next = p->level[i].next;
+		head->level[i].span = rank[i] + SL_SPAN(sl, p, i) - k;
+		if (sl->sum)
+			sl->headSum[i] = sum[i] + SL_SUM(sl, p)[i] - sum[0];
+	}
+	if (SL_FIRST(sl) != NULL)
+		SL_FIRST(sl)->prev = NULL;
+	else
+		sl->tail = NULL;
+	sl->size -= k;
+	sl->version++;
+	SL_COUNT(sl, deletes, k);
+	if (sl->hist != NULL) {
+		for (n = 0; n < (int)k; n++)
+			slHistAdd(sl->hist, nodeArr[n]->score, -1);
+	}
+	slShrinkLevel(sl);
+	return (int)k;
+}
+
+static size_t slNodeBytes(sl_t *sl, slNode_t *node)
+{
+	size_t sz = sizeof(slNode_t) + sizeof(struct levelNode_s) * (node->levelCap - 1);
+	if (sl->sum)
+		sz += sizeof(double) * node->levelCap;
+	return SL_CHUNK_ALIGN(sz);
+}
+
+/**
+ * a node stays where it is if it sits in a chunk that is not mostly
+ * holes, after prev if prev is in the same chunk
+ */
+static int slChunkKeep(struct slCompact_s *cp, slNode_t *prev, slNode_t *x)
+{
+	struct slChunk_s *k = slChunkOf(cp, x);
+	if (k == NULL)
+		return 0;
+	if (k != cp->fill && k->live * 4 < k->nodes)
+		return 0;
+	return prev == NULL || slChunkOf(cp, prev) != k || (const char *)prev < (const char *)x;
+}
+
+int slCompact(sl_t *sl, int budget, slMoveCb moveCb, void *ctx)
+{
+	slNode_t *update[SKIPLIST_MAXLEVEL];
+	size_t rank[SKIPLIST_MAXLEVEL];
+	double sum[SKIPLIST_MAXLEVEL];
+	slNode_t *head = SL_HEAD(sl);
+	struct slCompact_s *cp = sl->compact;
+	slNode_t *x;
+	slNode_t *next;
+	slNode_t *to;
+	size_t bytes;
+	int walked = 0;
+	int moved = 0;
+	int ret = 0;
+	int i;
+	if (sl->embed || sl->borrowed)
+		return -1;
+	if (cp == NULL) {
+		if ((cp = calloc(1, sizeof(*cp))) == NULL)
+			return -1;
+		cp->rank = 1;
+		sl->compact = cp;
+	}
+	if (cp->rank > sl->size) {
+		/* the last call ended the pass */
+		cp->rank = 1;
+		return 0;
+	}
+	/* update[i] is the node linking to the next one at level i */
+	slFindRank(sl, cp->rank - 1, update, rank, sum);
+	for (x = SL_NEXT(update[0]); x != NULL && walked < budget; x = next, walked++) {
+		next = SL_NEXT(x);
+		if (!slChunkKeep(cp, update[0] == head ? NULL : update[0], x)) {
+			bytes = slNodeBytes(sl, x);
+			if ((to = slChunkAlloc(cp, bytes)) == NULL) {
+				ret = -1;
+				break;
+			}
+			memcpy(to, x, bytes);
+			for (i = 0; i < x->levelSize; i++)
+				update[i]->level[i].next = to;
+			if (next != NULL)
+				next->prev = to;
+			else
+				sl->tail = to;
+			if (moveCb != NULL)
+				moveCb(x, to, ctx);
+			slReleaseNode(sl, x, NULL, NULL);
+			x = to;
+			moved++;
+		}
+		for (i = 0; i < x->levelSize; i++)
+			update[i] = x;
+	}
+	cp->rank = x == NULL ? sl->size + 1 : cp->rank + walked;
+	if (moved > 0)
+		sl->version++;
+	return ret < 0 ? ret : walked;
+}
+
+typedef int (*slSortCb)(void *a, void *b, void *ctx);
+
+/**
+ * stable bottom-up merge sort of n pointers, tmp holds n pointers
+ */
+static void slMergeSort(void **arr, void **tmp, size_t n, slSortCb cmp, void *ctx)
+{
+	size_t width;
+	void **src = arr;
+	void **dst = tmp;
+	for (width = 1; width < n; width *= 2) {
+		size_t lo;
+		void **t;
+		for (lo = 0; lo < n; lo += width * 2) {
+			size_t mid = lo + width < n ? lo + width : n;
+			size_t hi = lo + width * 2 < n ? lo + width * 2 : n;
+			size_t a = lo;
+			size_t b = mid;
+			size_t k = lo;
+			while (a < mid && b < hi)
+				dst[k++] = cmp(src[b], src[a], ctx) < 0 ? src[b++] : src[a++];
+			while (a < mid)
+				dst[k++] = src[a++];
+			while (b < hi)
+				dst[k++] = src[b++];
+		}
+		t = src;
+		src = dst;
+		dst = t;
+	}
+	if (src != arr)
+		memcpy(arr, src, sizeof(void *) * n);
+}
+
+struct slSetOpCtx_s {
+	sl_t *out;
+	slMemberCompareCb memberComp;
+	void *ctx;
+};
+
+static int slSortByComp(void *a, void *b, void *ctx);
+
+int slSortNodes(sl_t *sl, slNode_t **nodes, int n, void *ctx)
+{
+	struct slSetOpCtx_s c;
+	void **tmp;
+	if (n <= 1)
+		return 0;
+	if ((tmp = malloc(sizeof(void *) * n)) == NULL)
+		return -1;
+	c.out = sl;
+	c.memberComp = NULL;
+	c.ctx = ctx;
+	slMergeSort((void **)nodes, tmp, n, slSortByComp, &c);
+	free(tmp);
+	return 0;
+}
+
+static int slSortByMember(void *a, void *b, void *ctx)
+{
+	struct slSetOpCtx_s *c = ctx;
+	void *ua = ((slNode_t *)a)->udata;
+	void *ub = ((slNode_t *)b)->udata;
+	if (c->memberComp != NULL)
+		return c->memberComp(ua, ub, c->ctx);
+	if (ua == ub)
+		return 0;
+	return (size_t)ua < (size_t)ub ? -1 : 1;
+}
+
+static int slSortByComp(void *a, void *b, void *ctx)
+{
+	struct slSetOpCtx_s *c = ctx;
+	return c->out->comp(a, b, c->out, c->ctx);
+}
+
+/**
+ * sort every input by member, merge-join them and aggregate,
+ * then sort the result by out->comp and slBuildSorted it
+ */
+static int slSetOp(sl_t *out, sl_t **inputs, const double *weights, int n,
+		   int aggregate, slMemberCompareCb memberComp, void *ctx, int all)
+{
+	struct slSetOpCtx_s c;
+	slNode_t ***arrs = NULL;
+	size_t *pos = NULL;
+	void **res = NULL;
+	void **tmp = NULL;
+	size_t total = 0;
+	size_t cnt = 0;
+	size_t i;
+	int k;
+	int ret = -1;
+
+	if (out->size != 0 || out->embed)
+		return -1;
+	if (n <= 0)
+		return 0;
+	c.out = out;
+	c.memberComp = memberComp;
+	c.ctx = ctx;
+	for (k = 0; k < n; k++)
+		total += inputs[k]->size;
+	arrs = calloc(n, sizeof(*arrs));
+	pos = calloc(n, sizeof(*pos));
+	res = malloc(sizeof(void *) * (total + 1));
+	tmp = malloc(sizeof(void *) * (total + 1));
+	if (arrs == NULL || pos == NULL || res == NULL || tmp == NULL)
+		goto finished;
+
+	for (k = 0; k < n; k++) {
+		slNode_t *p;
+		if ((arrs[k] = malloc(sizeof(slNode_t *) * (inputs[k]->size + 1))) == NULL)
+			goto finished;
+		for (p = SL_FIRST(inputs[k]), i = 0; p != NULL; p = SL_NEXT(p))
+			arrs[k][i++] = p;
+		slMergeSort((void **)arrs[k], tmp, inputs[k]->size, slSortByMember, &c);
+	}
+
+	for (;;) {
+		slNode_t *min = NULL;
+		slNode_t *node;
+		double score = 0.0;
+		int found = 0;
+		for (k = 0; k < n; k++) {
+			if (pos[k] < inputs[k]->size &&
+			    (min == NULL || slSortByMember(arrs[k][pos[k]], min, &c) < 0))
+				min = arrs[k][pos[k]];
+		}
+		if (min == NULL)
+			break;
+		for (k = 0; k < n; k++) {
+			double s;
+			if (pos[k] >= inputs[k]->size || slSortByMember(arrs[k][pos[k]], min, &c) != 0)
+				continue;
+			s = arrs[k][pos[k]]->score * (weights != NULL ? weights[k] : 1.0);
+			if (found == 0 || aggregate == SL_AGGREGATE_SUM)
+				score = found == 0 ? s : score + s;
+			else if (aggregate == SL_AGGREGATE_MIN)
+				score = s < score ? s : score;
+			else
+				score = s > score ? s : score;
+			found++;
+			pos[k]++;
+		}
+		if (all && found < n)
+			continue;
+		if (out->sum)
+			node = slCreateSumNode(slRandomLevel(), min->udata, score);
+		else
+			node = slCreateNode(slRandomLevel(), min->udata, score);
+		if (node == NULL)
+			goto finished;
+		res[cnt++] = node;
+	}
+
+	slMergeSort(res, tmp, cnt, slSortByComp, &c);
+	slBuildSorted(out, (slNode_t **)res, (int)cnt);
+	ret = (int)cnt;
+finished:
+	if (ret < 0) {
+		for (i = 0; i < cnt; i++)
+			slFreeNode(res[i], NULL, NULL);
+	}
+	if (arrs != NULL) {
+		for (k = 0; k < n; k++)
+			free(arrs[k]);
+	}
+	free(arrs);
+	free(pos);
+	free(res);
+	free(tmp);
+	return ret;
+}
+
+int slUnion(sl_t *out, sl_t **inputs, const double *weights, int n,
+	    int aggregate, slMemberCompareCb memberComp, void *ctx)
+{
+	return slSetOp(out, inputs, weights, n, aggregate, memberComp, ctx, 0);
+}
+
+int slIntersect(sl_t *out, sl_t **inputs, const double *weights, int n,
+		int aggregate, slMemberCompareCb memberComp, void *ctx)
+{
+	return slSetOp(out, inputs, weights, n, aggregate, memberComp, ctx, 1);
+}
+
+/**
+ * score sum of the first rank nodes of a sum list
+ */
+static double slSumToRank(sl_t *sl, int rank)
+{
+	size_t traversed = 0;
+	double sum = 0.0;
+	slNode_t *p;
+	int i;
+	SL_HOP_DECL
+	p = SL_HEAD(sl);
+	for (i = sl->level - 1; i >= 0; i--) {
+		while (p->level[i].next != NULL && traversed + SL_SPAN(sl, p, i) <= (size_t)rank) {
+			traversed += SL_SPAN(sl, p, i);
+			sum += SL_SUM(sl, p)[i];
+			p = p->level[i].next;
+			SL_HOP();
+		}
+	}
+	SL_HOP_DONE(sl, SL_OP_BY_RANK);
+	return sum;
+}
+
+double slSumByRankRange(sl_t *sl, int rankMin, int rankMax)
+{
+	int n;
+	double sum = 0.0;
+	slNode_t *p;
+	if (rankMin < 1)
+		rankMin = 1;
+	if (rankMax > (int)sl->size)
+		rankMax = sl->size;
+	if (rankMin > rankMax)
+		return 0.0;
+	if (sl->sum)
+		return slSumToRank(sl, rankMax) - slSumToRank(sl, rankMin - 1);
+	SL_FOREACH_RANGE(sl, rankMin, rankMax, p, n) {
+		sum += p->score;
+	}
+	return sum;
+}
+
+double slSumByScoreRange(sl_t *sl, double min, double max, int *pCount)
+{
+	int i;
+	int rankMin = 0;
+	int rankMax = 0;
+	double sumMin = 0.0;
+	double sumMax = 0.0;
+	slNode_t *p;
+	SL_HOP_DECL
+
+	if (!sl->sum) {
+		for (p = slFirstGEThan(sl, min); p != NULL && p->score <= max; p = SL_NEXT(p)) {
+			sumMax += p->score;
+			rankMax++;
+		}
+		if (pCount != NULL)
+			*pCount = rankMax;
+		return sumMax;
+	}
+	/* sums up to the last node whose score < min, and <= max */
+	p = SL_HEAD(sl);
+	for (i = sl->level - 1; i >= 0; i--) {
+		while (p->level[i].next != NULL &&
+		       p->level[i].next->score < min) {
+			rankMin += SL_SPAN(sl, p, i);
+			sumMin += SL_SUM(sl, p)[i];
+			p = p->level[i].next;
+			SL_HOP();
+		}
+	}
+	p = SL_HEAD(sl);
+	for (i = sl->level - 1; i >= 0; i--) {
+		while (p->level[i].next != NULL &&
+		       p->level[i].next->score <= max) {
+			rankMax += SL_SPAN(sl, p, i);
+			sumMax += SL_SUM(sl, p)[i];
+			p = p->level[i].next;
+			SL_HOP();
+		}
+	}
+	SL_HOP_DONE(sl, SL_OP_BY_SCORE);
+	if (rankMax <= rankMin) {
+		rankMax = rankMin;
+		sumMax = sumMin;
+	}
+	if (pCount != NULL)
+		*pCount = rankMax - rankMin;
+	return sumMax - sumMin;
+}
+
 /**
  * greater or equal than score
  */
@@ -310,13 +1796,16 @@ slNode_t * slFirstGEThan(sl_t *sl, double score)
 {
 	int i;
 	slNode_t *p;
+	SL_HOP_DECL
 	p = SL_HEAD(sl);
 	for (i = sl->level - 1; i >= 0; i--) {
 		while (p->level[i].next != NULL &&
 		       p->level[i].next->score < score) {
 			p = p->level[i].next;
+			SL_HOP();
 		}
 	}
+	SL_HOP_DONE(sl, SL_OP_BY_SCORE);
 	return p->level[0].next;
 }
 
@@ -327,13 +1816,247 @@ slNode_t * slLastLEThan(sl_t *sl, double score)
 {
 	int i;
 	slNode_t *p;
+	SL_HOP_DECL
 	p = SL_HEAD(sl);
 	for (i = sl->level - 1; i >= 0; i--) {
 		while (p->level[i].next != NULL &&
 		       p->level[i].next->score <= score) {
 			p = p->level[i].next;
+			SL_HOP();
 		}
 	}
+	SL_HOP_DONE(sl, SL_OP_BY_SCORE);
 	return p;
 }
 
+void slCursorInit(slCursor_t *c, sl_t *sl, int rank, int reverse)
+{
+	c->sl = sl;
+	c->node = NULL;
+	c->reverse = reverse;
+	if (rank <= 0)
+		rank = reverse ? (int)sl->size : 1;
+	c->rank = reverse ? rank + 1 : rank - 1;
+	c->version = sl->version;
+	c->score = 0.0;
+	c->key = NULL;
+}
+
+/**
+ * find the neighbour of the key of the last returned node,
+ * the first node after it, or the last one before it if reverse
+ */
+static slNode_t *slCursorSeek(slCursor_t *c, void *ctx)
+{
+	sl_t *sl = c->sl;
+	slNode_t key;
+	slNode_t *p;
+	int traversed = 0;
+	int i;
+	int bound = c->reverse ? 0 : 1;	/* step over nodes equal to key too */
+	SL_HOP_DECL
+	key.score = c->score;
+	key.udata = c->key;
+	p = SL_HEAD(sl);
+	for (i = sl->level - 1; i >= 0; i--) {
+		while (p->level[i].next != NULL &&
+		       SL_COMP(sl, p->level[i].next, &key, ctx) < bound) {
+			traversed += SL_SPAN(sl, p, i);
+			p = p->level[i].next;
+			SL_HOP();
+		}
+	}
+	SL_HOP_DONE(sl, SL_OP_RANK);
+	if (c->reverse) {
+		c->rank = traversed;
+		return p == SL_HEAD(sl) ? NULL : p;
+	}
+	c->rank = traversed + 1;
+	return p->level[0].next;
+}
+
+slNode_t *slCursorNext(slCursor_t *c, void *ctx)
+{
+	sl_t *sl = c->sl;
+	slNode_t *next;
+	int rank;
+	if (c->node != NULL && c->version == sl->version) {
+		next = c->reverse ? SL_PREV(c->node) : SL_NEXT(c->node);
+		if (next == NULL)
+			return NULL;
+		c->rank += c->reverse ? -1 : 1;
+	} else if (c->node == NULL || sl->embed) {
+		/* comp of an embedded list reads the container, a key has none */
+		rank = c->reverse ? c->rank - 1 : c->rank + 1;
+		next = rank >= 1 ? slGetNodeByRank(sl, rank) : NULL;
+		if (next == NULL)
+			return NULL;
+		c->rank = rank;
+	} else {
+		/* keep the old key until there is a node to move to */
+		next = slCursorSeek(c, ctx);
+		if (next == NULL)
+			return NULL;
+	}
+	c->node = next;
+	c->version = sl->version;
+	c->score = next->score;
+	c->key = next->udata == NULL ? (void *)next : next->udata;
+	return next;
+}
+
+int slCursorFetch(slCursor_t *c, slNode_t **nodeArr, int sz, void *ctx)
+{
+	int n;
+	slNode_t *node;
+	for (n = 0; n < sz && (node = slCursorNext(c, ctx)) != NULL; n++)
+		nodeArr[n] = node;
+	return n;
+}
+
+/* merge order: comp of lists[0], then list index */
+static int slMergeLess(slMerge_t *m, int a, slNode_t *nodeA, int b, slNode_t *nodeB)
+{
+	int c = SL_COMP(m->lists[0], nodeA, nodeB, m->ctx);
+	return c != 0 ? c < 0 : a < b;
+}
+
+static void slMergeDown(slMerge_t *m, int i)
+{
+	for (;;) {
+		int l = i * 2 + 1;
+		int r = l + 1;
+		int k = i;
+		int tmp;
+		if (l < m->heapCnt && slMergeLess(m, m->heap[l], m->next[m->heap[l]],
+						  m->heap[k], m->next[m->heap[k]]))
+			k = l;
+		if (r < m->heapCnt && slMergeLess(m, m->heap[r], m->next[m->heap[r]],
+						  m->heap[k], m->next[m->heap[k]]))
+			k = r;
+		if (k == i)
+			return;
+		tmp = m->heap[i];
+		m->heap[i] = m->heap[k];
+		m->heap[k] = tmp;
+		i = k;
+	}
+}
+
+int slMergeInit(slMerge_t *m, sl_t **lists, int n, int rank, void *ctx)
+{
+	int pos[SL_MERGE_MAX];	/* nodes of every list before the start */
+	size_t total = 0;
+	size_t skip;
+	int i;
+	if (n < 1 || n > SL_MERGE_MAX)
+		return -1;
+	m->lists = lists;
+	m->n = n;
+	m->ctx = ctx;
+	m->heapCnt = 0;
+	for (i = 0; i < n; i++) {
+		pos[i] = 0;
+		total += lists[i]->size;
+	}
+	skip = rank > 1 ? (size_t)rank - 1 : 0;
+	if (skip > total)
+		skip = total;
+	m->rank = (int)skip;
+	/*
+	 * with t = skip / n, of the nodes t after every list position the
+	 * least one is ordered before less than n * t <= skip others,
+	 * so it and the t - 1 before it in its list are all skipped
+	 */
+	while (skip >= (size_t)n) {
+		size_t t = skip / n;
+		slNode_t *best = NULL;
+		int bestList = 0;
+		for (i = 0; i < n; i++) {
+			slNode_t *node;
+			if (lists[i]->size - pos[i] < t)
+				continue;
+			node = slGetNodeByRank(lists[i], pos[i] + (int)t);
+			if (best == NULL || slMergeLess(m, i, node, bestList, best)) {
+				best = node;
+				bestList = i;
+			}
+		}
+		pos[bestList] += (int)t;
+		skip -= t;
+	}
+	for (i = 0; i < n; i++) {
+		m->next[i] = (size_t)pos[i] < lists[i]->size
+			? slGetNodeByRank(lists[i], pos[i] + 1) : NULL;
+		if (m->next[i] != NULL)
+			m->heap[m->heapCnt++] = i;
+	}
+	for (i = m->heapCnt / 2 - 1; i >= 0; i--)
+		slMergeDown(m, i);
+	/* the rest, fewer than n */
+	m->rank -= (int)skip;
+	while (skip-- > 0)
+		slMergeNext(m, NULL);
+	return 0;
+}
+
+slNode_t *slMergeNext(slMerge_t *m, int *pList)
+{
+	slNode_t *node;
+	int i;
+	if (m->heapCnt == 0)
+		return NULL;
+	i = m->heap[0];
+	node = m->next[i];
+	m->next[i] = SL_NEXT(node);
+	if (m->next[i] == NULL)
+		m->heap[0] = m->heap[--m->heapCnt];
+	slMergeDown(m, 0);
+	m->rank++;
+	if (pList != NULL)
+		*pList = i;
+	return node;
+}
+
+int slMergeRankRange(sl_t **lists, int n, int rankMin, int rankMax,
+		     slNode_t **nodeArr, int *listArr, int sz, void *ctx)
+{
+	slMerge_t m;
+	slNode_t *node;
+	int list;
+	int k;
+	if (sz <= 0 || rankMin < 1 || rankMin > rankMax)
+		return 0;
+	if (slMergeInit(&m, lists, n, rankMin, ctx) != 0)
+		return 0;
+	for (k = 0; k < sz && k <= rankMax - rankMin && (node = slMergeNext(&m, &list)) != NULL; k++) {
+		nodeArr[k] = node;
+		if (listArr != NULL)
+			listArr[k] = list;
+	}
+	return k;
+}
+
+
+void slGetStats(sl_t *sl, struct slStats_s *stats)
+{
+	slNode_t *node;
+	size_t towers = 0;
+	size_t allocated = 0;	/* levels allocated, levelCap on a det list */
+	size_t levelBytes = sizeof(struct levelNode_s) + (sl->sum ? sizeof(double) : 0);
+	memset(stats, 0, sizeof(*stats));
+	stats->size = sl->size;
+	stats->level = sl->level;
+	for (node = SL_FIRST(sl); node != NULL; node = SL_NEXT(node)) {
+		stats->levelHist[node->levelSize - 1]++;
+		towers += node->levelSize;
+		allocated += node->levelCap;
+	}
+	stats->nodeBytes = sl->size * (sizeof(slNode_t) - sizeof(struct levelNode_s));
+	stats->towerBytes = allocated * levelBytes;
+	stats->avgHeight = sl->size == 0 ? 0.0 : (double)towers / sl->size;
+#if SL_ENABLE_STATS
+	stats->countersEnabled = 1;
+	stats->counters = sl->counters;
+#endif
+}
@@ -1,6 +1,8 @@
 #ifndef  _SKIPLIST_H_IOZX0MYF_
 #define  _SKIPLIST_H_IOZX0MYF_
 
+#include <stddef.h>
+
 #if defined (__cplusplus)
 extern "C" {
 #endif
@@ -8,12 +10,28 @@ extern "C" {
 #define SKIPLIST_MAXLEVEL 32
 #define SKIPLIST_P 0.25
 
+/**
+ * build with -DSL_ENABLE_STATS=1 to count comparisons and pointer hops,
+ * see slGetStats
+ */
+#ifndef SL_ENABLE_STATS
+# define SL_ENABLE_STATS 0
+#endif
+
 #define SL_LVL_NEXT(node, l) ((node)->level[l].next)
 #define SL_NEXT(node) ((node)->level[0].next)
 #define SL_PREV(node) ((node)->prev)
 
 #define SL_HEAD(sl) ((slNode_t *)&(sl->head))
 
+/* per-level score sums of a sum list, stored after the tower */
+#define SL_SUM(sl, node) ((node) == SL_HEAD(sl) ? (sl)->headSum \
+		: (double *)&(node)->level[(node)->levelSize])
+
+/* the struct a node is embedded in, see slCreateEmbedded */
+#define SL_CONTAINER_OF(node, type, member) \
+	((type *)(void *)((char *)(node) - offsetof(type, member)))
+
 #define SL_FIRST(sl) (sl->head.level[0].next)
 #define SL_LAST(sl) ((slNode_t *)sl->tail)
 
@@ -30,16 +48,32 @@ extern "C" {
 
 struct slNode_s;
 struct skiplist_s;
+struct slCompact_s;
 
 typedef struct slNode_s slNode_t;
 typedef struct skiplist_s sl_t;
 
 typedef void (*slFreeCb)(void *udata, void *ctx);
+
+/**
+ * node from moved to to by slCompact, from is freed after it returns
+ */
+typedef void (*slMoveCb)(slNode_t *from, slNode_t *to, void *ctx);
 typedef int (*slCompareCb)(slNode_t *nodeA, slNode_t *nodeB, sl_t *sl, void *ctx);
 
+/**
+ * member identity for slUnion/slIntersect, order udataA against udataB,
+ * return 0 if they are the same member
+ */
+typedef int (*slMemberCompareCb)(void *udataA, void *udataB, void *ctx);
+
+/**
+ * layout of the following structs is mirrored by the ffi.cdef
+ * in lua-bind/lskiplist_ffi.lua, keep them in sync
+ */
 struct levelNode_s {
 	slNode_t *next;
-	size_t span;
+	size_t span;	/* not maintained on the last link of a level */
 };
 
 struct slNode_s {
@@ -47,6 +81,7 @@ struct slNode_s {
 	void *udata;
 	slNode_t *prev;
 	int levelSize;
+	int levelCap;	/* levels allocated, levelSize may grow up to it on a deterministic list */
 	struct levelNode_s level[1];
 };
 
@@ -55,9 +90,44 @@ struct slNodeMax_s {
 	void *udata;
 	slNode_t *prev;
 	int levelSize;
+	int levelCap;
 	struct levelNode_s level[SKIPLIST_MAXLEVEL];
 };
 
+enum slOp_e {
+	SL_OP_INSERT = 0,
+	SL_OP_DELETE,
+	SL_OP_RANK,		/* slGetRank */
+	SL_OP_BY_RANK,		/* slGetNodeByRank and rank range lookups */
+	SL_OP_BY_SCORE,		/* slFirstGEThan, slLastLEThan, slGetScoreRange */
+	SL_OP_MAX
+};
+
+enum slAggregate_e {
+	SL_AGGREGATE_SUM = 0,
+	SL_AGGREGATE_MIN,
+	SL_AGGREGATE_MAX
+};
+
+struct slCounters_s {
+	unsigned long comparisons;		/* calls of sl->comp */
+	unsigned long inserts;
+	unsigned long deletes;
+	unsigned long ops[SL_OP_MAX];		/* descents per op */
+	unsigned long visited[SL_OP_MAX];	/* pointer hops per op */
+	unsigned long maxDescent;		/* most hops of one descent */
+};
+
+/* score histogram for approximate ranks, see slSetHistogram */
+struct slHist_s {
+	double min;
+	double scale;		/* buckets / (max - min) */
+	int buckets;
+	size_t size;		/* members counted */
+	size_t *count;		/* count[b] members in bucket b */
+	size_t *tree;		/* Fenwick tree over count, tree[1..buckets] */
+};
+
 struct skiplist_s {
 	struct slNodeMax_s head;
 	slNode_t *tail;
@@ -65,6 +135,31 @@ struct skiplist_s {
 	size_t size;
 	slCompareCb comp;
 	void *udata;
+	size_t cap;		/* 0 if unbounded, see slSetCapacity */
+	int sum;		/* 1 if links carry score sums, see slCreateSum */
+	int det;		/* levels of every node if heights follow the 1-2-3 rule, see slSetDeterministic */
+	int embed;		/* 1 if nodes live inside of their udata, see slSetEmbedded */
+	int lazy;		/* 1 if spans above level 0 may be dirty, see slSetLazySpans */
+	int borrowed;		/* 1 if nodes are parts of allocations sl does not own, see slmiInit */
+	double headSum[SKIPLIST_MAXLEVEL];
+	unsigned long version;	/* bumped by every insert, delete and bulk change */
+	struct slHist_s *hist;	/* NULL if off, see slSetHistogram */
+	struct slCompact_s *compact;	/* chunks of moved nodes, see slCompact */
+#if SL_ENABLE_STATS
+	/* keep it last, so that the layout above does not depend on it */
+	struct slCounters_s counters;
+#endif
+};
+
+struct slStats_s {
+	size_t size;
+	int level;
+	size_t levelHist[SKIPLIST_MAXLEVEL];	/* levelHist[i] nodes with levelSize == i + 1 */
+	size_t nodeBytes;			/* node headers, without towers */
+	size_t towerBytes;			/* levels allocated by all nodes, sums included */
+	double avgHeight;
+	int countersEnabled;			/* SL_ENABLE_STATS */
+	struct slCounters_s counters;		/* zero if not countersEnabled */
 };
 
 int slRandomLevel();
@@ -72,6 +167,12 @@ int slRandomLevel();
 slNode_t * slCreateNode(int level, void *udata, double score);
 void slFreeNode(slNode_t *node, slFreeCb freeCb, void *ctx);
 
+/**
+ * node for a sum list, with room for one score sum per level
+ * after its tower; a sum list only takes nodes created by this
+ */
+slNode_t * slCreateSumNode(int level, void *udata, double score);
+
 /**
  * you can use slInit to init a struct pointer by yourself
  * */
@@ -92,6 +193,167 @@ sl_t *slCreate();
  */
 void slFree(sl_t *sl, slFreeCb freeCb, void *ctx);
 
+/**
+ * sum list: like span, every link also carries the sum of the scores
+ * it skips, kept through insert, delete and range delete, so that
+ * slSumByRankRange and slSumByScoreRange are O(log N);
+ * sums are kept in double, exact for integer scores below 2^53;
+ * slc_t does not maintain them
+ */
+void slInitSum(sl_t *sl);
+sl_t *slCreateSum();
+
+/**
+ * deterministic mode (1-2-3 skiplist): node heights are not drawn but
+ * kept by the list, so that between two consecutive nodes taller than h
+ * there are 1 to 3 nodes of height h; a search makes at most 4 hops per
+ * level and the height stays under log2(N) + 1.
+ *
+ * slInsertNode links a node at height 1 and splits overfull gaps on the
+ * way up by promoting a middle node, deletes merge emptied gaps by
+ * demoting a neighbour, both O(log N) with spans kept.
+ *
+ * nodes are not reallocated, so a node grows only up to the levels it
+ * was created with (levelCap): every node must be created with det
+ * levels, slInsertNode asserts it. the gap bound, and so O(log N) in the
+ * worst case, holds up to 2^(det - 1) nodes; past that the top gap grows.
+ * that is memory: every node holds det links of 16 bytes (64-bit) where
+ * slRandomLevel averages 1.33, e.g. 21 levels, 336 bytes of tower per
+ * node against about 21, for up to 1M nodes.
+ * bulk builds, split and concat keep their own heights.
+ * sum lists, lazy lists and slc_t do not support it.
+ *
+ * det is 0 to turn it off, or 2 to SKIPLIST_MAXLEVEL;
+ * sl must be empty, return 0 if succeed, -1 if sl is not empty, a sum or
+ * lazy list, or det is out of range
+ */
+int slSetDeterministic(sl_t *sl, int det);
+
+/**
+ * native descending order: comp becomes score descending, equal scores
+ * ordered like the default comp, so the top scores are the first ranks
+ * and sit next to the head; the score helpers (slFirstGEThan,
+ * slGetScoreRange, slExpire, ...) still assume score ascending.
+ * desc == 0 sets the default comp back
+ *
+ * sl must be empty, return 0 if succeed, -1 if sl is not empty
+ */
+int slSetDescending(sl_t *sl, int desc);
+
+/**
+ * lazy spans, for write-heavy lists with few rank queries: inserts do
+ * not count ranks on the way down and leave the spans of the links they
+ * create dirty, deletes keep dirty spans dirty, clean ones stay exact.
+ * the first rank read through a dirty link (slGetRank, slGetNodeByRank,
+ * rank ranges, score ranges, split, concat, ...) recomputes it from the
+ * level below, only for the segments it walks; ranks are always exact.
+ *
+ * rank reads on a lazy list write to it, do not run them concurrently;
+ * slc_t does not support it, nor sum lists or deterministic mode.
+ * turning it off fixes every dirty span, O(N)
+ *
+ * return 0 if succeed, -1 if sl is a sum list or deterministic
+ */
+int slSetLazySpans(sl_t *sl, int lazy);
+
+/**
+ * embedded nodes: the node, tower inline, is the last member of a user
+ * struct, so comp reads the fields of a member from the cache lines of
+ * its links and a member is one allocation:
+ *
+ *	typedef struct player_s { int id; int level; slNode_t node; } player_t;
+ *	player_t *p = SL_CREATE_EMBEDDED(sl, player_t, node, slRandomLevel(), score);
+ *	... SL_CONTAINER_OF(nodeA, player_t, node)->level in comp
+ *
+ * slCreateEmbedded allocates offset bytes plus a node of level (with
+ * the score sums of a sum list) and sets udata to the container, which
+ * is what freeCb gets; slFreeEmbedded frees the container.
+ * on an embedded list every node freed by sl goes through
+ * slFreeEmbedded, so all of its nodes must be embedded;
+ * split and concat take lists of one kind, slUnion/slIntersect do not
+ * build embedded lists, slc_t does not support them; a cursor resumes
+ * by rank instead of by key on them, see slCursorInit.
+ *
+ * sl must be empty, return 0 if succeed, -1 if sl is not empty
+ */
+int slSetEmbedded(sl_t *sl, int embed);
+
+/**
+ * return the container, the node is at offset in it;
+ * NULL if no memory
+ */
+void *slCreateEmbedded(sl_t *sl, size_t offset, int level, double score);
+void slFreeEmbedded(slNode_t *node, slFreeCb freeCb, void *ctx);
+
+#define SL_CREATE_EMBEDDED(sl, type, member, level, score) \
+	((type *)slCreateEmbedded(sl, offsetof(type, member), level, score))
+
+/**
+ * approximate ranks: a fixed histogram of buckets equal slices of
+ * [min, max) counts the scores of sl, scores out of it fall into the
+ * first or last bucket. inserts, deletes, range deletes, expiry, bulk
+ * builds, split and concat keep it, O(log buckets) per node;
+ * slBuildParallel and slc_t do not, set it again after them.
+ *
+ * the count of scores below a score is read off the Fenwick tree and
+ * interpolated inside of its bucket, it is off by at most the count of
+ * that bucket, which slApproxRank reports; no comparison and no node
+ * is touched, whatever sl->comp is.
+ *
+ * replaces the histogram of sl, filled from its nodes, O(N + buckets);
+ * buckets <= 0 drops it.
+ * return 0 if succeed, -1 if min >= max or no memory
+ */
+int slSetHistogram(sl_t *sl, double min, double max, int buckets);
+
+/**
+ * about 1 + the count of scores < score, the rank score would take by
+ * score ascending; *pErr is set to the error bound if pErr != NULL
+ * return 0 if sl has no histogram
+ */
+int slApproxRank(sl_t *sl, double score, int *pErr);
+
+/**
+ * percent of scores < score, in [0, 100]
+ * return -1 if sl has no histogram
+ */
+double slApproxPercentile(sl_t *sl, double score);
+
+/**
+ * compaction: after long churn the nodes of neighbouring ranks are
+ * spread over the heap and a range scan misses the cache once per node.
+ * slCompact walks on from where its last call stopped, at most budget
+ * nodes, and copies every node that is not in place into a chunk of
+ * its own, in list order, fixing the links to it at every level; so a
+ * pass leaves the list in a few contiguous runs, like a fresh build.
+ * a node stays where it is if an earlier pass put it in a chunk that
+ * is at least a quarter live, after its predecessor; nodes of emptier
+ * chunks move out so the chunk can be freed.
+ *
+ * moved nodes keep score, udata and spans, but not their address:
+ * moveCb, if not NULL, gets every move to fix pointers kept elsewhere,
+ * and sl->comp must not order by node address, as internalComp does
+ * for NULL udata. nodes must come from slCreateNode or slCreateSumNode,
+ * an embedded list or a slmi_t index (sl->borrowed) returns -1; a list
+ * holding moved nodes cannot give them to another one by split or
+ * concat; slc_t does not support it.
+ *
+ * nodes sl lets go of (slDeleteNode with pNode, slExpire, ...) must be
+ * freed by slReleaseNode, before slDestroy.
+ *
+ * return count of nodes walked, 0 if the last call ended a pass (the
+ * next one starts over at rank 1), -1 if no memory, sl is embedded or
+ * its nodes are borrowed
+ */
+int slCompact(sl_t *sl, int budget, slMoveCb moveCb, void *ctx);
+
+/**
+ * free a node unlinked from sl, by the way sl allocated it:
+ * slFreeEmbedded on an embedded list, back to its chunk after slCompact,
+ * slFreeNode otherwise
+ */
+void slReleaseNode(sl_t *sl, slNode_t *node, slFreeCb freeCb, void *ctx);
+
 /**
  * set your own comp function
  */
@@ -112,14 +374,30 @@ int slGetRank(sl_t *sl, slNode_t *node, void *ctx);
  * size of sl
  */
 int slGetSize(sl_t *sl);
+
+/**
+ * ranks near the tail, within about two hops per level of it,
+ * are walked back from sl->tail instead of descending from the head
+ */
 slNode_t * slGetNodeByRank(sl_t *sl, int rank);
 
+/**
+ * tail-relative ranks, 1 for the last node:
+ * slGetNodeByRevRank(sl, 1) == SL_LAST(sl), NULL if out of range;
+ * slGetRevRank walks from node, which must be in sl, to the tail along
+ * the tallest links it finds, O(log distance) hops and no comparison,
+ * rank is sl->size - revRank + 1
+ */
+slNode_t * slGetNodeByRevRank(sl_t *sl, int revRank);
+int slGetRevRank(sl_t *sl, slNode_t *node);
+
 /**
  * delete node,
  * return 0 if succeed
- * call slFreeNode(node) if pNode == NULL and if node found in sl;
+ * call slReleaseNode(node)
+ * if pNode == NULL and if node found in sl;
  * write &node to pNode if pNode != NULL and if node found in sl,
- * you should call slFreeNode by yourself;
+ * you should call slReleaseNode by yourself;
  */
 int slDeleteNode(sl_t *sl, slNode_t *node, void *ctx, slNode_t **pNode);
 
@@ -134,6 +412,154 @@ int slDeleteByRankRange(sl_t *sl,
 		      int rankMin, int rankMax,
 		      slFreeCb freeCb, void *ctx);
 
+/**
+ * capped top-N mode: keep at most cap nodes, the first ones by sl->comp;
+ * 0 means unbounded, which is the default.
+ * nodes beyond cap are deleted from the tail, freeCb is called on them;
+ * return count deleted
+ */
+size_t slSetCapacity(sl_t *sl, size_t cap, slFreeCb freeCb, void *ctx);
+
+/**
+ * insert node under sl->cap;
+ * if sl is full, a node ordered after the last one is rejected
+ * with a single comparison, otherwise the last node is evicted;
+ * return 0 if inserted, 1 if rejected (node is still yours);
+ * *pEvicted is set to the evicted node or NULL if pEvicted != NULL,
+ * free it by slReleaseNode, else it is freed by
+ * slReleaseNode(sl, node, NULL, NULL)
+ */
+int slInsertCapped(sl_t *sl, slNode_t *node, void *ctx, slNode_t **pEvicted);
+
+/**
+ * unlink n nodes sorted by sl->comp in one forward sweep, every search
+ * starts from the path to the node before, so neighbouring nodes cost
+ * a few hops; nodes not in sl are skipped, none is freed
+ * return count unlinked
+ */
+int slDeleteNodes(sl_t *sl, slNode_t **nodes, int n, void *ctx);
+
+/**
+ * link n nodes sorted by sl->comp, the insert counterpart of
+ * slDeleteNodes: every search starts from the path to the node before
+ */
+void slInsertNodes(sl_t *sl, slNode_t **nodes, int n, void *ctx);
+
+/**
+ * expiry: on a list ordered by deadline (score ascending), unlink the
+ * due nodes, score <= now, at most budget of them, and write them to
+ * nodeArr in order; the prefix is cut off the head along one search
+ * path, O(log N) for spans and sums plus O(count) to collect the nodes
+ * return count unlinked, the nodes are yours
+ */
+int slExpire(sl_t *sl, double now, int budget, slNode_t **nodeArr);
+
+/**
+ * stable sort of n nodes by sl->comp, for slBuildSorted
+ * return 0 if succeed, -1 if no memory
+ */
+int slSortNodes(sl_t *sl, slNode_t **nodes, int n, void *ctx);
+
+/**
+ * link n nodes sorted by sl->comp into the empty sl in one pass, O(n);
+ * levelSize of every node is kept, nodes of a sum list must come
+ * from slCreateSumNode
+ * return 0 if succeed, -1 if sl is not empty
+ */
+int slBuildSorted(sl_t *sl, slNode_t **nodes, int n);
+
+/**
+ * move the nodes after rank into the empty out, sl keeps [1, rank];
+ * relinks along one search path, O(logN) without touching the moved nodes;
+ * out->comp is set to sl->comp, out must be a sum list iff sl is
+ * return 0 if succeed, -1 if out is not empty or of another kind
+ */
+int slSplitAtRank(sl_t *sl, int rank, sl_t *out);
+
+/**
+ * append every node of b to a and leave b empty,
+ * the last node of a must be ordered before the first of b by a->comp;
+ * O(logN) like slSplitAtRank
+ * return 0 if succeed, -1 if ranges overlap or lists are of another kind
+ */
+int slConcat(sl_t *a, sl_t *b, void *ctx);
+
+/**
+ * like ZUNIONSTORE/ZINTERSTORE: build the empty out from n inputs,
+ * a member scores weights[i] * score in inputs[i] (weights may be NULL
+ * for all 1.0), the scores of one member are combined by aggregate;
+ * union keeps members found in any input, intersect those found in all;
+ * members are matched by memberComp, or by udata pointer if NULL,
+ * and must be unique in each input;
+ * out gets new nodes sharing udata with the inputs,
+ * ctx would be passed to memberComp and out->comp
+ * return size of out, -1 if out is not empty or no memory
+ */
+int slUnion(sl_t *out, sl_t **inputs, const double *weights, int n,
+	    int aggregate, slMemberCompareCb memberComp, void *ctx);
+int slIntersect(sl_t *out, sl_t **inputs, const double *weights, int n,
+		int aggregate, slMemberCompareCb memberComp, void *ctx);
+
+/**
+ * fill nodeArr with nodes of rank range [rankMin, rankMax],
+ * at most sz nodes;
+ * return count of nodes written
+ */
+int slGetNodesRankRange(sl_t *sl,
+			int rankMin, int rankMax,
+			slNode_t **nodeArr, int sz);
+
+/**
+ * the following helpers write into caller-provided arrays instead of
+ * handing out nodes one by one, so they can be called from luajit ffi
+ * with cdata arrays, see lua-bind/lskiplist_ffi.lua;
+ * udataArr or scoreArr may be NULL if not needed
+ */
+
+/**
+ * fill udata and score of rank range [rankMin, rankMax], at most sz;
+ * return count written
+ */
+int slGetRankRange(sl_t *sl,
+		   int rankMin, int rankMax,
+		   void **udataArr, double *scoreArr, int sz);
+
+/**
+ * fill udata and score of nodes with min <= score <= max, at most sz;
+ * *pRankMin, *pRankMax are set to the rank range of all matching nodes,
+ * *pRankMin > *pRankMax if none matches, call it with sz == 0 to count;
+ * only meaningful when sl is ordered by score ascending
+ * return count written
+ */
+int slGetScoreRange(sl_t *sl,
+		    double min, double max,
+		    int *pRankMin, int *pRankMax,
+		    void **udataArr, double *scoreArr, int sz);
+
+/**
+ * sum of scores of rank range [rankMin, rankMax], clamped to [1, size];
+ * O(log N) on a sum list, walks the range otherwise
+ */
+double slSumByRankRange(sl_t *sl, int rankMin, int rankMax);
+
+/**
+ * sum of scores of nodes with min <= score <= max,
+ * *pCount is set to their count if pCount != NULL;
+ * only meaningful when sl is ordered by score ascending
+ */
+double slSumByScoreRange(sl_t *sl, double min, double max, int *pCount);
+
+/**
+ * walk sl and fill stats, O(N);
+ * counters are copied only if built with SL_ENABLE_STATS
+ */
+void slGetStats(sl_t *sl, struct slStats_s *stats);
+
+/**
+ * reset counters, no-op unless built with SL_ENABLE_STATS
+ */
+void slResetCounters(sl_t *sl);
+
 /**
  * greater or equal than score
  */
@@ -144,6 +570,92 @@ slNode_t * slFirstGEThan(sl_t *sl, double score);
  */
 slNode_t * slLastLEThan(sl_t *sl, double score);
 
+/**
+ * resumable cursor for paginated scans, walks forward or, if reverse,
+ * backward along SL_PREV;
+ * it pins the last node it returned and the sl->version it saw, a step
+ * is O(1) while sl did not change, otherwise it re-seeks in O(log N)
+ * from the (score, udata) of that node, which may be freed meanwhile:
+ * members ordered by sl->comp between it and the old next are not
+ * missed, nor is a member returned twice unless it moved.
+ * sl->comp must order by (score, udata), or by the node address if
+ * udata is NULL, like the default comp; the re-seek compares against a
+ * key node with only score and udata set.
+ * an embedded list has no such key, its cursor resumes after a change
+ * at the rank next to the last one returned, so inserts and deletes in
+ * front of it shift the scan: members may be skipped or returned twice.
+ */
+typedef struct slCursor_s {
+	sl_t *sl;
+	slNode_t *node;		/* last returned, NULL before the first step */
+	int rank;		/* rank of node */
+	int reverse;
+	unsigned long version;
+	double score;		/* key of node */
+	void *key;
+} slCursor_t;
+
+/**
+ * first slCursorNext returns the node at rank, or the first (last if
+ * reverse) one if rank is 0
+ */
+void slCursorInit(slCursor_t *c, sl_t *sl, int rank, int reverse);
+
+/**
+ * the next node, NULL at the end; c->rank is its rank.
+ * a cursor at the end picks up nodes added behind it later
+ * ctx would be passed to sl->comp function
+ */
+slNode_t *slCursorNext(slCursor_t *c, void *ctx);
+
+/**
+ * fill nodeArr with the next sz nodes at most, see slCursorNext
+ * return count written
+ */
+int slCursorFetch(slCursor_t *c, slNode_t **nodeArr, int sz, void *ctx);
+
+/**
+ * k-way merge of up to SL_MERGE_MAX lists, for top-K across boards:
+ * a heap over the next node of every list yields their nodes in one
+ * order, the comp of lists[0] (called with lists[0] as sl) orders the
+ * nodes of all of them, equal nodes come by list index.
+ * a start rank skips ahead by rank lookups, O(n^2 log(rank) log N)
+ * instead of rank heap steps; each step then is O(log n).
+ * like SL_FOREACH, the lists must not change while merging.
+ */
+#define SL_MERGE_MAX 64
+
+typedef struct slMerge_s {
+	sl_t **lists;
+	int n;
+	void *ctx;
+	int rank;			/* merged rank of the last returned node */
+	int heapCnt;
+	int heap[SL_MERGE_MAX];		/* list indexes, by their next node */
+	slNode_t *next[SL_MERGE_MAX];	/* next node of every list */
+} slMerge_t;
+
+/**
+ * the first slMergeNext returns the node at merged rank (1 for the first)
+ * ctx would be passed to comp
+ * return 0 if succeed, -1 if n is out of [1, SL_MERGE_MAX]
+ */
+int slMergeInit(slMerge_t *m, sl_t **lists, int n, int rank, void *ctx);
+
+/**
+ * the next node, NULL at the end; *pList is set to the index of its
+ * list if pList != NULL
+ */
+slNode_t *slMergeNext(slMerge_t *m, int *pList);
+
+/**
+ * fill nodeArr with merged rank range [rankMin, rankMax], at most sz,
+ * listArr gets their list indexes if not NULL
+ * return count written
+ */
+int slMergeRankRange(sl_t **lists, int n, int rankMin, int rankMax,
+		     slNode_t **nodeArr, int *listArr, int sz, void *ctx);
+
 #if defined (__cplusplus)
 }	/*end of extern "C"*/
 #endif
@@ -0,0 +1,225 @@
+#include <stdlib.h>
+#include <string.h>
+#include "slbuffer.h"
+
+#define SLWB_INIT_CAP 64
+
+static size_t slwbHash(slNode_t *node)
+{
+	size_t h = (size_t)node;
+	h ^= h >> 16;
+	h *= 0x45d9f3bu;
+	h ^= h >> 16;
+	return h;
+}
+
+static struct slwbEntry_s *slwbFind(slwb_t *wb, slNode_t *node)
+{
+	size_t mask = wb->cap - 1;
+	size_t i = slwbHash(node) & mask;
+	while (wb->map[i].node != NULL) {
+		if (wb->map[i].node == node)
+			return &wb->map[i];
+		i = (i + 1) & mask;
+	}
+	return NULL;
+}
+
+static int slwbGrow(slwb_t *wb)
+{
+	int i;
+	int oldCap = wb->cap;
+	struct slwbEntry_s *old = wb->map;
+	struct slwbEntry_s *map = calloc(oldCap * 2, sizeof(*map));
+	if (map == NULL)
+		return -1;
+	wb->map = map;
+	wb->cap = oldCap * 2;
+	for (i = 0; i < oldCap; i++) {
+		size_t mask = wb->cap - 1;
+		size_t j;
+		if (old[i].node == NULL)
+			continue;
+		j = slwbHash(old[i].node) & mask;
+		while (map[j].node != NULL)
+			j = (j + 1) & mask;
+		map[j] = old[i];
+	}
+	free(old);
+	return 0;
+}
+
+static void slwbRemove(slwb_t *wb, struct slwbEntry_s *e)
+{
+	size_t mask = wb->cap - 1;
+	size_t i = e - wb->map;
+	size_t j = i;
+	/* backward shift, no tombstones */
+	for (;;) {
+		size_t home;
+		j = (j + 1) & mask;
+		if (wb->map[j].node == NULL)
+			break;
+		home = slwbHash(wb->map[j].node) & mask;
+		if ((j > i && (home <= i || home > j)) || (j < i && (home <= i && home > j))) {
+			wb->map[i] = wb->map[j];
+			i = j;
+		}
+	}
+	wb->map[i].node = NULL;
+	wb->cnt--;
+}
+
+int slwbInit(slwb_t *wb, sl_t *sl, int threshold, double interval)
+{
+	memset(wb, 0, sizeof(*wb));
+	if ((wb->map = calloc(SLWB_INIT_CAP, sizeof(struct slwbEntry_s))) == NULL)
+		return -1;
+	wb->sl = sl;
+	wb->cap = SLWB_INIT_CAP;
+	wb->threshold = threshold;
+	wb->interval = interval;
+	wb->lastFlush = -1.0;
+	return 0;
+}
+
+void slwbDestroy(slwb_t *wb, void *ctx)
+{
+	slwbFlush(wb, ctx);
+	free(wb->map);
+	wb->map = NULL;
+}
+
+static void slwbApply(slwb_t *wb, slNode_t *node, double score, void *ctx)
+{
+	slNode_t *p = NULL;
+	if (slDeleteNode(wb->sl, node, ctx, &p) != 0)
+		return;
+	p->score = score;
+	slInsertNode(wb->sl, p, ctx);
+}
+
+int slwbUpdate(slwb_t *wb, slNode_t *node, double score, void *ctx)
+{
+	size_t mask;
+	size_t i;
+	wb->updates++;
+	if ((wb->cnt + 1) * 2 > wb->cap && slwbGrow(wb) != 0) {
+		struct slwbEntry_s *e = slwbFind(wb, node);
+		if (e != NULL)
+			slwbRemove(wb, e);
+		slwbApply(wb, node, score, ctx);
+		wb->applied++;
+		return 1;
+	}
+	mask = wb->cap - 1;
+	i = slwbHash(node) & mask;
+	while (wb->map[i].node != NULL && wb->map[i].node != node)
+		i = (i + 1) & mask;
+	if (wb->map[i].node == NULL) {
+		wb->map[i].node = node;
+		wb->cnt++;
+	}
+	wb->map[i].score = score;
+	if (wb->threshold > 0 && wb->cnt >= wb->threshold)
+		slwbFlush(wb, ctx);
+	return 0;
+}
+
+int slwbDelete(slwb_t *wb, slNode_t *node, void *ctx, slNode_t **pNode)
+{
+	struct slwbEntry_s *e = slwbFind(wb, node);
+	if (e != NULL)
+		slwbRemove(wb, e);
+	return slDeleteNode(wb->sl, node, ctx, pNode);
+}
+
+int slwbFlush(slwb_t *wb, void *ctx)
+{
+	slNode_t **nodes;
+	slNode_t *node;
+	int n = 0;
+	int i;
+	if (wb->cnt == 0)
+		return 0;
+	if ((nodes = malloc(sizeof(slNode_t *) * wb->cnt)) == NULL) {
+		/* apply in map order */
+		for (i = 0; i < wb->cap; i++) {
+			if (wb->map[i].node == NULL)
+				continue;
+			if (wb->map[i].node->score != wb->map[i].score) {
+				slwbApply(wb, wb->map[i].node, wb->map[i].score, ctx);
+				n++;
+			}
+			wb->map[i].node = NULL;
+		}
+		wb->cnt = 0;
+		wb->applied += n;
+		return n;
+	}
+	/* collect the moved nodes, their pending scores stay in the map */
+	for (i = 0; i < wb->cap; i++) {
+		node = wb->map[i].node;
+		if (node != NULL && node->score != wb->map[i].score)
+			nodes[n++] = node;
+	}
+	/* unlink in old score order, then link in new score order, each
+	 * sweep reuses the search path from one node to the next */
+	if (slSortNodes(wb->sl, nodes, n, ctx) == 0) {
+		(void)slDeleteNodes(wb->sl, nodes, n, ctx);
+	} else {
+		for (i = 0; i < n; i++)
+			(void)slDeleteNode(wb->sl, nodes[i], ctx, &node);
+	}
+	for (i = 0; i < n; i++)
+		nodes[i]->score = slwbFind(wb, nodes[i])->score;
+	for (i = 0; i < wb->cap; i++)
+		wb->map[i].node = NULL;
+	wb->cnt = 0;
+	if (slSortNodes(wb->sl, nodes, n, ctx) == 0) {
+		slInsertNodes(wb->sl, nodes, n, ctx);
+	} else {
+		for (i = 0; i < n; i++)
+			slInsertNode(wb->sl, nodes[i], ctx);
+	}
+	free(nodes);
+	wb->applied += n;
+	return n;
+}
+
+int slwbTick(slwb_t *wb, double now, void *ctx)
+{
+	if (wb->lastFlush < 0.0 || now < wb->lastFlush) {
+		wb->lastFlush = now;
+		return 0;
+	}
+	if (wb->interval <= 0.0 || now - wb->lastFlush < wb->interval)
+		return 0;
+	wb->lastFlush = now;
+	return slwbFlush(wb, ctx);
+}
+
+double slwbGetScore(slwb_t *wb, slNode_t *node)
+{
+	struct slwbEntry_s *e = slwbFind(wb, node);
+	return e != NULL ? e->score : node->score;
+}
+
+int slwbGetRank(slwb_t *wb, slNode_t *node, void *ctx)
+{
+	slwbFlush(wb, ctx);
+	return slGetRank(wb->sl, node, ctx);
+}
+
+slNode_t *slwbGetNodeByRank(slwb_t *wb, int rank, void *ctx)
+{
+	slwbFlush(wb, ctx);
+	return slGetNodeByRank(wb->sl, rank);
+}
+
+int slwbGetRankRange(slwb_t *wb, int rankMin, int rankMax,
+		     void **udataArr, double *scoreArr, int sz, void *ctx)
+{
+	slwbFlush(wb, ctx);
+	return slGetRankRange(wb->sl, rankMin, rankMax, udataArr, scoreArr, sz);
+}
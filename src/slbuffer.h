@@ -0,0 +1,92 @@
+#ifndef  _SLBUFFER_H_T3QF6M1Z_
+#define  _SLBUFFER_H_T3QF6M1Z_
+
+#include "skiplist.h"
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * write-coalescing front buffer of a sl_t
+ *
+ * slwbUpdate only records the latest score of a node in a hash map,
+ * so a hot member updated many times between two flushes costs one
+ * delete and insert. slwbFlush unlinks the moved nodes in old score
+ * order and links them back in new score order, reusing the search path
+ * from one node to the next; it runs when the map holds threshold
+ * nodes, on slwbTick after interval, or before any read through slwb*
+ * that needs rank.
+ *
+ * node->score is stale while the node is pending, use slwbGetScore.
+ */
+
+struct slwbEntry_s {
+	slNode_t *node;		/* NULL if empty */
+	double score;
+};
+
+typedef struct slWriteBuffer_s {
+	sl_t *sl;
+	struct slwbEntry_s *map;
+	int cnt;
+	int cap;
+	int threshold;		/* flush at cnt >= threshold, 0 for never */
+	double interval;	/* flush on slwbTick after interval, 0 for never */
+	double lastFlush;	/* < 0 until the first slwbTick */
+	unsigned long updates;	/* slwbUpdate calls */
+	unsigned long applied;	/* nodes moved in sl by flushes */
+} slwb_t;
+
+/**
+ * return 0 if succeed, -1 if no memory
+ */
+int slwbInit(slwb_t *wb, sl_t *sl, int threshold, double interval);
+
+/**
+ * flush and free the map, sl is kept
+ */
+void slwbDestroy(slwb_t *wb, void *ctx);
+
+/**
+ * set the score of node, node must be in sl;
+ * return 0 if buffered, 1 if applied to sl at once because of no memory
+ */
+int slwbUpdate(slwb_t *wb, slNode_t *node, double score, void *ctx);
+
+/**
+ * drop the pending score of node and slDeleteNode it
+ */
+int slwbDelete(slwb_t *wb, slNode_t *node, void *ctx, slNode_t **pNode);
+
+/**
+ * apply every pending score by slDeleteNodes and slInsertNodes;
+ * return count of nodes moved
+ */
+int slwbFlush(slwb_t *wb, void *ctx);
+
+/**
+ * flush if interval passed since the last flush,
+ * now is any monotonic clock in the unit of interval
+ * return count of nodes moved
+ */
+int slwbTick(slwb_t *wb, double now, void *ctx);
+
+/**
+ * pending score of node if any, node->score else
+ */
+double slwbGetScore(slwb_t *wb, slNode_t *node);
+
+/**
+ * exact reads, flush before reading sl
+ */
+int slwbGetRank(slwb_t *wb, slNode_t *node, void *ctx);
+slNode_t *slwbGetNodeByRank(slwb_t *wb, int rank, void *ctx);
+int slwbGetRankRange(slwb_t *wb, int rankMin, int rankMax,
+		     void **udataArr, double *scoreArr, int sz, void *ctx);
+
+#if defined (__cplusplus)
+}	/*end of extern "C"*/
+#endif
+
+#endif /* end of include guard:  _SLBUFFER_H_T3QF6M1Z_ */
@@ -0,0 +1,358 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "slbuild.h"
+
+struct slbJob_s;
+
+struct slbWorker_s {
+	pthread_t th;
+	int idx;
+	struct slbJob_s *job;
+	unsigned int rng;
+	size_t lo;		/* chunk of phase 1, segment of phase 3 */
+	size_t hi;
+	size_t outLo;		/* slot of phase 2 in job->out */
+	/* phase 3, per level: first and last node of the segment,
+	 * their rank and score prefix sum inside of the segment */
+	slNode_t *first[SKIPLIST_MAXLEVEL];
+	slNode_t *last[SKIPLIST_MAXLEVEL];
+	size_t firstRank[SKIPLIST_MAXLEVEL];
+	size_t lastRank[SKIPLIST_MAXLEVEL];
+	double firstSum[SKIPLIST_MAXLEVEL];
+	double lastSum[SKIPLIST_MAXLEVEL];
+	double total;
+	int level;
+	int failed;
+};
+
+struct slbJob_s {
+	sl_t *sl;
+	void *ctx;
+	void **udataArr;
+	const double *scoreArr;
+	size_t n;
+	int nthreads;
+	slNode_t **nodes;	/* sorted chunks */
+	slNode_t **out;		/* final order */
+	slNode_t **splitters;	/* nthreads - 1 */
+	size_t *bounds;		/* run k of chunk c is [bounds[c][k], bounds[c][k + 1]) */
+	struct slbWorker_s *workers;
+};
+
+#define SLB_BOUND(job, c, k) ((job)->bounds[(c) * ((job)->nthreads + 1) + (k)])
+
+static int slbRandomLevel(struct slbWorker_s *w)
+{
+	int level = 1;
+	unsigned int x = w->rng;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	w->rng = x;
+	/* SKIPLIST_P == 0.25 */
+	while ((x & 3) == 0 && level < SKIPLIST_MAXLEVEL) {
+		level++;
+		x >>= 2;
+	}
+	return level;
+}
+
+static int slbComp(struct slbJob_s *job, slNode_t *a, slNode_t *b)
+{
+	return job->sl->comp(a, b, job->sl, job->ctx);
+}
+
+static void slbRun(struct slbJob_s *job, void *(*fn)(void *))
+{
+	int started[SLB_MAX_THREADS];
+	int i;
+	for (i = 1; i < job->nthreads; i++)
+		started[i] = pthread_create(&job->workers[i].th, NULL, fn, &job->workers[i]) == 0;
+	fn(&job->workers[0]);
+	for (i = 1; i < job->nthreads; i++) {
+		/* no thread, do its share here */
+		if (started[i])
+			pthread_join(job->workers[i].th, NULL);
+		else
+			fn(&job->workers[i]);
+	}
+}
+
+/* phase 1 */
+static void *slbSortChunk(void *arg)
+{
+	struct slbWorker_s *w = arg;
+	struct slbJob_s *job = w->job;
+	size_t i;
+	for (i = w->lo; i < w->hi; i++) {
+		int level = slbRandomLevel(w);
+		slNode_t *node = job->sl->sum
+			? slCreateSumNode(level, job->udataArr[i], job->scoreArr[i])
+			: slCreateNode(level, job->udataArr[i], job->scoreArr[i]);
+		job->nodes[i] = node;
+		if (node == NULL)
+			w->failed = 1;
+	}
+	if (!w->failed && slSortNodes(job->sl, job->nodes + w->lo, (int)(w->hi - w->lo), job->ctx) != 0)
+		w->failed = 1;
+	return NULL;
+}
+
+/**
+ * first index of nodes[lo, hi) not ordered before key
+ */
+static size_t slbLowerBound(struct slbJob_s *job, size_t lo, size_t hi, slNode_t *key)
+{
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (slbComp(job, job->nodes[mid], key) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/**
+ * regular sampling: nthreads samples of every sorted chunk,
+ * every nthreads-th of the sorted samples splits the key space
+ */
+static int slbSplit(struct slbJob_s *job)
+{
+	int c;
+	int k;
+	int t = job->nthreads;
+	size_t off = 0;
+	slNode_t **samples = malloc(sizeof(slNode_t *) * t * t);
+	if (samples == NULL)
+		return -1;
+	for (c = 0; c < t; c++) {
+		struct slbWorker_s *w = &job->workers[c];
+		for (k = 0; k < t; k++)
+			samples[c * t + k] = job->nodes[w->lo + (w->hi - w->lo) * k / t];
+	}
+	if (slSortNodes(job->sl, samples, t * t, job->ctx) != 0) {
+		free(samples);
+		return -1;
+	}
+	for (k = 1; k < t; k++)
+		job->splitters[k - 1] = samples[k * t];
+	free(samples);
+
+	for (c = 0; c < t; c++) {
+		struct slbWorker_s *w = &job->workers[c];
+		SLB_BOUND(job, c, 0) = w->lo;
+		SLB_BOUND(job, c, t) = w->hi;
+		for (k = 1; k < t; k++)
+			SLB_BOUND(job, c, k) = slbLowerBound(job, SLB_BOUND(job, c, k - 1), w->hi,
+							    job->splitters[k - 1]);
+	}
+	for (k = 0; k < t; k++) {
+		job->workers[k].outLo = off;
+		for (c = 0; c < t; c++)
+			off += SLB_BOUND(job, c, k + 1) - SLB_BOUND(job, c, k);
+	}
+	return 0;
+}
+
+static void slbSiftDown(struct slbJob_s *job, int *heap, int cnt, const size_t *pos, int j)
+{
+	for (;;) {
+		int l = j * 2 + 1;
+		int m = j;
+		int tmp;
+		if (l < cnt && slbComp(job, job->nodes[pos[heap[l]]], job->nodes[pos[heap[m]]]) < 0)
+			m = l;
+		if (l + 1 < cnt && slbComp(job, job->nodes[pos[heap[l + 1]]], job->nodes[pos[heap[m]]]) < 0)
+			m = l + 1;
+		if (m == j)
+			return;
+		tmp = heap[j];
+		heap[j] = heap[m];
+		heap[m] = tmp;
+		j = m;
+	}
+}
+
+/* phase 2: merge run idx of every chunk, with a heap of run heads */
+static void *slbMergeRange(void *arg)
+{
+	struct slbWorker_s *w = arg;
+	struct slbJob_s *job = w->job;
+	size_t pos[SLB_MAX_THREADS];
+	size_t end[SLB_MAX_THREADS];
+	int heap[SLB_MAX_THREADS];
+	int heapCnt = 0;
+	size_t o = w->outLo;
+	int c;
+	for (c = 0; c < job->nthreads; c++) {
+		pos[c] = SLB_BOUND(job, c, w->idx);
+		end[c] = SLB_BOUND(job, c, w->idx + 1);
+		if (pos[c] < end[c])
+			heap[heapCnt++] = c;
+	}
+	for (c = heapCnt / 2 - 1; c >= 0; c--)
+		slbSiftDown(job, heap, heapCnt, pos, c);
+	while (heapCnt > 0) {
+		c = heap[0];
+		job->out[o++] = job->nodes[pos[c]++];
+		if (pos[c] >= end[c])
+			heap[0] = heap[--heapCnt];
+		slbSiftDown(job, heap, heapCnt, pos, 0);
+	}
+	return NULL;
+}
+
+/* phase 3 */
+static void *slbLinkSegment(void *arg)
+{
+	struct slbWorker_s *w = arg;
+	struct slbJob_s *job = w->job;
+	int sum = job->sl->sum;
+	double prefix = 0.0;
+	size_t i;
+	int j;
+	for (j = 0; j < SKIPLIST_MAXLEVEL; j++) {
+		w->first[j] = NULL;
+		w->last[j] = NULL;
+	}
+	w->level = 1;
+	for (i = w->lo; i < w->hi; i++) {
+		slNode_t *node = job->out[i];
+		size_t rank = i + 1;
+		prefix += node->score;
+		node->prev = i == 0 ? NULL : job->out[i - 1];
+		for (j = 0; j < node->levelSize; j++) {
+			slNode_t *last = w->last[j];
+			if (last == NULL) {
+				w->first[j] = node;
+				w->firstRank[j] = rank;
+				w->firstSum[j] = prefix;
+			} else {
+				last->level[j].next = node;
+				last->level[j].span = rank - w->lastRank[j];
+				if (sum)
+					SL_SUM(job->sl, last)[j] = prefix - w->lastSum[j];
+			}
+			w->last[j] = node;
+			w->lastRank[j] = rank;
+			w->lastSum[j] = prefix;
+		}
+		if (node->levelSize > w->level)
+			w->level = node->levelSize;
+	}
+	w->total = prefix;
+	return NULL;
+}
+
+static void slbStitch(struct slbJob_s *job)
+{
+	sl_t *sl = job->sl;
+	slNode_t *prev[SKIPLIST_MAXLEVEL];
+	size_t prevRank[SKIPLIST_MAXLEVEL];
+	double prevSum[SKIPLIST_MAXLEVEL];
+	double off = 0.0;
+	int s;
+	int j;
+	for (j = 0; j < SKIPLIST_MAXLEVEL; j++) {
+		prev[j] = SL_HEAD(sl);
+		prevRank[j] = 0;
+		prevSum[j] = 0.0;
+	}
+	for (s = 0; s < job->nthreads; s++) {
+		struct slbWorker_s *w = &job->workers[s];
+		for (j = 0; j < w->level; j++) {
+			if (w->first[j] == NULL)
+				continue;
+			prev[j]->level[j].next = w->first[j];
+			prev[j]->level[j].span = w->firstRank[j] - prevRank[j];
+			if (sl->sum)
+				SL_SUM(sl, prev[j])[j] = off + w->firstSum[j] - prevSum[j];
+			prev[j] = w->last[j];
+			prevRank[j] = w->lastRank[j];
+			prevSum[j] = off + w->lastSum[j];
+		}
+		if (w->level > sl->level)
+			sl->level = w->level;
+		off += w->total;
+	}
+	for (j = 0; j < SKIPLIST_MAXLEVEL; j++) {
+		prev[j]->level[j].next = NULL;
+		prev[j]->level[j].span = job->n - prevRank[j];
+		if (sl->sum)
+			SL_SUM(sl, prev[j])[j] = off - prevSum[j];
+	}
+	sl->tail = job->n == 0 ? NULL : job->out[job->n - 1];
+	sl->size = job->n;
+	sl->version++;
+}
+
+int slBuildParallel(sl_t *sl, void **udataArr, const double *scoreArr, int n,
+		    int nthreads, void *ctx)
+{
+	struct slbJob_s job;
+	int ret = -1;
+	int i;
+	/* embedded nodes come from the caller, det heights from the 1-2-3 rule */
+	if (sl->size != 0 || n < 0 || sl->embed || sl->det)
+		return -1;
+	if (nthreads < 1)
+		nthreads = 1;
+	if (nthreads > SLB_MAX_THREADS)
+		nthreads = SLB_MAX_THREADS;
+	/* a few nodes per thread at least, or sampling makes no sense */
+	while (nthreads > 1 && (size_t)n < (size_t)nthreads * nthreads * 4)
+		nthreads /= 2;
+
+	memset(&job, 0, sizeof(job));
+	job.sl = sl;
+	job.ctx = ctx;
+	job.udataArr = udataArr;
+	job.scoreArr = scoreArr;
+	job.n = n;
+	job.nthreads = nthreads;
+	job.nodes = calloc(n + 1, sizeof(slNode_t *));
+	job.out = malloc(sizeof(slNode_t *) * (n + 1));
+	job.splitters = malloc(sizeof(slNode_t *) * nthreads);
+	job.bounds = malloc(sizeof(size_t) * nthreads * (nthreads + 1));
+	job.workers = calloc(nthreads, sizeof(struct slbWorker_s));
+	if (job.nodes == NULL || job.out == NULL || job.splitters == NULL ||
+	    job.bounds == NULL || job.workers == NULL)
+		goto finished;
+
+	for (i = 0; i < nthreads; i++) {
+		struct slbWorker_s *w = &job.workers[i];
+		w->idx = i;
+		w->job = &job;
+		w->rng = ((unsigned int)rand() * 2654435761u + i) | 1;
+		w->lo = (size_t)n * i / nthreads;
+		w->hi = (size_t)n * (i + 1) / nthreads;
+	}
+	slbRun(&job, slbSortChunk);
+	for (i = 0; i < nthreads; i++) {
+		if (job.workers[i].failed)
+			goto finished;
+	}
+	if (slbSplit(&job) != 0)
+		goto finished;
+	slbRun(&job, slbMergeRange);
+	slbRun(&job, slbLinkSegment);
+	slbStitch(&job);
+	ret = 0;
+finished:
+	if (ret != 0 && job.nodes != NULL) {
+		for (i = 0; i < n; i++) {
+			if (job.nodes[i] != NULL)
+				slFreeNode(job.nodes[i], NULL, NULL);
+		}
+	}
+	free(job.nodes);
+	free(job.out);
+	free(job.splitters);
+	free(job.bounds);
+	free(job.workers);
+	return ret;
+}
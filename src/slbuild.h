@@ -0,0 +1,40 @@
+#ifndef  _SLBUILD_H_K2VN7T4A_
+#define  _SLBUILD_H_K2VN7T4A_
+
+#include "skiplist.h"
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * multi-threaded bulk construction from unsorted rows
+ *
+ * every phase runs on nthreads threads:
+ *	1. create nodes of a chunk, draw their heights and sort the chunk
+ *	2. split the sorted chunks at regular samples and merge one key
+ *	   range per thread into its slot of the final order
+ *	3. link levels and compute spans inside one segment per thread
+ * then the segments are stitched per level in O(nthreads * level).
+ *
+ * sl->comp is called from several threads at once, it must not
+ * keep state of its own; internalComp is fine.
+ */
+
+#define SLB_MAX_THREADS 64
+
+/**
+ * build the empty sl from n rows (udataArr[i], scoreArr[i]),
+ * nodes are created by slCreateNode, or slCreateSumNode for a sum list,
+ * ctx would be passed to sl->comp
+ * return 0 if succeed, -1 if sl is not empty, embedded (see slSetEmbedded)
+ * or deterministic (see slSetDeterministic), or no memory
+ */
+int slBuildParallel(sl_t *sl, void **udataArr, const double *scoreArr, int n,
+		    int nthreads, void *ctx);
+
+#if defined (__cplusplus)
+}	/*end of extern "C"*/
+#endif
+
+#endif /* end of include guard:  _SLBUILD_H_K2VN7T4A_ */
@@ -0,0 +1,410 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "slconcurrent.h"
+
+/* the writer owns sl, plain loads are fine on its side */
+#define SLC_LOAD_PTR(p) __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define SLC_STORE_PTR(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+#define SLC_LOAD(v) __atomic_load_n(&(v), __ATOMIC_RELAXED)
+#define SLC_STORE(v, x) __atomic_store_n(&(v), (x), __ATOMIC_RELAXED)
+
+/* readers check seq every SLC_HOP_CHECK hops, so a long walk over a list
+ * being rewritten restarts early instead of running on */
+#define SLC_HOP_CHECK 64
+
+static void slcWriteBegin(slc_t *slc)
+{
+	SLC_STORE(slc->seq, slc->seq + 1);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void slcWriteEnd(slc_t *slc)
+{
+	__atomic_store_n(&slc->seq, slc->seq + 1, __ATOMIC_RELEASE);
+}
+
+static unsigned long slcReadBegin(slc_t *slc)
+{
+	unsigned long seq;
+	while ((seq = __atomic_load_n(&slc->seq, __ATOMIC_ACQUIRE)) & 1)
+		;
+	return seq;
+}
+
+static int slcReadChanged(slc_t *slc, unsigned long seq)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&slc->seq, __ATOMIC_RELAXED) != seq;
+}
+
+void slcInit(slc_t *slc, slFreeCb freeCb, void *freeCtx)
+{
+	slInit(&slc->sl);
+	slc->sl.udata = NULL;
+	slc->seq = 0;
+	slc->epoch = 1;
+	memset(slc->readers, 0, sizeof(slc->readers));
+	slc->retired = NULL;
+	slc->retiredCnt = 0;
+	slc->retiredCap = 0;
+	slc->freeCb = freeCb;
+	slc->freeCtx = freeCtx;
+}
+
+void slcDestroy(slc_t *slc)
+{
+	int i;
+	for (i = 0; i < slc->retiredCnt; i++) {
+		slNode_t *node = slc->retired[i].node;
+		slFreeNode(node, slc->retired[i].freeUdata ? slc->freeCb : NULL, slc->freeCtx);
+	}
+	free(slc->retired);
+	slc->retired = NULL;
+	slc->retiredCnt = slc->retiredCap = 0;
+	slDestroy(&slc->sl, slc->freeCb, slc->freeCtx);
+}
+
+/**
+ * make room for one more retired node before unlinking it,
+ * return -1 if no memory
+ */
+static int slcRetireRoom(slc_t *slc)
+{
+	if (slc->retiredCnt >= slc->retiredCap) {
+		int cap = slc->retiredCap * 2 + SLC_RECLAIM_THRESHOLD;
+		struct slcRetired_s *arr = realloc(slc->retired, sizeof(*arr) * cap);
+		if (arr == NULL)
+			return -1;
+		slc->retired = arr;
+		slc->retiredCap = cap;
+	}
+	return 0;
+}
+
+/* after slcRetireRoom */
+static void slcRetire(slc_t *slc, slNode_t *node, int freeUdata)
+{
+	slc->retired[slc->retiredCnt].node = node;
+	slc->retired[slc->retiredCnt].epoch = __atomic_load_n(&slc->epoch, __ATOMIC_RELAXED);
+	slc->retired[slc->retiredCnt].freeUdata = freeUdata;
+	slc->retiredCnt++;
+	if (slc->retiredCnt % SLC_RECLAIM_THRESHOLD == 0)
+		slcReclaim(slc);
+}
+
+int slcReclaim(slc_t *slc)
+{
+	int i;
+	int n = 0;
+	int freed = 0;
+	unsigned long min = ULONG_MAX;
+
+	/* readers entering from now on can not reach retired nodes */
+	__atomic_add_fetch(&slc->epoch, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	for (i = 0; i < SLC_MAX_READERS; i++) {
+		unsigned long e = __atomic_load_n(&slc->readers[i].epoch, __ATOMIC_SEQ_CST);
+		if (e != 0 && e < min)
+			min = e;
+	}
+	for (i = 0; i < slc->retiredCnt; i++) {
+		struct slcRetired_s *r = &slc->retired[i];
+		if (r->epoch < min) {
+			slFreeNode(r->node, r->freeUdata ? slc->freeCb : NULL, slc->freeCtx);
+			freed++;
+		} else {
+			slc->retired[n++] = *r;
+		}
+	}
+	slc->retiredCnt = n;
+	return freed;
+}
+
+void slcInsertNode(slc_t *slc, slNode_t *node, void *ctx)
+{
+	sl_t *sl = &slc->sl;
+	int level;
+	slNode_t *update[SKIPLIST_MAXLEVEL];
+	slNode_t *p;
+	int rank[SKIPLIST_MAXLEVEL];
+	int i;
+
+	p = SL_HEAD(sl);
+	for (i = sl->level - 1; i >= 0; i--) {
+		rank[i] = i == (sl->level-1) ? 0 : rank[i+1];
+		while (p->level[i].next != NULL
+			&& (sl->comp(p->level[i].next, node, sl, ctx) < 0)) {
+			rank[i] += p->level[i].span;
+			p = p->level[i].next;
+		}
+		update[i] = p;
+	}
+
+	slcWriteBegin(slc);
+	level = node->levelSize;
+	if (level > sl->level) {
+		for (i = sl->level; i < level; i++) {
+			rank[i] = 0;
+			update[i] = SL_HEAD(sl);
+			SLC_STORE(update[i]->level[i].span, sl->size);
+		}
+	}
+	/* node must be complete before any reader can reach it */
+	for (i = 0; i < level; i++) {
+		node->level[i].next = update[i]->level[i].next;
+		node->level[i].span = update[i]->level[i].span - (rank[0] - rank[i]);
+	}
+	node->prev = (update[0] == SL_HEAD(sl)) ? NULL : update[0];
+	for (i = 0; i < level; i++) {
+		SLC_STORE(update[i]->level[i].span, rank[0] - rank[i] + 1);
+		SLC_STORE_PTR(update[i]->level[i].next, node);
+	}
+	for (i = level; i < sl->level; i++) {
+		SLC_STORE(update[i]->level[i].span, update[i]->level[i].span + 1);
+	}
+	if (level > sl->level)
+		SLC_STORE(sl->level, level);
+	if (node->level[0].next)
+		node->level[0].next->prev = node;
+	else
+		sl->tail = node;
+	SLC_STORE(sl->size, sl->size + 1);
+	sl->version++;
+	slcWriteEnd(slc);
+}
+
+static int slcUnlink(slc_t *slc, slNode_t *node, void *ctx)
+{
+	sl_t *sl = &slc->sl;
+	slNode_t *update[SKIPLIST_MAXLEVEL];
+	slNode_t *p;
+	slNode_t *header;
+	int i;
+
+	p = SL_HEAD(sl);
+	for (i = sl->level - 1; i >= 0; i--) {
+		while (p->level[i].next != NULL &&
+		       sl->comp(p->level[i].next, node, sl, ctx) < 0) {
+			p = p->level[i].next;
+		}
+		update[i] = p;
+	}
+	if (p->level[0].next != node)
+		return -1;
+
+	/* node keeps its own links, so readers standing on it can go on */
+	slcWriteBegin(slc);
+	for (i = 0; i < sl->level; i++) {
+		if (update[i]->level[i].next == node) {
+			SLC_STORE(update[i]->level[i].span,
+				  update[i]->level[i].span + node->level[i].span - 1);
+			SLC_STORE_PTR(update[i]->level[i].next, node->level[i].next);
+		} else {
+			SLC_STORE(update[i]->level[i].span, update[i]->level[i].span - 1);
+		}
+	}
+	if (node->level[0].next != NULL) {
+		node->level[0].next->prev = node->prev;
+	} else {
+		sl->tail = node->prev;
+	}
+	header = SL_HEAD(sl);
+	while (sl->level > 1 && header->level[sl->level-1].next == NULL)
+		SLC_STORE(sl->level, sl->level - 1);
+	SLC_STORE(sl->size, sl->size - 1);
+	sl->version++;
+	slcWriteEnd(slc);
+	return 0;
+}
+
+int slcDeleteNode(slc_t *slc, slNode_t *node, void *ctx)
+{
+	if (slcRetireRoom(slc) != 0 || slcUnlink(slc, node, ctx) != 0)
+		return -1;
+	slcRetire(slc, node, 1);
+	return 0;
+}
+
+slNode_t *slcUpdate(slc_t *slc, slNode_t *node, double score, void *ctx)
+{
+	slNode_t *fresh;
+	if (slcRetireRoom(slc) != 0)
+		return NULL;
+	if ((fresh = slCreateNode(slRandomLevel(), node->udata, score)) == NULL)
+		return NULL;
+	if (slcUnlink(slc, node, ctx) != 0) {
+		slFreeNode(fresh, NULL, NULL);
+		return NULL;
+	}
+	/* udata moved to fresh */
+	slcRetire(slc, node, 0);
+	slcInsertNode(slc, fresh, ctx);
+	return fresh;
+}
+
+int slcReaderRegister(slc_t *slc)
+{
+	int i;
+	for (i = 0; i < SLC_MAX_READERS; i++) {
+		int unused = 0;
+		if (__atomic_compare_exchange_n(&slc->readers[i].used, &unused, 1, 0,
+						__ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+			return i;
+	}
+	return -1;
+}
+
+void slcReaderUnregister(slc_t *slc, int rid)
+{
+	__atomic_store_n(&slc->readers[rid].epoch, 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&slc->readers[rid].used, 0, __ATOMIC_RELEASE);
+}
+
+void slcReadLock(slc_t *slc, int rid)
+{
+	unsigned long epoch = __atomic_load_n(&slc->epoch, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&slc->readers[rid].epoch, epoch, __ATOMIC_SEQ_CST);
+	/* pairs with the fence in slcReclaim */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void slcReadUnlock(slc_t *slc, int rid)
+{
+	__atomic_store_n(&slc->readers[rid].epoch, 0, __ATOMIC_RELEASE);
+}
+
+int slcGetSize(slc_t *slc)
+{
+	return (int)SLC_LOAD(slc->sl.size);
+}
+
+int slcGetRank(slc_t *slc, slNode_t *node, void *ctx)
+{
+	sl_t *sl = &slc->sl;
+	unsigned long seq;
+	int traversed;
+	int rank;
+	int hops;
+	int i;
+	slNode_t *p;
+	slNode_t *next;
+
+	if (node == NULL)
+		return 0;
+retry:
+	seq = slcReadBegin(slc);
+	traversed = 0;
+	rank = 0;
+	hops = 0;
+	p = SL_HEAD(sl);
+	for (i = SLC_LOAD(sl->level) - 1; i >= 0; i--) {
+		while ((next = SLC_LOAD_PTR(p->level[i].next)) != NULL &&
+		       sl->comp(next, node, sl, ctx) <= 0) {
+			traversed += SLC_LOAD(p->level[i].span);
+			p = next;
+			if (++hops % SLC_HOP_CHECK == 0 && slcReadChanged(slc, seq))
+				goto retry;
+		}
+		if (p != SL_HEAD(sl) && sl->comp(p, node, sl, ctx) == 0) {
+			rank = traversed;
+			break;
+		}
+	}
+	if (slcReadChanged(slc, seq))
+		goto retry;
+	return rank;
+}
+
+int slcCountLess(slc_t *slc, slNode_t *key, void *ctx)
+{
+	sl_t *sl = &slc->sl;
+	unsigned long seq;
+	int traversed;
+	int hops;
+	int i;
+	slNode_t *p;
+	slNode_t *next;
+
+retry:
+	seq = slcReadBegin(slc);
+	traversed = 0;
+	hops = 0;
+	p = SL_HEAD(sl);
+	for (i = SLC_LOAD(sl->level) - 1; i >= 0; i--) {
+		while ((next = SLC_LOAD_PTR(p->level[i].next)) != NULL &&
+		       sl->comp(next, key, sl, ctx) < 0) {
+			traversed += SLC_LOAD(p->level[i].span);
+			p = next;
+			if (++hops % SLC_HOP_CHECK == 0 && slcReadChanged(slc, seq))
+				goto retry;
+		}
+	}
+	if (slcReadChanged(slc, seq))
+		goto retry;
+	return traversed;
+}
+
+slNode_t *slcGetNodeByRank(slc_t *slc, int rank)
+{
+	sl_t *sl = &slc->sl;
+	unsigned long seq;
+	int traversed;
+	int hops;
+	int i;
+	slNode_t *p;
+	slNode_t *next;
+	slNode_t *found;
+
+retry:
+	seq = slcReadBegin(slc);
+	traversed = 0;
+	hops = 0;
+	found = NULL;
+	p = SL_HEAD(sl);
+	for (i = SLC_LOAD(sl->level) - 1; i >= 0; i--) {
+		while ((next = SLC_LOAD_PTR(p->level[i].next)) != NULL &&
+		       SLC_LOAD(p->level[i].span) + traversed <= (size_t)rank) {
+			traversed += SLC_LOAD(p->level[i].span);
+			p = next;
+			if (++hops % SLC_HOP_CHECK == 0 && slcReadChanged(slc, seq))
+				goto retry;
+		}
+		if (traversed == rank) {
+			found = p == SL_HEAD(sl) ? NULL : p;
+			break;
+		}
+	}
+	if (slcReadChanged(slc, seq))
+		goto retry;
+	return found;
+}
+
+int slcGetRankRange(slc_t *slc,
+		    int rankMin, int rankMax,
+		    void **udataArr, double *scoreArr, int sz)
+{
+	unsigned long seq;
+	slNode_t *p;
+	int n;
+
+	if (sz <= 0 || rankMin < 1 || rankMin > rankMax)
+		return 0;
+retry:
+	/* slcGetNodeByRank validates on its own, the walk below must
+	 * belong to the same version */
+	seq = slcReadBegin(slc);
+	p = slcGetNodeByRank(slc, rankMin);
+	for (n = 0; p != NULL && n < sz && n <= rankMax - rankMin; n++) {
+		if (udataArr != NULL)
+			udataArr[n] = p->udata;
+		if (scoreArr != NULL)
+			scoreArr[n] = p->score;
+		p = SLC_LOAD_PTR(p->level[0].next);
+		if ((n + 1) % SLC_HOP_CHECK == 0 && slcReadChanged(slc, seq))
+			goto retry;
+	}
+	if (slcReadChanged(slc, seq))
+		goto retry;
+	return n;
+}
@@ -0,0 +1,127 @@
+#ifndef  _SLCONCURRENT_H_R7WD3M0E_
+#define  _SLCONCURRENT_H_R7WD3M0E_
+
+#include "skiplist.h"
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * single writer / multi reader skiplist
+ *
+ * one writer thread calls slcInsertNode/slcDeleteNode/slcUpdate,
+ * links and spans are published with release stores and every write
+ * bumps slc->seq, so readers traverse without locks and retry a query
+ * if slc->seq changed underneath them.
+ *
+ * deleted nodes are retired and freed by the writer only after every
+ * reader that could still see them has left its read section (epochs).
+ *
+ * reader:
+ *	int rid = slcReaderRegister(slc);
+ *	slcReadLock(slc, rid);
+ *	rank = slcGetRank(slc, node, ctx);
+ *	slcReadUnlock(slc, rid);
+ *	...
+ *	slcReaderUnregister(slc, rid);
+ *
+ * nodes returned by readers are valid until slcReadUnlock.
+ */
+
+#define SLC_MAX_READERS 64
+#define SLC_RECLAIM_THRESHOLD 128
+
+struct slcReaderSlot_s {
+	unsigned long epoch;	/* 0 if not inside a read section */
+	int used;
+	char pad[64 - sizeof(unsigned long) - sizeof(int)];
+};
+
+struct slcRetired_s {
+	slNode_t *node;
+	unsigned long epoch;	/* slc->epoch when node was unlinked */
+	int freeUdata;		/* 0 if udata moved to another node */
+};
+
+typedef struct slConcurrent_s {
+	sl_t sl;
+	unsigned long seq;	/* odd while the writer is changing sl */
+	unsigned long epoch;
+	struct slcReaderSlot_s readers[SLC_MAX_READERS];
+	struct slcRetired_s *retired;
+	int retiredCnt;
+	int retiredCap;
+	slFreeCb freeCb;	/* called on udata of reclaimed nodes */
+	void *freeCtx;
+} slc_t;
+
+/**
+ * freeCb would be called when a deleted node is reclaimed
+ */
+void slcInit(slc_t *slc, slFreeCb freeCb, void *freeCtx);
+
+/**
+ * free every node, no reader may be inside of a read section
+ */
+void slcDestroy(slc_t *slc);
+
+/**
+ * writer only
+ */
+void slcInsertNode(slc_t *slc, slNode_t *node, void *ctx);
+
+/**
+ * unlink node and retire it, return 0 if succeed,
+ * -1 if node not found or no memory, sl is not changed then
+ */
+int slcDeleteNode(slc_t *slc, slNode_t *node, void *ctx);
+
+/**
+ * retire node and insert a new node with the same udata and score,
+ * return the new node, NULL if node not found or no memory,
+ * sl is not changed then
+ */
+slNode_t *slcUpdate(slc_t *slc, slNode_t *node, double score, void *ctx);
+
+/**
+ * free retired nodes no reader can see any more,
+ * called by slcDeleteNode every SLC_RECLAIM_THRESHOLD retirements;
+ * return count of nodes freed
+ */
+int slcReclaim(slc_t *slc);
+
+/**
+ * return reader id, -1 if SLC_MAX_READERS readers registered
+ */
+int slcReaderRegister(slc_t *slc);
+void slcReaderUnregister(slc_t *slc, int rid);
+
+void slcReadLock(slc_t *slc, int rid);
+void slcReadUnlock(slc_t *slc, int rid);
+
+/**
+ * readers, must be called inside of a read section
+ */
+int slcGetSize(slc_t *slc);
+int slcGetRank(slc_t *slc, slNode_t *node, void *ctx);
+slNode_t *slcGetNodeByRank(slc_t *slc, int rank);
+
+/**
+ * count of nodes ordered before key by sl->comp,
+ * key needs score and udata only and does not have to be in slc
+ */
+int slcCountLess(slc_t *slc, slNode_t *key, void *ctx);
+
+/**
+ * see slGetRankRange, a consistent snapshot of the range is copied
+ */
+int slcGetRankRange(slc_t *slc,
+		    int rankMin, int rankMax,
+		    void **udataArr, double *scoreArr, int sz);
+
+#if defined (__cplusplus)
+}	/*end of extern "C"*/
+#endif
+
+#endif /* end of include guard:  _SLCONCURRENT_H_R7WD3M0E_ */
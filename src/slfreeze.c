@@ -0,0 +1,223 @@
+#include <stdlib.h>
+#include <string.h>
+#include "slfreeze.h"
+
+#ifdef __GNUC__
+# define SLFZ_PREFETCH(p) __builtin_prefetch(p)
+#else
+# define SLFZ_PREFETCH(p)
+#endif
+
+/* blob: header, eytz[size + 1], scores[size], udata[size], eytzRank[size + 1] */
+static size_t slfzBlobSize(size_t size)
+{
+	return sizeof(struct slfzHeader_s) + sizeof(double) * (size + 1) + sizeof(double) * size
+		+ sizeof(void *) * size + sizeof(int) * (size + 1);
+}
+
+static slfz_t *slfzWrap(struct slfzHeader_s *hdr, int owned)
+{
+	slfz_t *fz = malloc(sizeof(*fz));
+	char *p = (char *)hdr;
+	if (fz == NULL)
+		return NULL;
+	fz->hdr = hdr;
+	fz->size = hdr->size;
+	fz->owned = owned;
+	p += sizeof(struct slfzHeader_s);
+	fz->eytz = (const double *)p;
+	p += sizeof(double) * (fz->size + 1);
+	fz->scores = (const double *)p;
+	p += sizeof(double) * fz->size;
+	fz->udata = (void * const *)p;
+	p += sizeof(void *) * fz->size;
+	fz->eytzRank = (const int *)p;
+	return fz;
+}
+
+/**
+ * an in-order walk of the implicit tree (children of k at 2k, 2k + 1)
+ * meets the slots in rank order
+ */
+static void slfzLayout(double *eytz, int *eytzRank, const double *scores, size_t size)
+{
+	size_t i = 0;
+	size_t k = 1;
+	/* the leftmost slot, then in-order successors */
+	while (k <= size)
+		k *= 2;
+	k /= 2;
+	while (k >= 1 && i < size) {
+		eytz[k] = scores[i];
+		eytzRank[k] = (int)++i;
+		if (k * 2 + 1 <= size) {
+			/* leftmost of the right subtree */
+			k = k * 2 + 1;
+			while (k * 2 <= size)
+				k *= 2;
+		} else {
+			/* up while we are a right child */
+			while (k & 1)
+				k >>= 1;
+			k >>= 1;
+		}
+	}
+}
+
+slfz_t *slFreeze(sl_t *sl)
+{
+	size_t size = sl->size;
+	size_t blobSize = slfzBlobSize(size);
+	struct slfzHeader_s *hdr = malloc(blobSize);
+	slfz_t *fz;
+	slNode_t *node;
+	double *scores;
+	void **udata;
+	size_t i;
+	if (hdr == NULL)
+		return NULL;
+	hdr->magic = SLFZ_MAGIC;
+	hdr->size = size;
+	hdr->version = sl->version;
+	hdr->blobSize = blobSize;
+	if ((fz = slfzWrap(hdr, 1)) == NULL) {
+		free(hdr);
+		return NULL;
+	}
+	scores = (double *)fz->scores;
+	udata = (void **)fz->udata;
+	for (node = SL_FIRST(sl), i = 0; node != NULL; node = SL_NEXT(node), i++) {
+		scores[i] = node->score;
+		udata[i] = node->udata;
+	}
+	((double *)fz->eytz)[0] = 0.0;
+	((int *)fz->eytzRank)[0] = 0;
+	slfzLayout((double *)fz->eytz, (int *)fz->eytzRank, scores, size);
+	return fz;
+}
+
+slfz_t *slfzLoad(const void *buf, size_t size)
+{
+	const struct slfzHeader_s *hdr = buf;
+	if (size < sizeof(*hdr) || hdr->magic != SLFZ_MAGIC ||
+	    hdr->blobSize != size || slfzBlobSize(hdr->size) != size)
+		return NULL;
+	return slfzWrap((struct slfzHeader_s *)hdr, 0);
+}
+
+void slfzFree(slfz_t *fz)
+{
+	if (fz == NULL)
+		return;
+	if (fz->owned)
+		free(fz->hdr);
+	free(fz);
+}
+
+const void *slfzData(slfz_t *fz, size_t *pSize)
+{
+	if (pSize != NULL)
+		*pSize = fz->hdr->blobSize;
+	return fz->hdr;
+}
+
+int slfzIsCurrent(slfz_t *fz, sl_t *sl)
+{
+	return fz->hdr->version == sl->version && fz->size == sl->size;
+}
+
+int slfzGetSize(slfz_t *fz)
+{
+	return (int)fz->size;
+}
+
+/**
+ * descend without branches on the comparison, k ends past a leaf with
+ * the path in its bits; the last left turn is the answer
+ */
+#define SLFZ_SEARCH(fz, k, cond) do { \
+	const double *e_ = (fz)->eytz; \
+	size_t n_ = (fz)->size; \
+	k = 1; \
+	while (k <= n_) { \
+		SLFZ_PREFETCH(e_ + k * 16); \
+		k = 2 * k + (cond); \
+	} \
+	while (k & 1) \
+		k >>= 1; \
+	k >>= 1; \
+} while (0)
+
+int slfzLowerBound(slfz_t *fz, double score)
+{
+	size_t k;
+	SLFZ_SEARCH(fz, k, e_[k] < score);
+	return k == 0 ? (int)fz->size + 1 : fz->eytzRank[k];
+}
+
+int slfzUpperBound(slfz_t *fz, double score)
+{
+	size_t k;
+	SLFZ_SEARCH(fz, k, e_[k] <= score);
+	return k == 0 ? (int)fz->size + 1 : fz->eytzRank[k];
+}
+
+int slfzGetRank(slfz_t *fz, void *udata, double score)
+{
+	size_t i;
+	for (i = slfzLowerBound(fz, score) - 1; i < fz->size && fz->scores[i] == score; i++) {
+		if (fz->udata[i] == udata)
+			return (int)i + 1;
+	}
+	return 0;
+}
+
+int slfzGetByRank(slfz_t *fz, int rank, void **pUdata, double *pScore)
+{
+	if (rank < 1 || (size_t)rank > fz->size)
+		return -1;
+	if (pUdata != NULL)
+		*pUdata = fz->udata[rank - 1];
+	if (pScore != NULL)
+		*pScore = fz->scores[rank - 1];
+	return 0;
+}
+
+static int slfzCopy(slfz_t *fz, int rankMin, int rankMax,
+		    void **udataArr, double *scoreArr, int sz)
+{
+	int n;
+	if (rankMax > (int)fz->size)
+		rankMax = (int)fz->size;
+	n = rankMax - rankMin + 1;
+	if (n > sz)
+		n = sz;
+	if (n <= 0)
+		return 0;
+	if (udataArr != NULL)
+		memcpy(udataArr, fz->udata + rankMin - 1, sizeof(void *) * n);
+	if (scoreArr != NULL)
+		memcpy(scoreArr, fz->scores + rankMin - 1, sizeof(double) * n);
+	return n;
+}
+
+int slfzGetRankRange(slfz_t *fz, int rankMin, int rankMax,
+		     void **udataArr, double *scoreArr, int sz)
+{
+	if (sz <= 0 || rankMin < 1 || rankMin > rankMax)
+		return 0;
+	return slfzCopy(fz, rankMin, rankMax, udataArr, scoreArr, sz);
+}
+
+int slfzGetScoreRange(slfz_t *fz, double min, double max,
+		      int *pRankMin, int *pRankMax,
+		      void **udataArr, double *scoreArr, int sz)
+{
+	int rankMin = slfzLowerBound(fz, min);
+	int rankMax = slfzUpperBound(fz, max) - 1;
+	if (pRankMin != NULL)
+		*pRankMin = rankMin;
+	if (pRankMax != NULL)
+		*pRankMax = rankMax;
+	return slfzCopy(fz, rankMin, rankMax, udataArr, scoreArr, sz);
+}
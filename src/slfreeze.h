@@ -0,0 +1,108 @@
+#ifndef  _SLFREEZE_H_B8MJ4R0X_
+#define  _SLFREEZE_H_B8MJ4R0X_
+
+#include <stddef.h>
+#include "skiplist.h"
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * frozen, read-only copy of a sl_t
+ *
+ * one contiguous blob holds the scores twice, in rank order and in
+ * Eytzinger (BFS) order for a branchless, cache friendly binary search,
+ * plus udata in rank order and the rank of every Eytzinger slot.
+ * the blob is position independent: slfzData hands it out for writing
+ * to disk, slfzLoad wraps a blob in place without a copy.
+ *
+ * udata is stored by pointer value, store ids in udata if a blob has to
+ * outlive the process.
+ *
+ * a frozen copy answers queries for sl until the next change of sl,
+ * see slfzIsCurrent; score bounds assume sl is ordered by score ascending.
+ */
+
+#define SLFZ_MAGIC 0x736c667aUL
+
+struct slfzHeader_s {
+	unsigned long magic;
+	unsigned long size;
+	unsigned long version;	/* sl->version when frozen */
+	unsigned long blobSize;
+};
+
+typedef struct slFrozen_s {
+	struct slfzHeader_s *hdr;	/* start of the blob */
+	size_t size;
+	const double *eytz;		/* eytz[1..size], eytz[0] unused */
+	const double *scores;		/* scores[0..size), by rank - 1 */
+	void * const *udata;		/* like scores */
+	const int *eytzRank;		/* rank of eytz[k] */
+	int owned;			/* 1 if slfzFree frees the blob */
+} slfz_t;
+
+/**
+ * copy sl in rank order, O(N)
+ * return NULL if no memory
+ */
+slfz_t *slFreeze(sl_t *sl);
+
+/**
+ * wrap a blob from slfzData, buf must be aligned like a double and
+ * outlive the frozen copy
+ * return NULL if buf is not a whole blob or no memory
+ */
+slfz_t *slfzLoad(const void *buf, size_t size);
+
+void slfzFree(slfz_t *fz);
+
+/**
+ * the blob, *pSize bytes
+ */
+const void *slfzData(slfz_t *fz, size_t *pSize);
+
+/**
+ * 1 if sl did not change since fz was frozen from it
+ */
+int slfzIsCurrent(slfz_t *fz, sl_t *sl);
+
+int slfzGetSize(slfz_t *fz);
+
+/**
+ * rank of the first score >= score (lower bound), > score (upper bound),
+ * size + 1 if none
+ */
+int slfzLowerBound(slfz_t *fz, double score);
+int slfzUpperBound(slfz_t *fz, double score);
+
+/**
+ * rank of (score, udata), 0 if not found;
+ * equal scores are scanned in rank order
+ */
+int slfzGetRank(slfz_t *fz, void *udata, double score);
+
+/**
+ * return 0 if succeed, -1 if rank is out of range
+ */
+int slfzGetByRank(slfz_t *fz, int rank, void **pUdata, double *pScore);
+
+/**
+ * see slGetRankRange
+ */
+int slfzGetRankRange(slfz_t *fz, int rankMin, int rankMax,
+		     void **udataArr, double *scoreArr, int sz);
+
+/**
+ * see slGetScoreRange
+ */
+int slfzGetScoreRange(slfz_t *fz, double min, double max,
+		      int *pRankMin, int *pRankMax,
+		      void **udataArr, double *scoreArr, int sz);
+
+#if defined (__cplusplus)
+}	/*end of extern "C"*/
+#endif
+
+#endif /* end of include guard:  _SLFREEZE_H_B8MJ4R0X_ */
@@ -0,0 +1,437 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "sllockfree.h"
+
+#define SLLF_MARK(p) ((sllfNode_t *)((size_t)(p) | 1))
+#define SLLF_UNMARK(p) ((sllfNode_t *)((size_t)(p) & ~(size_t)1))
+#define SLLF_IS_MARKED(p) (((size_t)(p)) & 1)
+
+#define SLLF_LOAD(p) __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define SLLF_CAS(p, expected, desired) \
+	__atomic_compare_exchange_n(&(p), &(expected), (desired), 0, \
+				    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+
+/* node->state */
+#define SLLF_INSERTING 0
+#define SLLF_LINKED 1
+#define SLLF_DELETED_EARLY 2	/* deleted before sllfInsert finished linking */
+#define SLLF_POPPED_EARLY 3	/* the same, udata handed over */
+
+static int sllfComp(sllfNode_t *node, double score, void *udata)
+{
+	if (node->score != score)
+		return node->score < score ? -1 : 1;
+	if (node->udata == udata)
+		return 0;
+	return (size_t)node->udata < (size_t)udata ? -1 : 1;
+}
+
+static int sllfRandomLevel(struct sllfThread_s *t)
+{
+	int level = 1;
+	unsigned int x = t->rng;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	t->rng = x;
+	/* SKIPLIST_P == 0.25, two bits per level */
+	while ((x & 3) == 0 && level < SLLF_MAXLEVEL) {
+		level++;
+		x >>= 2;
+	}
+	return level;
+}
+
+static sllfNode_t *sllfCreateNode(int level, void *udata, double score)
+{
+	int i;
+	sllfNode_t *node = malloc(sizeof(sllfNode_t) + sizeof(sllfNode_t *) * (level - 1));
+	if (node == NULL)
+		return NULL;
+	node->score = score;
+	node->udata = udata;
+	node->levelSize = level;
+	node->state = SLLF_INSERTING;
+	for (i = 0; i < level; i++)
+		node->next[i] = NULL;
+	return node;
+}
+
+sllf_t *sllfCreate(slFreeCb freeCb, void *freeCtx)
+{
+	int i;
+	sllf_t *l = malloc(sizeof(*l));
+	if (l == NULL)
+		return NULL;
+	memset(l, 0, sizeof(*l));
+	l->head = sllfCreateNode(SLLF_MAXLEVEL, NULL, 0.0);
+	if (l->head == NULL) {
+		free(l);
+		return NULL;
+	}
+	l->epoch = 1;
+	l->freeCb = freeCb;
+	l->freeCtx = freeCtx;
+	for (i = 0; i < SLLF_MAX_THREADS; i++)
+		l->threads[i].rng = 2463534242u + i * 2654435761u;
+	return l;
+}
+
+static void sllfFreeNode(sllf_t *l, sllfNode_t *node, int freeUdata)
+{
+	if (freeUdata && l->freeCb != NULL)
+		l->freeCb(node->udata, l->freeCtx);
+	free(node);
+}
+
+void sllfFree(sllf_t *l)
+{
+	int i;
+	int j;
+	sllfNode_t *node;
+	sllfNode_t *next;
+	/* retired nodes are unlinked already, so nothing is freed twice */
+	for (node = SLLF_UNMARK(l->head->next[0]); node != NULL; node = next) {
+		next = SLLF_UNMARK(node->next[0]);
+		sllfFreeNode(l, node, 1);
+	}
+	for (i = 0; i < SLLF_MAX_THREADS; i++) {
+		struct sllfThread_s *t = &l->threads[i];
+		for (j = 0; j < t->retiredCnt; j++)
+			sllfFreeNode(l, t->retired[j].node, t->retired[j].freeUdata);
+		free(t->retired);
+	}
+	free(l->head);
+	free(l);
+}
+
+int sllfThreadRegister(sllf_t *l)
+{
+	int i;
+	for (i = 0; i < SLLF_MAX_THREADS; i++) {
+		int unused = 0;
+		if (__atomic_compare_exchange_n(&l->threads[i].used, &unused, 1, 0,
+						__ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+			return i;
+	}
+	return -1;
+}
+
+void sllfThreadUnregister(sllf_t *l, int tid)
+{
+	__atomic_store_n(&l->threads[tid].epoch, 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&l->threads[tid].used, 0, __ATOMIC_RELEASE);
+}
+
+static void sllfReclaim(sllf_t *l, struct sllfThread_s *t)
+{
+	int i;
+	int n = 0;
+	unsigned long min = ULONG_MAX;
+
+	__atomic_add_fetch(&l->epoch, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	for (i = 0; i < SLLF_MAX_THREADS; i++) {
+		unsigned long e = __atomic_load_n(&l->threads[i].epoch, __ATOMIC_SEQ_CST);
+		if (e != 0 && e < min)
+			min = e;
+	}
+	for (i = 0; i < t->retiredCnt; i++) {
+		struct sllfRetired_s *r = &t->retired[i];
+		if (r->epoch < min)
+			sllfFreeNode(l, r->node, r->freeUdata);
+		else
+			t->retired[n++] = *r;
+	}
+	t->retiredCnt = n;
+}
+
+static void sllfEnter(sllf_t *l, int tid)
+{
+	unsigned long epoch = __atomic_load_n(&l->epoch, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&l->threads[tid].epoch, epoch, __ATOMIC_SEQ_CST);
+	/* pairs with the fence in sllfReclaim */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static void sllfExit(sllf_t *l, int tid)
+{
+	struct sllfThread_s *t = &l->threads[tid];
+	__atomic_store_n(&t->epoch, 0, __ATOMIC_RELEASE);
+	if (t->retiredCnt >= SLLF_RECLAIM_THRESHOLD)
+		sllfReclaim(l, t);
+}
+
+static void sllfRetire(sllf_t *l, int tid, sllfNode_t *node, int freeUdata)
+{
+	struct sllfThread_s *t = &l->threads[tid];
+	if (t->retiredCnt >= t->retiredCap) {
+		int cap = t->retiredCap * 2 + SLLF_RECLAIM_THRESHOLD;
+		struct sllfRetired_s *arr = realloc(t->retired, sizeof(*arr) * cap);
+		if (arr == NULL)
+			return;	/* leak rather than free a node someone may hold */
+		t->retired = arr;
+		t->retiredCap = cap;
+	}
+	t->retired[t->retiredCnt].node = node;
+	t->retired[t->retiredCnt].epoch = __atomic_load_n(&l->epoch, __ATOMIC_SEQ_CST);
+	t->retired[t->retiredCnt].freeUdata = freeUdata;
+	t->retiredCnt++;
+}
+
+/**
+ * fill preds and succs around (score, udata) at every level,
+ * unlinking marked nodes on the way;
+ * return 1 if an unmarked node with this key is in level 0
+ */
+static int sllfFind(sllf_t *l, double score, void *udata,
+		    sllfNode_t **preds, sllfNode_t **succs)
+{
+	int i;
+	sllfNode_t *pred;
+	sllfNode_t *curr;
+	sllfNode_t *succ;
+
+retry:
+	pred = l->head;
+	curr = NULL;
+	for (i = SLLF_MAXLEVEL - 1; i >= 0; i--) {
+		curr = SLLF_UNMARK(SLLF_LOAD(pred->next[i]));
+		while (curr != NULL) {
+			succ = SLLF_LOAD(curr->next[i]);
+			while (SLLF_IS_MARKED(succ)) {
+				sllfNode_t *expected = curr;
+				if (!SLLF_CAS(pred->next[i], expected, SLLF_UNMARK(succ)))
+					goto retry;
+				curr = SLLF_UNMARK(succ);
+				if (curr == NULL)
+					break;
+				succ = SLLF_LOAD(curr->next[i]);
+			}
+			if (curr == NULL || sllfComp(curr, score, udata) >= 0)
+				break;
+			pred = curr;
+			curr = SLLF_UNMARK(succ);
+		}
+		preds[i] = pred;
+		succs[i] = curr;
+	}
+	return curr != NULL && sllfComp(curr, score, udata) == 0;
+}
+
+/**
+ * read-only search, first unmarked node >= (score, udata) in level 0
+ */
+static sllfNode_t *sllfSearch(sllf_t *l, double score, void *udata)
+{
+	int i;
+	sllfNode_t *pred = l->head;
+	sllfNode_t *curr = NULL;
+	sllfNode_t *succ;
+	for (i = SLLF_MAXLEVEL - 1; i >= 0; i--) {
+		curr = SLLF_UNMARK(SLLF_LOAD(pred->next[i]));
+		while (curr != NULL) {
+			succ = SLLF_LOAD(curr->next[i]);
+			while (SLLF_IS_MARKED(succ)) {
+				curr = SLLF_UNMARK(succ);
+				if (curr == NULL)
+					break;
+				succ = SLLF_LOAD(curr->next[i]);
+			}
+			if (curr == NULL || sllfComp(curr, score, udata) >= 0)
+				break;
+			pred = curr;
+			curr = SLLF_UNMARK(succ);
+		}
+	}
+	return curr;
+}
+
+int sllfInsert(sllf_t *l, int tid, void *udata, double score)
+{
+	int i;
+	int level;
+	int state = SLLF_INSERTING;
+	sllfNode_t *preds[SLLF_MAXLEVEL];
+	sllfNode_t *succs[SLLF_MAXLEVEL];
+	sllfNode_t *node;
+
+	level = sllfRandomLevel(&l->threads[tid]);
+	if ((node = sllfCreateNode(level, udata, score)) == NULL)
+		return -1;
+
+	sllfEnter(l, tid);
+	for (;;) {
+		sllfNode_t *expected;
+		if (sllfFind(l, score, udata, preds, succs)) {
+			sllfExit(l, tid);
+			free(node);
+			return 1;
+		}
+		for (i = 0; i < level; i++)
+			node->next[i] = succs[i];
+		expected = succs[0];
+		if (SLLF_CAS(preds[0]->next[0], expected, node))
+			break;
+	}
+	__atomic_add_fetch(&l->size, 1, __ATOMIC_RELAXED);
+
+	for (i = 1; i < level; i++) {
+		for (;;) {
+			sllfNode_t *expected;
+			sllfNode_t *succ = SLLF_LOAD(node->next[i]);
+			if (SLLF_IS_MARKED(succ))
+				goto linked;
+			if (succ != succs[i] && !SLLF_CAS(node->next[i], succ, succs[i]))
+				goto linked;	/* marked meanwhile */
+			expected = succs[i];
+			if (SLLF_CAS(preds[i]->next[i], expected, node))
+				break;
+			sllfFind(l, score, udata, preds, succs);
+			if (succs[0] != node)
+				goto linked;	/* deleted already */
+		}
+	}
+linked:
+	if (!__atomic_compare_exchange_n(&node->state, &state, SLLF_LINKED, 0,
+					 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		/* a deleter got node while we were linking it, its find may
+		 * have run before our last link, so unlink and retire here */
+		sllfFind(l, score, udata, preds, succs);
+		sllfRetire(l, tid, node, state == SLLF_DELETED_EARLY);
+	}
+	sllfExit(l, tid);
+	return 0;
+}
+
+/**
+ * mark victim at every level, then unlink it;
+ * return -1 if another thread deleted it first
+ */
+static int sllfRemove(sllf_t *l, int tid, sllfNode_t *victim, int freeUdata,
+		      sllfNode_t **preds, sllfNode_t **succs)
+{
+	int i;
+	int state = SLLF_INSERTING;
+	sllfNode_t *succ;
+
+	for (i = victim->levelSize - 1; i >= 1; i--) {
+		succ = SLLF_LOAD(victim->next[i]);
+		while (!SLLF_IS_MARKED(succ)) {
+			if (SLLF_CAS(victim->next[i], succ, SLLF_MARK(succ)))
+				break;
+		}
+	}
+	succ = SLLF_LOAD(victim->next[0]);
+	for (;;) {
+		if (SLLF_IS_MARKED(succ))
+			return -1;
+		if (SLLF_CAS(victim->next[0], succ, SLLF_MARK(succ)))
+			break;
+	}
+	__atomic_sub_fetch(&l->size, 1, __ATOMIC_RELAXED);
+	sllfFind(l, victim->score, victim->udata, preds, succs);
+	/* if sllfInsert is still linking victim, it retires victim */
+	if (!__atomic_compare_exchange_n(&victim->state, &state,
+					 freeUdata ? SLLF_DELETED_EARLY : SLLF_POPPED_EARLY, 0,
+					 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		/* sllfInsert is done, but its last link may have come after
+		 * our find, so unlink again before retiring */
+		sllfFind(l, victim->score, victim->udata, preds, succs);
+		sllfRetire(l, tid, victim, freeUdata);
+	}
+	return 0;
+}
+
+int sllfDelete(sllf_t *l, int tid, void *udata, double score)
+{
+	int ret = -1;
+	sllfNode_t *preds[SLLF_MAXLEVEL];
+	sllfNode_t *succs[SLLF_MAXLEVEL];
+
+	sllfEnter(l, tid);
+	if (sllfFind(l, score, udata, preds, succs))
+		ret = sllfRemove(l, tid, succs[0], 1, preds, succs);
+	sllfExit(l, tid);
+	return ret;
+}
+
+int sllfContains(sllf_t *l, int tid, void *udata, double score)
+{
+	sllfNode_t *node;
+	int found;
+	sllfEnter(l, tid);
+	node = sllfSearch(l, score, udata);
+	found = node != NULL && sllfComp(node, score, udata) == 0;
+	sllfExit(l, tid);
+	return found;
+}
+
+int sllfFirstGE(sllf_t *l, int tid, double score, void **pUdata, double *pScore)
+{
+	sllfNode_t *node;
+	sllfEnter(l, tid);
+	/* NULL udata sorts before every entry of the same score */
+	node = sllfSearch(l, score, NULL);
+	if (node != NULL) {
+		if (pUdata != NULL)
+			*pUdata = node->udata;
+		if (pScore != NULL)
+			*pScore = node->score;
+	}
+	sllfExit(l, tid);
+	return node == NULL ? -1 : 0;
+}
+
+int sllfPopFirst(sllf_t *l, int tid, void **pUdata, double *pScore)
+{
+	sllfNode_t *preds[SLLF_MAXLEVEL];
+	sllfNode_t *succs[SLLF_MAXLEVEL];
+	sllfNode_t *node;
+
+	sllfEnter(l, tid);
+	for (;;) {
+		void *udata;
+		double score;
+		node = SLLF_UNMARK(SLLF_LOAD(l->head->next[0]));
+		while (node != NULL && SLLF_IS_MARKED(SLLF_LOAD(node->next[0])))
+			node = SLLF_UNMARK(SLLF_LOAD(node->next[0]));
+		if (node == NULL)
+			break;
+		udata = node->udata;
+		score = node->score;
+		if (sllfRemove(l, tid, node, 0, preds, succs) == 0) {
+			if (pUdata != NULL)
+				*pUdata = udata;
+			if (pScore != NULL)
+				*pScore = score;
+			break;
+		}
+	}
+	sllfExit(l, tid);
+	return node == NULL ? -1 : 0;
+}
+
+int sllfForRange(sllf_t *l, int tid, double min, double max, sllfVisitCb cb, void *ctx)
+{
+	int n = 0;
+	sllfNode_t *node;
+	sllfEnter(l, tid);
+	for (node = sllfSearch(l, min, NULL);
+	     node != NULL && node->score <= max;
+	     node = SLLF_UNMARK(SLLF_LOAD(node->next[0]))) {
+		if (SLLF_IS_MARKED(SLLF_LOAD(node->next[0])))
+			continue;
+		n++;
+		if (cb(node->udata, node->score, ctx) != 0)
+			break;
+	}
+	sllfExit(l, tid);
+	return n;
+}
+
+unsigned long sllfGetSize(sllf_t *l)
+{
+	return __atomic_load_n(&l->size, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,133 @@
+#ifndef  _SLLOCKFREE_H_P4HN8C2T_
+#define  _SLLOCKFREE_H_P4HN8C2T_
+
+#include "skiplist.h"
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * lock-free ordered set without rank (Fraser/Harris style)
+ *
+ * for timer queues, job sets and other users that never ask for rank,
+ * there is no span to maintain, so any number of threads may insert,
+ * delete and search at the same time.
+ *
+ * entries are ordered by (score, udata) like internalComp,
+ * and are unique on (score, udata).
+ *
+ * the low bit of next marks a node deleted at that level,
+ * unlinked nodes are freed through epochs, so every thread
+ * registers once and passes its id to each call:
+ *
+ *	int tid = sllfThreadRegister(l);
+ *	sllfInsert(l, tid, udata, score);
+ *	sllfThreadUnregister(l, tid);
+ */
+
+#define SLLF_MAXLEVEL 24
+#define SLLF_MAX_THREADS 64
+#define SLLF_RECLAIM_THRESHOLD 128
+
+typedef struct sllfNode_s sllfNode_t;
+typedef struct sllf_s sllf_t;
+
+struct sllfNode_s {
+	double score;
+	void *udata;
+	int levelSize;
+	int state;		/* see sllfInsert */
+	sllfNode_t *next[1];
+};
+
+struct sllfRetired_s {
+	sllfNode_t *node;
+	unsigned long epoch;	/* l->epoch when node was unlinked */
+	int freeUdata;		/* 0 if udata handed over by sllfPopFirst */
+};
+
+struct sllfThread_s {
+	unsigned long epoch;	/* 0 if outside of an op */
+	int used;
+	unsigned int rng;
+	struct sllfRetired_s *retired;
+	int retiredCnt;
+	int retiredCap;
+	char pad[64];
+};
+
+struct sllf_s {
+	sllfNode_t *head;
+	unsigned long epoch;
+	unsigned long size;
+	slFreeCb freeCb;	/* called on udata of deleted entries */
+	void *freeCtx;
+	struct sllfThread_s threads[SLLF_MAX_THREADS];
+};
+
+/**
+ * alloc and init, freeCb would be called on udata of reclaimed entries
+ */
+sllf_t *sllfCreate(slFreeCb freeCb, void *freeCtx);
+
+/**
+ * free every entry and l, no thread may be inside of an op
+ */
+void sllfFree(sllf_t *l);
+
+/**
+ * return thread id, -1 if SLLF_MAX_THREADS threads registered
+ */
+int sllfThreadRegister(sllf_t *l);
+
+/**
+ * nodes retired by tid are kept until a thread registers as tid again
+ * and reclaims them, or sllfFree
+ */
+void sllfThreadUnregister(sllf_t *l, int tid);
+
+/**
+ * return 0 if inserted, 1 if (score, udata) exists, -1 if no memory
+ */
+int sllfInsert(sllf_t *l, int tid, void *udata, double score);
+
+/**
+ * return 0 if deleted, -1 if not found
+ */
+int sllfDelete(sllf_t *l, int tid, void *udata, double score);
+
+int sllfContains(sllf_t *l, int tid, void *udata, double score);
+
+/**
+ * first entry with score >= score,
+ * return 0 and fill *pUdata, *pScore if found
+ */
+int sllfFirstGE(sllf_t *l, int tid, double score, void **pUdata, double *pScore);
+
+/**
+ * delete the first entry, for timer queues,
+ * return 0 and fill *pUdata, *pScore if any;
+ * the entry's udata is handed over, freeCb is not called on it
+ */
+int sllfPopFirst(sllf_t *l, int tid, void **pUdata, double *pScore);
+
+typedef int (*sllfVisitCb)(void *udata, double score, void *ctx);
+
+/**
+ * visit entries with min <= score <= max in order, stop if cb returns non-zero;
+ * entries inserted or deleted concurrently may or may not be visited
+ * return count visited
+ */
+int sllfForRange(sllf_t *l, int tid, double min, double max, sllfVisitCb cb, void *ctx);
+
+/**
+ * approximate while ops are running
+ */
+unsigned long sllfGetSize(sllf_t *l);
+
+#if defined (__cplusplus)
+}	/*end of extern "C"*/
+#endif
+
+#endif /* end of include guard:  _SLLOCKFREE_H_P4HN8C2T_ */
@@ -0,0 +1,169 @@
+#include <stdlib.h>
+#include "slmulti.h"
+
+/* towers start on a double boundary, like a node from malloc */
+#define SLMI_ALIGN(x) (((x) + sizeof(double) - 1) / sizeof(double) * sizeof(double))
+
+int slmiInit(slmi_t *m, int n)
+{
+	int i;
+	if (n < 1 || n > SLMI_MAXINDEX)
+		return -1;
+	m->n = n;
+	for (i = 0; i < n; i++) {
+		slInit(SLMI_INDEX(m, i));
+		SLMI_INDEX(m, i)->udata = NULL;
+		/* towers live inside of entries, slCompact must not move them */
+		SLMI_INDEX(m, i)->borrowed = 1;
+	}
+	return 0;
+}
+
+void slmiDestroy(slmi_t *m, slFreeCb freeCb, void *ctx)
+{
+	slNode_t *node;
+	slNode_t *next;
+	for (node = SL_FIRST(SLMI_INDEX(m, 0)); node != NULL; node = next) {
+		next = SL_NEXT(node);
+		slmiFreeEntry(SLMI_ENTRY(node), freeCb, ctx);
+	}
+}
+
+slmiEntry_t *slmiCreateEntry(slmi_t *m, void *udata, const double *scores)
+{
+	int level[SLMI_MAXINDEX];
+	size_t sz = SLMI_ALIGN(sizeof(slmiEntry_t));
+	size_t off[SLMI_MAXINDEX];
+	slmiEntry_t *e;
+	int i;
+	int j;
+	for (i = 0; i < m->n; i++) {
+		level[i] = slRandomLevel();
+		off[i] = sz;
+		sz += SLMI_ALIGN(sizeof(slNode_t) + sizeof(struct levelNode_s) * (level[i] - 1));
+	}
+	if ((e = malloc(sz)) == NULL)
+		return NULL;
+	e->udata = udata;
+	e->n = m->n;
+	for (i = 0; i < m->n; i++) {
+		slNode_t *node;
+		e->off[i] = (int)off[i];
+		node = SLMI_NODE(e, i);
+		node->score = scores[i];
+		node->udata = e;
+		node->prev = NULL;
+		node->levelSize = level[i];
+		node->levelCap = level[i];
+		for (j = 0; j < level[i]; j++) {
+			node->level[j].next = NULL;
+			node->level[j].span = 0;
+		}
+	}
+	return e;
+}
+
+void slmiFreeEntry(slmiEntry_t *e, slFreeCb freeCb, void *ctx)
+{
+	if (freeCb != NULL)
+		freeCb(e->udata, ctx);
+	free(e);
+}
+
+void slmiInsert(slmi_t *m, slmiEntry_t *e, void *ctx)
+{
+	int i;
+	for (i = 0; i < m->n; i++)
+		slInsertNode(SLMI_INDEX(m, i), SLMI_NODE(e, i), ctx);
+}
+
+int slmiDelete(slmi_t *m, slmiEntry_t *e, void *ctx, slmiEntry_t **pEntry)
+{
+	slNode_t *p;
+	int i;
+	for (i = 0; i < m->n; i++) {
+		if (slDeleteNode(SLMI_INDEX(m, i), SLMI_NODE(e, i), ctx, &p) != 0) {
+			/* not in index i, link the towers taken out back */
+			while (--i >= 0)
+				slInsertNode(SLMI_INDEX(m, i), SLMI_NODE(e, i), ctx);
+			return -1;
+		}
+	}
+	if (pEntry != NULL)
+		*pEntry = e;
+	else
+		slmiFreeEntry(e, NULL, NULL);
+	return 0;
+}
+
+int slmiUpdateIndex(slmi_t *m, slmiEntry_t *e, int i, double score, void *ctx)
+{
+	slNode_t *node = SLMI_NODE(e, i);
+	slNode_t *p;
+	if (slDeleteNode(SLMI_INDEX(m, i), node, ctx, &p) != 0)
+		return -1;
+	node->score = score;
+	slInsertNode(SLMI_INDEX(m, i), node, ctx);
+	return 0;
+}
+
+int slmiUpdate(slmi_t *m, slmiEntry_t *e, const double *scores, void *ctx)
+{
+	double old[SLMI_MAXINDEX];
+	int movedIdx[SLMI_MAXINDEX];
+	int moved = 0;
+	int i;
+	for (i = 0; i < m->n; i++) {
+		if (SLMI_SCORE(e, i) == scores[i])
+			continue;
+		old[i] = SLMI_SCORE(e, i);
+		if (slmiUpdateIndex(m, e, i, scores[i], ctx) != 0) {
+			/* not in index i, move the indices done so far back */
+			while (moved > 0) {
+				i = movedIdx[--moved];
+				slmiUpdateIndex(m, e, i, old[i], ctx);
+			}
+			return -1;
+		}
+		movedIdx[moved++] = i;
+	}
+	return moved;
+}
+
+int slmiExpire(slmi_t *m, int i, double now, int budget,
+	       slFreeCb freeCb, void *ctx)
+{
+	slNode_t *due[SLMI_EXPIRE_BATCH];
+	slNode_t *nodes[SLMI_EXPIRE_BATCH];
+	slNode_t *p;
+	int removed = 0;
+	int n;
+	int j;
+	int k;
+	while (removed < budget) {
+		n = budget - removed < SLMI_EXPIRE_BATCH ? budget - removed : SLMI_EXPIRE_BATCH;
+		if ((n = slExpire(SLMI_INDEX(m, i), now, n, due)) == 0)
+			break;
+		for (j = 0; j < m->n; j++) {
+			if (j == i)
+				continue;
+			for (k = 0; k < n; k++)
+				nodes[k] = SLMI_NODE(SLMI_ENTRY(due[k]), j);
+			if (slSortNodes(SLMI_INDEX(m, j), nodes, n, ctx) == 0) {
+				slDeleteNodes(SLMI_INDEX(m, j), nodes, n, ctx);
+			} else {
+				for (k = 0; k < n; k++)
+					slDeleteNode(SLMI_INDEX(m, j), nodes[k], ctx, &p);
+			}
+		}
+		for (k = 0; k < n; k++)
+			slmiFreeEntry(SLMI_ENTRY(due[k]), freeCb, ctx);
+		removed += n;
+	}
+	return removed;
+}
+
+int slmiGetRank(slmi_t *m, slmiEntry_t *e, int i, void *ctx)
+{
+	return slGetRank(SLMI_INDEX(m, i), SLMI_NODE(e, i), ctx);
+}
@@ -0,0 +1,112 @@
+#ifndef  _SLMULTI_H_K2VD7N4Q_
+#define  _SLMULTI_H_K2VD7N4Q_
+
+#include "skiplist.h"
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * multi-index entries: one member ordered by several keys
+ *
+ * an entry carries one tower per index in a single allocation, every
+ * tower is a slNode_t of its index with udata pointing back at the
+ * entry, so any read API of an index works on SLMI_INDEX(m, i) and
+ * SLMI_ENTRY(node) gets the entry of a node found there.
+ * slmiInsert, slmiDelete and slmiUpdate keep every index in step.
+ *
+ * the default comp orders a tower by (score, entry address); a comp set
+ * on an index gets towers, their udata is the entry.
+ * indices are plain lists: no sum lists, capped or deterministic modes.
+ * an index does not own its towers, they are freed with their entry:
+ * range deletes (slDeleteByRankRange, slExpire), capacity eviction
+ * (slSetCapacity, slInsertCapped) and slCompact must not be used on an
+ * index, slmiInit marks them borrowed and slCompact returns -1 for them;
+ * use slmiDelete and slmiExpire instead.
+ */
+
+#define SLMI_MAXINDEX 8
+
+typedef struct slmiEntry_s {
+	void *udata;
+	int n;
+	int off[SLMI_MAXINDEX];	/* byte offset of tower i from the entry */
+} slmiEntry_t;
+
+typedef struct slMulti_s {
+	int n;
+	sl_t index[SLMI_MAXINDEX];
+} slmi_t;
+
+#define SLMI_INDEX(m, i) (&(m)->index[i])
+#define SLMI_NODE(e, i) ((slNode_t *)((char *)(e) + (e)->off[i]))
+#define SLMI_ENTRY(node) ((slmiEntry_t *)(node)->udata)
+#define SLMI_SCORE(e, i) (SLMI_NODE(e, i)->score)
+
+/**
+ * return 0 if succeed, -1 if n is not in [1, SLMI_MAXINDEX]
+ */
+int slmiInit(slmi_t *m, int n);
+
+/**
+ * free every entry, freeCb is called on its udata; do not free m
+ */
+void slmiDestroy(slmi_t *m, slFreeCb freeCb, void *ctx);
+
+/**
+ * one allocation with a tower for every index of m,
+ * scores[i] is the key in index i
+ * return NULL if no memory
+ */
+slmiEntry_t *slmiCreateEntry(slmi_t *m, void *udata, const double *scores);
+void slmiFreeEntry(slmiEntry_t *e, slFreeCb freeCb, void *ctx);
+
+/**
+ * link e into every index
+ * ctx would be passed to the comp function of every index
+ */
+void slmiInsert(slmi_t *m, slmiEntry_t *e, void *ctx);
+
+/**
+ * unlink e from every index,
+ * return 0 if succeed, -1 if e is not in m, no index is changed then;
+ * e is freed by slmiFreeEntry(e, NULL, NULL) if pEntry == NULL,
+ * else written to pEntry
+ */
+int slmiDelete(slmi_t *m, slmiEntry_t *e, void *ctx, slmiEntry_t **pEntry);
+
+/**
+ * move e to scores[i] in every index i whose key changed
+ * return count of indices moved, -1 if e is not in m, no index is
+ * changed then
+ */
+int slmiUpdate(slmi_t *m, slmiEntry_t *e, const double *scores, void *ctx);
+
+/**
+ * move e to score in index i only
+ * return 0 if succeed, -1 if e is not in m
+ */
+int slmiUpdateIndex(slmi_t *m, slmiEntry_t *e, int i, double score, void *ctx);
+
+/**
+ * expiry: with deadlines as the key of index i, delete the entries due
+ * at now from every index, at most budget of them, freeCb is called on
+ * their udata; batches of SLMI_EXPIRE_BATCH are cut off index i by
+ * slExpire and swept out of the other indices by slDeleteNodes
+ * return count deleted
+ */
+#define SLMI_EXPIRE_BATCH 64
+int slmiExpire(slmi_t *m, int i, double now, int budget,
+	       slFreeCb freeCb, void *ctx);
+
+/**
+ * rank of e in index i, 0 if not found
+ */
+int slmiGetRank(slmi_t *m, slmiEntry_t *e, int i, void *ctx);
+
+#if defined (__cplusplus)
+}	/*end of extern "C"*/
+#endif
+
+#endif /* end of include guard:  _SLMULTI_H_K2VD7N4Q_ */
@@ -0,0 +1,107 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "slparallel.h"
+
+struct slpChunk_s {
+	pthread_t th;
+	int started;
+	slNode_t *first;
+	int rankMin;
+	int count;
+	int visited;
+	void *partial;
+	slRangeCb fn;
+	void *ctx;
+};
+
+static void *slpWalk(void *arg)
+{
+	struct slpChunk_s *c = arg;
+	slNode_t *node = c->first;
+	int i;
+	for (i = 0; i < c->count && node != NULL; i++, node = SL_NEXT(node)) {
+		if (c->fn(node, c->rankMin + i, c->partial, c->ctx) != 0) {
+			i++;
+			break;
+		}
+	}
+	c->visited = i;
+	return NULL;
+}
+
+int slParallelReduceRange(sl_t *sl, int rankMin, int rankMax, int nthreads,
+			  slRangeCb fn, size_t partialSize, slReduceCb reduce, void *ctx)
+{
+	struct slpChunk_s *chunks;
+	char *partials = NULL;
+	char *base = NULL;	/* partials from a cache line boundary on */
+	/* whole cache lines per partial, also aligned like malloc would */
+	size_t stride = (partialSize + SLP_CACHE_LINE - 1) / SLP_CACHE_LINE * SLP_CACHE_LINE;
+	int total;
+	int visited = 0;
+	int i;
+
+	if (rankMin < 1)
+		rankMin = 1;
+	if (rankMax > (int)sl->size)
+		rankMax = sl->size;
+	if (rankMin > rankMax)
+		return 0;
+	total = rankMax - rankMin + 1;
+	if (nthreads < 1)
+		nthreads = 1;
+	if (nthreads > SLP_MAX_THREADS)
+		nthreads = SLP_MAX_THREADS;
+	if (nthreads > total)
+		nthreads = total;
+
+	if ((chunks = malloc(sizeof(*chunks) * nthreads)) == NULL)
+		return -1;
+	if (partialSize > 0) {
+		/* one line more, malloc aligns to less than a line */
+		if ((partials = calloc(nthreads + 1, stride)) == NULL) {
+			free(chunks);
+			return -1;
+		}
+		base = partials + (SLP_CACHE_LINE - (size_t)partials % SLP_CACHE_LINE) % SLP_CACHE_LINE;
+	}
+	/* the descents touch sl counters, keep them on this thread */
+	for (i = 0; i < nthreads; i++) {
+		struct slpChunk_s *c = &chunks[i];
+		int lo = (int)((double)total * i / nthreads);
+		int hi = (int)((double)total * (i + 1) / nthreads);
+		c->rankMin = rankMin + lo;
+		c->count = hi - lo;
+		c->first = slGetNodeByRank(sl, c->rankMin);
+		c->partial = base == NULL ? NULL : base + stride * i;
+		c->fn = fn;
+		c->ctx = ctx;
+	}
+	for (i = 1; i < nthreads; i++)
+		chunks[i].started = pthread_create(&chunks[i].th, NULL, slpWalk, &chunks[i]) == 0;
+	slpWalk(&chunks[0]);
+	for (i = 1; i < nthreads; i++) {
+		/* no thread, walk its chunk here */
+		if (chunks[i].started)
+			pthread_join(chunks[i].th, NULL);
+		else
+			slpWalk(&chunks[i]);
+	}
+
+	for (i = 0; i < nthreads; i++) {
+		visited += chunks[i].visited;
+		if (reduce != NULL)
+			reduce(chunks[i].partial, i, ctx);
+	}
+	free(partials);
+	free(chunks);
+	return visited;
+}
+
+int slParallelForRange(sl_t *sl, int rankMin, int rankMax, int nthreads,
+		       slRangeCb fn, void *ctx)
+{
+	return slParallelReduceRange(sl, rankMin, rankMax, nthreads, fn, 0, NULL, ctx);
+}
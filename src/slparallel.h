@@ -0,0 +1,55 @@
+#ifndef  _SLPARALLEL_H_W5JC1R8D_
+#define  _SLPARALLEL_H_W5JC1R8D_
+
+#include "skiplist.h"
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * rank-partitioned scans on several threads
+ *
+ * [rankMin, rankMax] is cut into nthreads chunks of equal size, the first
+ * node of every chunk is found by slGetNodeByRank on the calling thread,
+ * then each chunk is walked on level 0 by its own thread.
+ *
+ * only safe while no one mutates sl.
+ */
+
+#define SLP_MAX_THREADS 64
+/* partials are this far apart, so chunks do not write to one cache line */
+#define SLP_CACHE_LINE 64
+
+/**
+ * called on every node of a chunk, rank is the rank of node,
+ * partial is the chunk's accumulator, NULL if partialSize == 0;
+ * return non-zero to stop walking this chunk
+ */
+typedef int (*slRangeCb)(slNode_t *node, int rank, void *partial, void *ctx);
+
+/**
+ * called on the calling thread after every chunk is walked,
+ * once per chunk in rank order
+ */
+typedef void (*slReduceCb)(void *partial, int chunk, void *ctx);
+
+/**
+ * rankMin, rankMax are clamped to [1, size]
+ * return count of nodes visited, -1 if no memory
+ */
+int slParallelForRange(sl_t *sl, int rankMin, int rankMax, int nthreads,
+		       slRangeCb fn, void *ctx);
+
+/**
+ * like slParallelForRange, every chunk gets partialSize zeroed bytes as its
+ * accumulator, reduce folds them in rank order
+ */
+int slParallelReduceRange(sl_t *sl, int rankMin, int rankMax, int nthreads,
+			  slRangeCb fn, size_t partialSize, slReduceCb reduce, void *ctx);
+
+#if defined (__cplusplus)
+}	/*end of extern "C"*/
+#endif
+
+#endif /* end of include guard:  _SLPARALLEL_H_W5JC1R8D_ */
@@ -0,0 +1,440 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <string.h>
+#include "slshard.h"
+
+static size_t slsHash(void *udata)
+{
+	size_t h = (size_t)udata;
+	h ^= h >> 16;
+	h *= 0x45d9f3bu;
+	h ^= h >> 16;
+	h *= 0x45d9f3bu;
+	h ^= h >> 16;
+	return h;
+}
+
+/**
+ * independent of slsHash: map slots take its low bits, a shard chosen
+ * from the same hash would fix some of them and use 1/nshards of a map
+ */
+static size_t slsShardHash(void *udata)
+{
+	size_t h = (size_t)udata;
+	h ^= h >> 15;
+	h *= 0x2c1b3c6du;
+	h ^= h >> 12;
+	h *= 0x297a2d39u;
+	h ^= h >> 15;
+	return h;
+}
+
+int slsShardOf(sls_t *s, void *udata)
+{
+	return (int)(slsShardHash(udata) % (size_t)s->nshards);
+}
+
+static int slsRandomLevel(struct slsShard_s *sh)
+{
+	int level = 1;
+	unsigned int x = sh->rng;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	sh->rng = x;
+	/* SKIPLIST_P == 0.25 */
+	while ((x & 3) == 0 && level < SKIPLIST_MAXLEVEL) {
+		level++;
+		x >>= 2;
+	}
+	return level;
+}
+
+static struct slsMapEntry_s *slsMapFind(struct slsShard_s *sh, void *udata)
+{
+	size_t mask = sh->mapCap - 1;
+	size_t i = slsHash(udata) & mask;
+	while (sh->map[i].udata != NULL) {
+		if (sh->map[i].udata == udata)
+			return &sh->map[i];
+		i = (i + 1) & mask;
+	}
+	return NULL;
+}
+
+static int slsMapSet(struct slsShard_s *sh, void *udata, slNode_t *node)
+{
+	size_t mask;
+	size_t i;
+	if ((sh->mapCnt + 1) * 2 > sh->mapCap) {
+		int j;
+		int cap = sh->mapCap * 2;
+		struct slsMapEntry_s *old = sh->map;
+		struct slsMapEntry_s *map = calloc(cap, sizeof(*map));
+		if (map == NULL)
+			return -1;
+		sh->map = map;
+		sh->mapCap = cap;
+		sh->mapCnt = 0;
+		for (j = 0; j < cap / 2; j++) {
+			if (old[j].udata != NULL)
+				slsMapSet(sh, old[j].udata, old[j].node);
+		}
+		free(old);
+	}
+	mask = sh->mapCap - 1;
+	i = slsHash(udata) & mask;
+	while (sh->map[i].udata != NULL && sh->map[i].udata != udata)
+		i = (i + 1) & mask;
+	if (sh->map[i].udata == NULL)
+		sh->mapCnt++;
+	sh->map[i].udata = udata;
+	sh->map[i].node = node;
+	return 0;
+}
+
+static void slsMapDel(struct slsShard_s *sh, struct slsMapEntry_s *e)
+{
+	size_t mask = sh->mapCap - 1;
+	size_t i = e - sh->map;
+	size_t j = i;
+	/* backward shift, no tombstones */
+	for (;;) {
+		size_t home;
+		j = (j + 1) & mask;
+		if (sh->map[j].udata == NULL)
+			break;
+		home = slsHash(sh->map[j].udata) & mask;
+		if ((j > i && (home <= i || home > j)) || (j < i && (home <= i && home > j))) {
+			sh->map[i] = sh->map[j];
+			i = j;
+		}
+	}
+	sh->map[i].udata = NULL;
+	sh->map[i].node = NULL;
+	sh->mapCnt--;
+}
+
+static void slsApply(struct slsShard_s *sh, struct slsOp_s *op)
+{
+	struct slsMapEntry_s *e = slsMapFind(sh, op->udata);
+	slNode_t *node;
+	if (op->type == SLS_OP_DELETE) {
+		if (e == NULL || slcDeleteNode(&sh->slc, e->node, NULL) != 0)
+			return;
+		slsMapDel(sh, e);
+		if (sh->freeCb != NULL)
+			sh->freeCb(op->udata, sh->freeCtx);
+		return;
+	}
+	if (e != NULL) {
+		if (e->node->score == op->score)
+			return;
+		if ((node = slcUpdate(&sh->slc, e->node, op->score, NULL)) != NULL)
+			e->node = node;
+		return;
+	}
+	if ((node = slCreateNode(slsRandomLevel(sh), op->udata, op->score)) == NULL)
+		return;
+	if (slsMapSet(sh, op->udata, node) != 0) {
+		slFreeNode(node, NULL, NULL);
+		return;
+	}
+	slcInsertNode(&sh->slc, node, NULL);
+}
+
+static void *slsWorker(void *arg)
+{
+	struct slsShard_s *sh = arg;
+	struct slsOp_s *batch = NULL;
+	int batchCap = 0;
+	for (;;) {
+		int i;
+		int n;
+		struct slsOp_s *tmp;
+		pthread_mutex_lock(&sh->lock);
+		while (sh->queueCnt == 0 && !sh->stop)
+			pthread_cond_wait(&sh->cond, &sh->lock);
+		if (sh->queueCnt == 0) {
+			pthread_mutex_unlock(&sh->lock);
+			break;
+		}
+		/* take the whole queue, producers go on with the spare buffer */
+		tmp = sh->queue;
+		sh->queue = batch;
+		batch = tmp;
+		n = sh->queueCnt;
+		i = sh->queueCap;
+		sh->queueCap = batchCap;
+		batchCap = i;
+		sh->queueCnt = 0;
+		pthread_mutex_unlock(&sh->lock);
+
+		for (i = 0; i < n; i++)
+			slsApply(sh, &batch[i]);
+
+		pthread_mutex_lock(&sh->lock);
+		sh->pending -= n;
+		if (sh->pending == 0)
+			pthread_cond_broadcast(&sh->cond);
+		pthread_mutex_unlock(&sh->lock);
+	}
+	free(batch);
+	return NULL;
+}
+
+sls_t *slsCreate(int nshards, slFreeCb freeCb, void *freeCtx)
+{
+	int i;
+	sls_t *s;
+	if (nshards < 1 || nshards > SLS_MAX_SHARDS)
+		return NULL;
+	if ((s = malloc(sizeof(*s))) == NULL)
+		return NULL;
+	s->nshards = nshards;
+	s->freeCb = freeCb;
+	s->freeCtx = freeCtx;
+	if ((s->shards = calloc(nshards, sizeof(struct slsShard_s))) == NULL) {
+		free(s);
+		return NULL;
+	}
+	for (i = 0; i < nshards; i++) {
+		struct slsShard_s *sh = &s->shards[i];
+		/* retired nodes only free themselves, see slsApply */
+		slcInit(&sh->slc, NULL, NULL);
+		sh->freeCb = freeCb;
+		sh->freeCtx = freeCtx;
+		pthread_mutex_init(&sh->lock, NULL);
+		pthread_cond_init(&sh->cond, NULL);
+		sh->mapCap = 64;
+		sh->map = calloc(sh->mapCap, sizeof(struct slsMapEntry_s));
+		sh->rng = 2463534242u + i * 2654435761u;
+		if (sh->map == NULL || pthread_create(&sh->worker, NULL, slsWorker, sh) != 0) {
+			slcDestroy(&sh->slc);
+			pthread_mutex_destroy(&sh->lock);
+			pthread_cond_destroy(&sh->cond);
+			free(sh->map);
+			/* stop and free the shards started so far */
+			s->nshards = i;
+			slsFree(s);
+			return NULL;
+		}
+	}
+	return s;
+}
+
+void slsFree(sls_t *s)
+{
+	int i;
+	for (i = 0; i < s->nshards; i++) {
+		struct slsShard_s *sh = &s->shards[i];
+		pthread_mutex_lock(&sh->lock);
+		sh->stop = 1;
+		pthread_cond_broadcast(&sh->cond);
+		pthread_mutex_unlock(&sh->lock);
+	}
+	for (i = 0; i < s->nshards; i++) {
+		struct slsShard_s *sh = &s->shards[i];
+		pthread_join(sh->worker, NULL);
+		if (sh->freeCb != NULL) {
+			sl_t *sl = &sh->slc.sl;
+			slNode_t *node;
+			for (node = SL_FIRST(sl); node != NULL; node = SL_NEXT(node))
+				sh->freeCb(node->udata, sh->freeCtx);
+		}
+		slcDestroy(&sh->slc);
+		pthread_mutex_destroy(&sh->lock);
+		pthread_cond_destroy(&sh->cond);
+		free(sh->queue);
+		free(sh->map);
+	}
+	free(s->shards);
+	free(s);
+}
+
+static int slsEnqueue(sls_t *s, int type, void *udata, double score)
+{
+	struct slsShard_s *sh = &s->shards[slsShardOf(s, udata)];
+	struct slsOp_s *op;
+	pthread_mutex_lock(&sh->lock);
+	if (sh->queueCnt >= sh->queueCap) {
+		int cap = sh->queueCap * 2 + 64;
+		struct slsOp_s *queue = realloc(sh->queue, sizeof(*queue) * cap);
+		if (queue == NULL) {
+			pthread_mutex_unlock(&sh->lock);
+			return -1;
+		}
+		sh->queue = queue;
+		sh->queueCap = cap;
+	}
+	op = &sh->queue[sh->queueCnt++];
+	op->type = type;
+	op->udata = udata;
+	op->score = score;
+	sh->pending++;
+	/* the worker sleeps only on an empty queue, flushers share the cond */
+	if (sh->queueCnt == 1)
+		pthread_cond_broadcast(&sh->cond);
+	pthread_mutex_unlock(&sh->lock);
+	return 0;
+}
+
+int slsUpdate(sls_t *s, void *udata, double score)
+{
+	return slsEnqueue(s, SLS_OP_UPDATE, udata, score);
+}
+
+int slsDelete(sls_t *s, void *udata)
+{
+	return slsEnqueue(s, SLS_OP_DELETE, udata, 0.0);
+}
+
+void slsFlush(sls_t *s)
+{
+	int i;
+	for (i = 0; i < s->nshards; i++) {
+		struct slsShard_s *sh = &s->shards[i];
+		pthread_mutex_lock(&sh->lock);
+		while (sh->pending > 0)
+			pthread_cond_wait(&sh->cond, &sh->lock);
+		pthread_mutex_unlock(&sh->lock);
+	}
+}
+
+int slsReaderRegister(sls_t *s, slsReader_t *rd)
+{
+	int i;
+	for (i = 0; i < s->nshards; i++) {
+		if ((rd->rids[i] = slcReaderRegister(&s->shards[i].slc)) < 0) {
+			while (--i >= 0)
+				slcReaderUnregister(&s->shards[i].slc, rd->rids[i]);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void slsReaderUnregister(sls_t *s, slsReader_t *rd)
+{
+	int i;
+	for (i = 0; i < s->nshards; i++)
+		slcReaderUnregister(&s->shards[i].slc, rd->rids[i]);
+}
+
+int slsGetSize(sls_t *s)
+{
+	int i;
+	int size = 0;
+	for (i = 0; i < s->nshards; i++)
+		size += slcGetSize(&s->shards[i].slc);
+	return size;
+}
+
+int slsGetRank(sls_t *s, slsReader_t *rd, void *udata, double score)
+{
+	int i;
+	int less = 0;
+	slNode_t key;
+	key.score = score;
+	key.udata = udata;
+	for (i = 0; i < s->nshards; i++) {
+		slc_t *slc = &s->shards[i].slc;
+		slcReadLock(slc, rd->rids[i]);
+		less += slcCountLess(slc, &key, NULL);
+		slcReadUnlock(slc, rd->rids[i]);
+	}
+	return less + 1;
+}
+
+/* level-0 cursor of one shard, refilled SLS_MERGE_BATCH entries at a time */
+struct slsIter_s {
+	int next;	/* shard rank of the next batch */
+	int pos;
+	int cnt;
+	void *udata[SLS_MERGE_BATCH];
+	double score[SLS_MERGE_BATCH];
+};
+
+static int slsIterFill(sls_t *s, slsReader_t *rd, int shard, struct slsIter_s *it)
+{
+	slc_t *slc = &s->shards[shard].slc;
+	slcReadLock(slc, rd->rids[shard]);
+	it->cnt = slcGetRankRange(slc, it->next, it->next + SLS_MERGE_BATCH - 1,
+				  it->udata, it->score, SLS_MERGE_BATCH);
+	slcReadUnlock(slc, rd->rids[shard]);
+	it->next += it->cnt;
+	it->pos = 0;
+	return it->cnt;
+}
+
+/* internalComp order */
+static int slsIterLess(struct slsIter_s *a, struct slsIter_s *b)
+{
+	double sa = a->score[a->pos];
+	double sb = b->score[b->pos];
+	if (sa != sb)
+		return sa < sb;
+	return (size_t)a->udata[a->pos] < (size_t)b->udata[b->pos];
+}
+
+static void slsHeapDown(struct slsIter_s **heap, int n, int i)
+{
+	for (;;) {
+		int l = i * 2 + 1;
+		int r = l + 1;
+		int m = i;
+		struct slsIter_s *tmp;
+		if (l < n && slsIterLess(heap[l], heap[m]))
+			m = l;
+		if (r < n && slsIterLess(heap[r], heap[m]))
+			m = r;
+		if (m == i)
+			return;
+		tmp = heap[i];
+		heap[i] = heap[m];
+		heap[m] = tmp;
+		i = m;
+	}
+}
+
+int slsGetRankRange(sls_t *s, slsReader_t *rd,
+		    int rankMin, int rankMax,
+		    void **udataArr, double *scoreArr, int sz)
+{
+	int i;
+	int n = 0;
+	int heapCnt = 0;
+	int rank = 0;
+	struct slsIter_s *iters;
+	struct slsIter_s *heap[SLS_MAX_SHARDS];
+
+	if (sz <= 0 || rankMin < 1 || rankMin > rankMax)
+		return 0;
+	if ((iters = malloc(sizeof(*iters) * s->nshards)) == NULL)
+		return 0;
+	for (i = 0; i < s->nshards; i++) {
+		iters[i].next = 1;
+		if (slsIterFill(s, rd, i, &iters[i]) > 0)
+			heap[heapCnt++] = &iters[i];
+	}
+	for (i = heapCnt / 2 - 1; i >= 0; i--)
+		slsHeapDown(heap, heapCnt, i);
+
+	while (heapCnt > 0 && rank < rankMax && n < sz) {
+		struct slsIter_s *it = heap[0];
+		if (++rank >= rankMin) {
+			if (udataArr != NULL)
+				udataArr[n] = it->udata[it->pos];
+			if (scoreArr != NULL)
+				scoreArr[n] = it->score[it->pos];
+			n++;
+		}
+		if (++it->pos >= it->cnt &&
+		    (it->cnt < SLS_MERGE_BATCH || slsIterFill(s, rd, (int)(it - iters), it) == 0))
+			heap[0] = heap[--heapCnt];
+		slsHeapDown(heap, heapCnt, 0);
+	}
+	free(iters);
+	return n;
+}
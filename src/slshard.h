@@ -0,0 +1,136 @@
+#ifndef  _SLSHARD_H_Q9BX2E6L_
+#define  _SLSHARD_H_Q9BX2E6L_
+
+#include <pthread.h>
+#include "slconcurrent.h"
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * sharded leaderboard
+ *
+ * members (udata) are hash-partitioned over nshards slc_t, each written
+ * only by its own worker thread; slsUpdate/slsDelete queue the write to
+ * the owning worker and return.
+ *
+ * global queries run on the calling thread as slc_t readers:
+ * the rank of (score, udata) is the sum of per-shard counts of entries
+ * ordered before it, rank ranges are merged from per-shard iterators.
+ * shards are read one after another, so a global answer may mix
+ * versions of different shards while writes are in flight.
+ *
+ * entries are ordered like internalComp, by score then udata.
+ */
+
+#define SLS_MAX_SHARDS 64
+#define SLS_MERGE_BATCH 64
+
+enum slsOpType_e {
+	SLS_OP_UPDATE = 0,
+	SLS_OP_DELETE
+};
+
+struct slsOp_s {
+	int type;
+	void *udata;
+	double score;
+};
+
+struct slsMapEntry_s {
+	void *udata;		/* NULL if empty */
+	slNode_t *node;
+};
+
+struct slsShard_s {
+	slc_t slc;
+	pthread_t worker;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;	/* ops queued, or drained if pending == 0 */
+	struct slsOp_s *queue;
+	int queueCnt;
+	int queueCap;
+	int pending;		/* queued or being applied */
+	int stop;
+	/* udata -> node, touched by the worker only */
+	struct slsMapEntry_s *map;
+	int mapCnt;
+	int mapCap;
+	unsigned int rng;
+	/* called by the worker right after unlinking, not at reclaim,
+	 * so udata may be added again at once */
+	slFreeCb freeCb;
+	void *freeCtx;
+};
+
+typedef struct slSharded_s {
+	int nshards;
+	struct slsShard_s *shards;
+	slFreeCb freeCb;
+	void *freeCtx;
+} sls_t;
+
+/**
+ * reader handle of a query thread, one reader id per shard
+ */
+typedef struct slsReader_s {
+	int rids[SLS_MAX_SHARDS];
+} slsReader_t;
+
+/**
+ * create nshards shards and start their workers,
+ * freeCb would be called on udata of deleted members, by the worker
+ * as soon as it unlinks them (readers compare udata but never read
+ * through it), and on every member by slsFree
+ * return NULL if no memory or a worker cannot start
+ */
+sls_t *slsCreate(int nshards, slFreeCb freeCb, void *freeCtx);
+
+/**
+ * stop workers after draining their queues, and free everything
+ */
+void slsFree(sls_t *s);
+
+/**
+ * insert udata, or move it to score if exists
+ * return 0 if queued, -1 if no memory
+ */
+int slsUpdate(sls_t *s, void *udata, double score);
+int slsDelete(sls_t *s, void *udata);
+
+/**
+ * wait until every write queued before is applied
+ */
+void slsFlush(sls_t *s);
+
+int slsShardOf(sls_t *s, void *udata);
+
+/**
+ * return 0 if succeed, -1 if too many readers
+ */
+int slsReaderRegister(sls_t *s, slsReader_t *rd);
+void slsReaderUnregister(sls_t *s, slsReader_t *rd);
+
+int slsGetSize(sls_t *s);
+
+/**
+ * global rank of (score, udata), counting every entry ordered before it;
+ * udata does not have to be a member
+ */
+int slsGetRank(sls_t *s, slsReader_t *rd, void *udata, double score);
+
+/**
+ * merge global rank range [rankMin, rankMax], at most sz,
+ * udataArr or scoreArr may be NULL
+ * return count written
+ */
+int slsGetRankRange(sls_t *s, slsReader_t *rd,
+		    int rankMin, int rankMax,
+		    void **udataArr, double *scoreArr, int sz);
+
+#if defined (__cplusplus)
+}	/*end of extern "C"*/
+#endif
+
+#endif /* end of include guard:  _SLSHARD_H_Q9BX2E6L_ */
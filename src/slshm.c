@@ -0,0 +1,446 @@
+#include <stdlib.h>
+#include <string.h>
+#include "slshm.h"
+
+/* the writer owns the region, plain loads are fine on its side */
+#define SLSHM_LOAD_OFF(v) __atomic_load_n(&(v), __ATOMIC_ACQUIRE)
+#define SLSHM_STORE_OFF(v, x) __atomic_store_n(&(v), (x), __ATOMIC_RELEASE)
+#define SLSHM_LOAD(v) __atomic_load_n(&(v), __ATOMIC_RELAXED)
+#define SLSHM_STORE(v, x) __atomic_store_n(&(v), (x), __ATOMIC_RELAXED)
+
+/* readers check seq every SLSHM_HOP_CHECK hops, see SLC_HOP_CHECK */
+#define SLSHM_HOP_CHECK 64
+
+#define SLSHM_ALIGN(n) (((n) + sizeof(double) - 1) & ~(sizeof(double) - 1))
+
+#define SLSHM_NODE(sm, off) ((struct slshmNode_s *)((sm)->base + (off)))
+#define SLSHM_HEAD_OFF offsetof(struct slshmRegion_s, head)
+
+static void slshmWriteBegin(slshm_t *sm)
+{
+	SLSHM_STORE(sm->r->seq, sm->r->seq + 1);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void slshmWriteEnd(slshm_t *sm)
+{
+	__atomic_store_n(&sm->r->seq, sm->r->seq + 1, __ATOMIC_RELEASE);
+}
+
+static unsigned long slshmReadBegin(slshm_t *sm)
+{
+	unsigned long seq;
+	while ((seq = __atomic_load_n(&sm->r->seq, __ATOMIC_ACQUIRE)) & 1)
+		;
+	return seq;
+}
+
+static int slshmReadChanged(slshm_t *sm, unsigned long seq)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&sm->r->seq, __ATOMIC_RELAXED) != seq;
+}
+
+/**
+ * order node against (score, key)
+ */
+static int slshmComp(struct slshmNode_s *node, unsigned long key, double score)
+{
+	unsigned long k;
+	if (node->score != score)
+		return node->score < score ? -1 : 1;
+	k = SLSHM_LOAD(node->key);
+	return k == key ? 0 : k < key ? -1 : 1;
+}
+
+static int slshmRandomLevel(slshm_t *sm)
+{
+	int level = 1;
+	unsigned int x = sm->r->rng;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	sm->r->rng = x;
+	/* SKIPLIST_P == 0.25 */
+	while ((x & 3) == 0 && level < SKIPLIST_MAXLEVEL) {
+		level++;
+		x >>= 2;
+	}
+	return level;
+}
+
+size_t slshmNodeBytes(int level)
+{
+	return SLSHM_ALIGN(sizeof(struct slshmNode_s) + sizeof(struct slshmLevel_s) * (level - 1));
+}
+
+/**
+ * a node of level or taller: the free list of level, fresh bytes,
+ * then the free lists of taller nodes
+ */
+static slshmOff_t slshmAlloc(slshm_t *sm, int level)
+{
+	struct slshmRegion_s *r = sm->r;
+	slshmOff_t off;
+	size_t sz = slshmNodeBytes(level);
+	int i;
+	if (r->freeList[level - 1] != 0) {
+		off = r->freeList[level - 1];
+		r->freeList[level - 1] = SLSHM_NODE(sm, off)->level[0].next;
+		return off;
+	}
+	if (r->regionSize - r->brk >= sz) {
+		off = r->brk;
+		r->brk += sz;
+		SLSHM_NODE(sm, off)->levelSize = level;
+		return off;
+	}
+	for (i = level; i < SKIPLIST_MAXLEVEL; i++) {
+		if (r->freeList[i] != 0) {
+			off = r->freeList[i];
+			r->freeList[i] = SLSHM_NODE(sm, off)->level[0].next;
+			return off;
+		}
+	}
+	return 0;
+}
+
+/**
+ * fill update[] and rank[] with the last node before (score, key) per level
+ */
+static void slshmDescend(slshm_t *sm, unsigned long key, double score,
+			 slshmOff_t *update, size_t *rank)
+{
+	struct slshmRegion_s *r = sm->r;
+	slshmOff_t x = SLSHM_HEAD_OFF;
+	slshmOff_t next;
+	int i;
+	for (i = r->level - 1; i >= 0; i--) {
+		rank[i] = i == r->level - 1 ? 0 : rank[i + 1];
+		while ((next = SLSHM_NODE(sm, x)->level[i].next) != 0 &&
+		       slshmComp(SLSHM_NODE(sm, next), key, score) < 0) {
+			rank[i] += SLSHM_NODE(sm, x)->level[i].span;
+			x = next;
+		}
+		update[i] = x;
+	}
+}
+
+/**
+ * link the node at off, its score and key are set
+ */
+static void slshmLink(slshm_t *sm, slshmOff_t off)
+{
+	struct slshmRegion_s *r = sm->r;
+	struct slshmNode_s *node = SLSHM_NODE(sm, off);
+	slshmOff_t update[SKIPLIST_MAXLEVEL];
+	size_t rank[SKIPLIST_MAXLEVEL];
+	int level = node->levelSize;
+	int i;
+
+	slshmDescend(sm, node->key, node->score, update, rank);
+	if (level > r->level) {
+		for (i = r->level; i < level; i++) {
+			rank[i] = 0;
+			update[i] = SLSHM_HEAD_OFF;
+			SLSHM_STORE(r->head.level[i].span, r->size);
+		}
+		SLSHM_STORE(r->level, level);
+	}
+	/* the node is complete before the first link to it is published */
+	for (i = 0; i < level; i++) {
+		struct slshmLevel_s *u = &SLSHM_NODE(sm, update[i])->level[i];
+		SLSHM_STORE(node->level[i].next, u->next);
+		SLSHM_STORE(node->level[i].span, u->span - (rank[0] - rank[i]));
+	}
+	for (i = 0; i < level; i++) {
+		struct slshmLevel_s *u = &SLSHM_NODE(sm, update[i])->level[i];
+		SLSHM_STORE(u->span, rank[0] - rank[i] + 1);
+		SLSHM_STORE_OFF(u->next, off);
+	}
+	for (i = level; i < r->level; i++) {
+		struct slshmLevel_s *u = &SLSHM_NODE(sm, update[i])->level[i];
+		SLSHM_STORE(u->span, u->span + 1);
+	}
+	SLSHM_STORE(r->size, r->size + 1);
+}
+
+/**
+ * unlink the node at off, return 0 if succeed, -1 if not found
+ */
+static int slshmUnlink(slshm_t *sm, slshmOff_t off)
+{
+	struct slshmRegion_s *r = sm->r;
+	struct slshmNode_s *node;
+	slshmOff_t update[SKIPLIST_MAXLEVEL];
+	size_t rank[SKIPLIST_MAXLEVEL];
+	int i;
+
+	if (off < sizeof(struct slshmRegion_s) || off >= r->brk)
+		return -1;
+	node = SLSHM_NODE(sm, off);
+	slshmDescend(sm, node->key, node->score, update, rank);
+	if (SLSHM_NODE(sm, update[0])->level[0].next != off)
+		return -1;
+	for (i = 0; i < r->level; i++) {
+		struct slshmLevel_s *u = &SLSHM_NODE(sm, update[i])->level[i];
+		if (u->next == off) {
+			SLSHM_STORE(u->span, u->span + node->level[i].span - 1);
+			SLSHM_STORE_OFF(u->next, node->level[i].next);
+		} else {
+			SLSHM_STORE(u->span, u->span - 1);
+		}
+	}
+	while (r->level > 1 && r->head.level[r->level - 1].next == 0)
+		SLSHM_STORE(r->level, r->level - 1);
+	SLSHM_STORE(r->size, r->size - 1);
+	return 0;
+}
+
+int slshmCreate(slshm_t *sm, void *base, size_t size)
+{
+	struct slshmRegion_s *r = base;
+	int i;
+	if (size < sizeof(struct slshmRegion_s))
+		return -1;
+	memset(r, 0, sizeof(*r));
+	r->regionSize = size;
+	r->brk = SLSHM_ALIGN(sizeof(struct slshmRegion_s));
+	r->rng = ((unsigned int)rand() * 2654435761u) | 1;
+	r->level = 1;
+	r->head.levelSize = SKIPLIST_MAXLEVEL;
+	for (i = 0; i < SKIPLIST_MAXLEVEL; i++)
+		r->head.level[i].next = 0;
+	sm->base = base;
+	sm->r = r;
+	/* last, attach checks it */
+	__atomic_store_n(&r->magic, SLSHM_MAGIC, __ATOMIC_RELEASE);
+	return 0;
+}
+
+int slshmAttach(slshm_t *sm, void *base, size_t size)
+{
+	struct slshmRegion_s *r = base;
+	if (size < sizeof(struct slshmRegion_s) ||
+	    __atomic_load_n(&r->magic, __ATOMIC_ACQUIRE) != SLSHM_MAGIC ||
+	    r->regionSize != size)
+		return -1;
+	sm->base = base;
+	sm->r = r;
+	return 0;
+}
+
+slshmOff_t slshmInsert(slshm_t *sm, unsigned long key, double score)
+{
+	struct slshmNode_s *node;
+	slshmOff_t off = slshmAlloc(sm, slshmRandomLevel(sm));
+	if (off == 0)
+		return 0;
+	node = SLSHM_NODE(sm, off);
+	slshmWriteBegin(sm);
+	node->score = score;
+	SLSHM_STORE(node->key, key);
+	slshmLink(sm, off);
+	slshmWriteEnd(sm);
+	return off;
+}
+
+int slshmDelete(slshm_t *sm, slshmOff_t off)
+{
+	struct slshmNode_s *node;
+	int ret;
+	slshmWriteBegin(sm);
+	ret = slshmUnlink(sm, off);
+	if (ret == 0) {
+		/* readers still on it see a node of the same height */
+		node = SLSHM_NODE(sm, off);
+		SLSHM_STORE_OFF(node->level[0].next, sm->r->freeList[node->levelSize - 1]);
+		sm->r->freeList[node->levelSize - 1] = off;
+	}
+	slshmWriteEnd(sm);
+	return ret;
+}
+
+int slshmUpdate(slshm_t *sm, slshmOff_t off, double score)
+{
+	int ret;
+	slshmWriteBegin(sm);
+	ret = slshmUnlink(sm, off);
+	if (ret == 0) {
+		SLSHM_NODE(sm, off)->score = score;
+		slshmLink(sm, off);
+	}
+	slshmWriteEnd(sm);
+	return ret;
+}
+
+int slshmGetSize(slshm_t *sm)
+{
+	return (int)SLSHM_LOAD(sm->r->size);
+}
+
+int slshmGetRank(slshm_t *sm, unsigned long key, double score)
+{
+	unsigned long seq;
+	size_t traversed;
+	int rank;
+	int hops;
+	int i;
+	slshmOff_t x;
+	slshmOff_t next;
+
+retry:
+	seq = slshmReadBegin(sm);
+	traversed = 0;
+	rank = 0;
+	hops = 0;
+	x = SLSHM_HEAD_OFF;
+	for (i = SLSHM_LOAD(sm->r->level) - 1; i >= 0; i--) {
+		while ((next = SLSHM_LOAD_OFF(SLSHM_NODE(sm, x)->level[i].next)) != 0 &&
+		       slshmComp(SLSHM_NODE(sm, next), key, score) <= 0) {
+			traversed += SLSHM_LOAD(SLSHM_NODE(sm, x)->level[i].span);
+			x = next;
+			if (++hops % SLSHM_HOP_CHECK == 0 && slshmReadChanged(sm, seq))
+				goto retry;
+		}
+		if (x != SLSHM_HEAD_OFF && slshmComp(SLSHM_NODE(sm, x), key, score) == 0) {
+			rank = (int)traversed;
+			break;
+		}
+	}
+	if (slshmReadChanged(sm, seq))
+		goto retry;
+	return rank;
+}
+
+/**
+ * offset of the node at rank, 0 if out of range or seq moved on;
+ * the caller validates seq
+ */
+static slshmOff_t slshmFindRank(slshm_t *sm, int rank, unsigned long seq)
+{
+	size_t traversed = 0;
+	int hops = 0;
+	int i;
+	slshmOff_t x = SLSHM_HEAD_OFF;
+	slshmOff_t next;
+
+	for (i = SLSHM_LOAD(sm->r->level) - 1; i >= 0; i--) {
+		while ((next = SLSHM_LOAD_OFF(SLSHM_NODE(sm, x)->level[i].next)) != 0 &&
+		       SLSHM_LOAD(SLSHM_NODE(sm, x)->level[i].span) + traversed <= (size_t)rank) {
+			traversed += SLSHM_LOAD(SLSHM_NODE(sm, x)->level[i].span);
+			x = next;
+			if (++hops % SLSHM_HOP_CHECK == 0 && slshmReadChanged(sm, seq))
+				return 0;
+		}
+		if (traversed == (size_t)rank)
+			return x == SLSHM_HEAD_OFF ? 0 : x;
+	}
+	return 0;
+}
+
+int slshmGetByRank(slshm_t *sm, int rank, unsigned long *pKey, double *pScore)
+{
+	unsigned long seq;
+	unsigned long key = 0;
+	double score = 0.0;
+	slshmOff_t x;
+
+	if (rank < 1)
+		return -1;
+retry:
+	seq = slshmReadBegin(sm);
+	x = slshmFindRank(sm, rank, seq);
+	if (x != 0) {
+		key = SLSHM_LOAD(SLSHM_NODE(sm, x)->key);
+		score = SLSHM_NODE(sm, x)->score;
+	}
+	if (slshmReadChanged(sm, seq))
+		goto retry;
+	if (x == 0)
+		return -1;
+	if (pKey != NULL)
+		*pKey = key;
+	if (pScore != NULL)
+		*pScore = score;
+	return 0;
+}
+
+/**
+ * copy from the node at x on, until a score over *pMax or cnt nodes,
+ * pMax may be NULL;
+ * return count copied, -1 if seq moved on
+ */
+static int slshmCopy(slshm_t *sm, unsigned long seq, slshmOff_t x, const double *pMax, int cnt,
+		     unsigned long *keyArr, double *scoreArr)
+{
+	int n;
+	for (n = 0; x != 0 && n < cnt; n++) {
+		struct slshmNode_s *node = SLSHM_NODE(sm, x);
+		if (pMax != NULL && node->score > *pMax)
+			break;
+		if (keyArr != NULL)
+			keyArr[n] = SLSHM_LOAD(node->key);
+		if (scoreArr != NULL)
+			scoreArr[n] = node->score;
+		x = SLSHM_LOAD_OFF(node->level[0].next);
+		if ((n + 1) % SLSHM_HOP_CHECK == 0 && slshmReadChanged(sm, seq))
+			return -1;
+	}
+	return n;
+}
+
+int slshmGetRankRange(slshm_t *sm, int rankMin, int rankMax,
+		      unsigned long *keyArr, double *scoreArr, int sz)
+{
+	unsigned long seq;
+	int n;
+
+	if (sz <= 0 || rankMin < 1 || rankMin > rankMax)
+		return 0;
+	if (sz > rankMax - rankMin + 1)
+		sz = rankMax - rankMin + 1;
+retry:
+	seq = slshmReadBegin(sm);
+	n = slshmCopy(sm, seq, slshmFindRank(sm, rankMin, seq), NULL, sz,
+		      keyArr, scoreArr);
+	if (n < 0 || slshmReadChanged(sm, seq))
+		goto retry;
+	return n;
+}
+
+int slshmGetScoreRange(slshm_t *sm, double min, double max, int *pRankMin,
+		       unsigned long *keyArr, double *scoreArr, int sz)
+{
+	unsigned long seq;
+	size_t traversed;
+	int hops;
+	int i;
+	int n;
+	slshmOff_t x;
+	slshmOff_t next;
+
+	if (sz <= 0 || min > max)
+		return 0;
+retry:
+	seq = slshmReadBegin(sm);
+	traversed = 0;
+	hops = 0;
+	x = SLSHM_HEAD_OFF;
+	for (i = SLSHM_LOAD(sm->r->level) - 1; i >= 0; i--) {
+		while ((next = SLSHM_LOAD_OFF(SLSHM_NODE(sm, x)->level[i].next)) != 0 &&
+		       SLSHM_NODE(sm, next)->score < min) {
+			traversed += SLSHM_LOAD(SLSHM_NODE(sm, x)->level[i].span);
+			x = next;
+			if (++hops % SLSHM_HOP_CHECK == 0 && slshmReadChanged(sm, seq))
+				goto retry;
+		}
+	}
+	n = slshmCopy(sm, seq, SLSHM_LOAD_OFF(SLSHM_NODE(sm, x)->level[0].next), &max, sz,
+		      keyArr, scoreArr);
+	if (n < 0 || slshmReadChanged(sm, seq))
+		goto retry;
+	if (pRankMin != NULL)
+		*pRankMin = n > 0 ? (int)traversed + 1 : 0;
+	return n;
+}
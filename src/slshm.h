@@ -0,0 +1,148 @@
+#ifndef  _SLSHM_H_W5HC8P2N_
+#define  _SLSHM_H_W5HC8P2N_
+
+#include <stddef.h>
+#include "skiplist.h"
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * position independent skiplist in a caller provided memory region
+ *
+ * everything, the list head included, lives inside of the region and
+ * links are offsets from its base, so every process may map it at its
+ * own address (shm_open + mmap, or a shared file mapping).
+ * nodes come from an in-region allocator: bump allocation plus one free
+ * list per tower height, nodes never leave the region or change height.
+ *
+ * one writer process calls slshmInsert/slshmDelete/slshmUpdate, every
+ * write bumps a sequence counter in the region; reader processes query
+ * without locks and retry if the counter moved, like slc_t.
+ * a writer dying inside of a write leaves the counter odd, readers then
+ * spin until the region is formatted again.
+ *
+ * members are (score, key) pairs ordered by score then key,
+ * a pair must be unique in the list.
+ */
+
+#define SLSHM_MAGIC 0x736c736dUL
+
+typedef size_t slshmOff_t;	/* offset from the region base, 0 for none */
+
+struct slshmLevel_s {
+	slshmOff_t next;
+	size_t span;
+};
+
+struct slshmNode_s {
+	double score;
+	unsigned long key;
+	int levelSize;
+	struct slshmLevel_s level[1];
+};
+
+struct slshmNodeMax_s {
+	double score;
+	unsigned long key;
+	int levelSize;
+	struct slshmLevel_s level[SKIPLIST_MAXLEVEL];
+};
+
+/**
+ * header at offset 0 of the region
+ */
+struct slshmRegion_s {
+	unsigned long magic;
+	unsigned long seq;		/* odd while the writer is changing the list */
+	size_t regionSize;
+	size_t brk;			/* first byte never allocated */
+	slshmOff_t freeList[SKIPLIST_MAXLEVEL];	/* by levelSize - 1, chained by level[0].next */
+	unsigned int rng;
+	int level;
+	size_t size;
+	struct slshmNodeMax_s head;
+};
+
+/**
+ * per-process handle
+ */
+typedef struct slShm_s {
+	char *base;
+	struct slshmRegion_s *r;
+} slshm_t;
+
+/**
+ * bytes taken by a node of level, the region needs
+ * sizeof(struct slshmRegion_s) plus about slshmNodeBytes(2) per member
+ */
+size_t slshmNodeBytes(int level);
+
+/**
+ * format size bytes at base as an empty list, base must be aligned
+ * like a double (mmap is);
+ * return 0 if succeed, -1 if the region is too small
+ */
+int slshmCreate(slshm_t *sm, void *base, size_t size);
+
+/**
+ * attach to a region formatted by slshmCreate, mapped at base
+ * return 0 if succeed, -1 if it is not a list or size differs
+ */
+int slshmAttach(slshm_t *sm, void *base, size_t size);
+
+/**
+ * writer only
+ * return offset of the new node, 0 if the region is full
+ */
+slshmOff_t slshmInsert(slshm_t *sm, unsigned long key, double score);
+
+/**
+ * unlink the node at off and keep it for reuse
+ * return 0 if succeed, -1 if not found
+ */
+int slshmDelete(slshm_t *sm, slshmOff_t off);
+
+/**
+ * move the node at off to score, its offset does not change
+ * return 0 if succeed, -1 if not found
+ */
+int slshmUpdate(slshm_t *sm, slshmOff_t off, double score);
+
+/**
+ * readers, from any process
+ */
+int slshmGetSize(slshm_t *sm);
+
+/**
+ * rank of (score, key), 0 if not in the list
+ */
+int slshmGetRank(slshm_t *sm, unsigned long key, double score);
+
+/**
+ * copy the member at rank, return 0 if succeed, -1 if out of range
+ */
+int slshmGetByRank(slshm_t *sm, int rank, unsigned long *pKey, double *pScore);
+
+/**
+ * copy a consistent snapshot of ranks [rankMin, rankMax], at most sz,
+ * keyArr or scoreArr may be NULL
+ * return count copied
+ */
+int slshmGetRankRange(slshm_t *sm, int rankMin, int rankMax,
+		      unsigned long *keyArr, double *scoreArr, int sz);
+
+/**
+ * copy members with min <= score <= max, at most sz,
+ * pRankMin gets the rank of the first one if not NULL
+ * return count copied
+ */
+int slshmGetScoreRange(slshm_t *sm, double min, double max, int *pRankMin,
+		       unsigned long *keyArr, double *scoreArr, int sz);
+
+#if defined (__cplusplus)
+}	/*end of extern "C"*/
+#endif
+
+#endif /* end of include guard:  _SLSHM_H_W5HC8P2N_ */
@@ -0,0 +1,394 @@
+#include <stdlib.h>
+#include <string.h>
+#include "baseline.h"
+
+static int entryComp(double scoreA, int idA, double scoreB, int idB)
+{
+	if (scoreA != scoreB)
+		return scoreA < scoreB ? -1 : 1;
+	if (idA != idB)
+		return idA < idB ? -1 : 1;
+	return 0;
+}
+
+static int saEntryComp(const void *a, const void *b)
+{
+	const saEntry_t *ea = a;
+	const saEntry_t *eb = b;
+	return entryComp(ea->score, ea->id, eb->score, eb->id);
+}
+
+int saInit(sortedArray_t *sa, int cap)
+{
+	sa->arr = malloc(sizeof(saEntry_t) * (cap > 0 ? cap : 1));
+	sa->size = 0;
+	sa->cap = cap;
+	return sa->arr == NULL ? -1 : 0;
+}
+
+void saDestroy(sortedArray_t *sa)
+{
+	free(sa->arr);
+	sa->arr = NULL;
+	sa->size = sa->cap = 0;
+}
+
+void saBuild(sortedArray_t *sa, int size)
+{
+	sa->size = size;
+	qsort(sa->arr, size, sizeof(saEntry_t), saEntryComp);
+}
+
+/* index of first entry >= (score, id) */
+static int saLowerBound(sortedArray_t *sa, double score, int id)
+{
+	int lo = 0;
+	int hi = sa->size;
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		if (entryComp(sa->arr[mid].score, sa->arr[mid].id, score, id) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+int saInsert(sortedArray_t *sa, double score, int id)
+{
+	int i;
+	if (sa->size >= sa->cap) {
+		int cap = sa->cap * 2 + 1;
+		saEntry_t *arr = realloc(sa->arr, sizeof(saEntry_t) * cap);
+		if (arr == NULL)
+			return -1;
+		sa->arr = arr;
+		sa->cap = cap;
+	}
+	i = saLowerBound(sa, score, id);
+	memmove(sa->arr + i + 1, sa->arr + i, sizeof(saEntry_t) * (sa->size - i));
+	sa->arr[i].score = score;
+	sa->arr[i].id = id;
+	sa->size++;
+	return 0;
+}
+
+int saDelete(sortedArray_t *sa, double score, int id)
+{
+	int i = saLowerBound(sa, score, id);
+	if (i >= sa->size || sa->arr[i].id != id)
+		return -1;
+	memmove(sa->arr + i, sa->arr + i + 1, sizeof(saEntry_t) * (sa->size - i - 1));
+	sa->size--;
+	return 0;
+}
+
+int saRank(sortedArray_t *sa, double score, int id)
+{
+	int i = saLowerBound(sa, score, id);
+	if (i >= sa->size || sa->arr[i].id != id)
+		return 0;
+	return i + 1;
+}
+
+int saFirstGE(sortedArray_t *sa, double score)
+{
+	int lo = 0;
+	int hi = sa->size;
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		if (sa->arr[mid].score < score)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+void rbInit(rbTree_t *t)
+{
+	rbNode_t *nil = RB_NIL(t);
+	memset(nil, 0, sizeof(*nil));
+	nil->left = nil->right = nil->parent = nil;
+	t->root = nil;
+}
+
+static void rbRotateLeft(rbTree_t *t, rbNode_t *x)
+{
+	rbNode_t *nil = RB_NIL(t);
+	rbNode_t *y = x->right;
+	x->right = y->left;
+	if (y->left != nil)
+		y->left->parent = x;
+	y->parent = x->parent;
+	if (x->parent == nil)
+		t->root = y;
+	else if (x == x->parent->left)
+		x->parent->left = y;
+	else
+		x->parent->right = y;
+	y->left = x;
+	x->parent = y;
+	y->size = x->size;
+	x->size = x->left->size + x->right->size + 1;
+}
+
+static void rbRotateRight(rbTree_t *t, rbNode_t *x)
+{
+	rbNode_t *nil = RB_NIL(t);
+	rbNode_t *y = x->left;
+	x->left = y->right;
+	if (y->right != nil)
+		y->right->parent = x;
+	y->parent = x->parent;
+	if (x->parent == nil)
+		t->root = y;
+	else if (x == x->parent->right)
+		x->parent->right = y;
+	else
+		x->parent->left = y;
+	y->right = x;
+	x->parent = y;
+	y->size = x->size;
+	x->size = x->left->size + x->right->size + 1;
+}
+
+void rbInsert(rbTree_t *t, rbNode_t *z)
+{
+	rbNode_t *nil = RB_NIL(t);
+	rbNode_t *y = nil;
+	rbNode_t *x = t->root;
+	while (x != nil) {
+		y = x;
+		x->size++;
+		if (entryComp(z->score, z->id, x->score, x->id) < 0)
+			x = x->left;
+		else
+			x = x->right;
+	}
+	z->parent = y;
+	if (y == nil)
+		t->root = z;
+	else if (entryComp(z->score, z->id, y->score, y->id) < 0)
+		y->left = z;
+	else
+		y->right = z;
+	z->left = z->right = nil;
+	z->red = 1;
+	z->size = 1;
+
+	while (z->parent->red) {
+		rbNode_t *gp = z->parent->parent;
+		if (z->parent == gp->left) {
+			y = gp->right;
+			if (y->red) {
+				z->parent->red = 0;
+				y->red = 0;
+				gp->red = 1;
+				z = gp;
+			} else {
+				if (z == z->parent->right) {
+					z = z->parent;
+					rbRotateLeft(t, z);
+				}
+				z->parent->red = 0;
+				z->parent->parent->red = 1;
+				rbRotateRight(t, z->parent->parent);
+			}
+		} else {
+			y = gp->left;
+			if (y->red) {
+				z->parent->red = 0;
+				y->red = 0;
+				gp->red = 1;
+				z = gp;
+			} else {
+				if (z == z->parent->left) {
+					z = z->parent;
+					rbRotateRight(t, z);
+				}
+				z->parent->red = 0;
+				z->parent->parent->red = 1;
+				rbRotateLeft(t, z->parent->parent);
+			}
+		}
+	}
+	t->root->red = 0;
+}
+
+static void rbTransplant(rbTree_t *t, rbNode_t *u, rbNode_t *v)
+{
+	if (u->parent == RB_NIL(t))
+		t->root = v;
+	else if (u == u->parent->left)
+		u->parent->left = v;
+	else
+		u->parent->right = v;
+	v->parent = u->parent;
+}
+
+void rbDelete(rbTree_t *t, rbNode_t *z)
+{
+	rbNode_t *nil = RB_NIL(t);
+	rbNode_t *x;
+	rbNode_t *y = z;
+	rbNode_t *p;
+	int yRed = y->red;
+
+	if (z->left == nil) {
+		x = z->right;
+		rbTransplant(t, z, z->right);
+	} else if (z->right == nil) {
+		x = z->left;
+		rbTransplant(t, z, z->left);
+	} else {
+		y = z->right;
+		while (y->left != nil)
+			y = y->left;
+		yRed = y->red;
+		x = y->right;
+		if (y->parent == z) {
+			x->parent = y;
+		} else {
+			rbTransplant(t, y, y->right);
+			y->right = z->right;
+			y->right->parent = y;
+		}
+		rbTransplant(t, z, y);
+		y->left = z->left;
+		y->left->parent = y;
+		y->red = z->red;
+	}
+	/* fix sizes from the lowest touched node up to root */
+	for (p = x->parent; p != nil; p = p->parent)
+		p->size = p->left->size + p->right->size + 1;
+
+	if (yRed)
+		return;
+	while (x != t->root && !x->red) {
+		rbNode_t *w;
+		if (x == x->parent->left) {
+			w = x->parent->right;
+			if (w->red) {
+				w->red = 0;
+				x->parent->red = 1;
+				rbRotateLeft(t, x->parent);
+				w = x->parent->right;
+			}
+			if (!w->left->red && !w->right->red) {
+				w->red = 1;
+				x = x->parent;
+			} else {
+				if (!w->right->red) {
+					w->left->red = 0;
+					w->red = 1;
+					rbRotateRight(t, w);
+					w = x->parent->right;
+				}
+				w->red = x->parent->red;
+				x->parent->red = 0;
+				w->right->red = 0;
+				rbRotateLeft(t, x->parent);
+				x = t->root;
+			}
+		} else {
+			w = x->parent->left;
+			if (w->red) {
+				w->red = 0;
+				x->parent->red = 1;
+				rbRotateRight(t, x->parent);
+				w = x->parent->left;
+			}
+			if (!w->right->red && !w->left->red) {
+				w->red = 1;
+				x = x->parent;
+			} else {
+				if (!w->left->red) {
+					w->right->red = 0;
+					w->red = 1;
+					rbRotateLeft(t, w);
+					w = x->parent->left;
+				}
+				w->red = x->parent->red;
+				x->parent->red = 0;
+				w->left->red = 0;
+				rbRotateRight(t, x->parent);
+				x = t->root;
+			}
+		}
+	}
+	x->red = 0;
+	/* nil may have been used as x, keep it clean */
+	nil->size = 0;
+	nil->parent = nil;
+}
+
+int rbRank(rbTree_t *t, rbNode_t *node)
+{
+	int rank = (int)node->left->size + 1;
+	rbNode_t *p = node;
+	while (p != t->root) {
+		if (p == p->parent->right)
+			rank += (int)p->parent->left->size + 1;
+		p = p->parent;
+	}
+	return rank;
+}
+
+rbNode_t *rbByRank(rbTree_t *t, int rank)
+{
+	rbNode_t *nil = RB_NIL(t);
+	rbNode_t *p = t->root;
+	while (p != nil) {
+		int r = (int)p->left->size + 1;
+		if (rank == r)
+			return p;
+		if (rank < r) {
+			p = p->left;
+		} else {
+			rank -= r;
+			p = p->right;
+		}
+	}
+	return NULL;
+}
+
+rbNode_t *rbFirstGE(rbTree_t *t, double score, int *pRank)
+{
+	rbNode_t *nil = RB_NIL(t);
+	rbNode_t *p = t->root;
+	rbNode_t *found = NULL;
+	int before = 0;
+	int rank = 0;
+	while (p != nil) {
+		if (p->score < score) {
+			before += (int)p->left->size + 1;
+			p = p->right;
+		} else {
+			found = p;
+			rank = before + (int)p->left->size + 1;
+			p = p->left;
+		}
+	}
+	if (pRank != NULL)
+		*pRank = rank;
+	return found;
+}
+
+rbNode_t *rbNext(rbTree_t *t, rbNode_t *node)
+{
+	rbNode_t *nil = RB_NIL(t);
+	rbNode_t *p;
+	if (node->right != nil) {
+		p = node->right;
+		while (p->left != nil)
+			p = p->left;
+		return p;
+	}
+	p = node->parent;
+	while (p != nil && node == p->right) {
+		node = p;
+		p = p->parent;
+	}
+	return p == nil ? NULL : p;
+}
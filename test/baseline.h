@@ -0,0 +1,79 @@
+#ifndef  _BASELINE_H_K2V8QZ1N_
+#define  _BASELINE_H_K2V8QZ1N_
+
+/**
+ * baselines for the benchmark harness, both ordered by (score, id)
+ * like a skiplist with internalComp
+ */
+
+#include <stddef.h>
+
+/**
+ * sorted array
+ */
+typedef struct saEntry_s {
+	double score;
+	int id;
+} saEntry_t;
+
+typedef struct sortedArray_s {
+	saEntry_t *arr;
+	int size;
+	int cap;
+} sortedArray_t;
+
+int saInit(sortedArray_t *sa, int cap);
+void saDestroy(sortedArray_t *sa);
+
+/**
+ * sort entries of sa->arr[0, size) once, for prefill
+ */
+void saBuild(sortedArray_t *sa, int size);
+int saInsert(sortedArray_t *sa, double score, int id);
+int saDelete(sortedArray_t *sa, double score, int id);
+
+/**
+ * rank from 1, 0 if not found
+ */
+int saRank(sortedArray_t *sa, double score, int id);
+
+/**
+ * index of first entry with score >= score
+ */
+int saFirstGE(sortedArray_t *sa, double score);
+
+/**
+ * red-black tree augmented with subtree size (order statistic tree)
+ */
+typedef struct rbNode_s rbNode_t;
+
+struct rbNode_s {
+	double score;
+	int id;
+	int red;
+	size_t size;
+	rbNode_t *left;
+	rbNode_t *right;
+	rbNode_t *parent;
+};
+
+typedef struct rbTree_s {
+	rbNode_t *root;
+	rbNode_t nil;
+} rbTree_t;
+
+void rbInit(rbTree_t *t);
+void rbInsert(rbTree_t *t, rbNode_t *node);
+void rbDelete(rbTree_t *t, rbNode_t *node);
+int rbRank(rbTree_t *t, rbNode_t *node);
+rbNode_t *rbByRank(rbTree_t *t, int rank);
+
+/**
+ * first node with score >= score, *pRank is set to its rank
+ */
+rbNode_t *rbFirstGE(rbTree_t *t, double score, int *pRank);
+rbNode_t *rbNext(rbTree_t *t, rbNode_t *node);
+
+#define RB_NIL(t) (&(t)->nil)
+
+#endif /* end of include guard:  _BASELINE_H_K2V8QZ1N_ */
@@ -0,0 +1,312 @@
+/**
+ * correctness checks, make check
+ *
+ * every list kind (plain, sum, lazy, det, desc) goes through random
+ * inserts and deletes, batch deletes and inserts, expiry, split and
+ * concat, and compaction; after each step the whole list is checked:
+ * order, prev and tail, size, the span and score sum of every link
+ * against a walk on level 0, and rank lookups against positions;
+ * det lists also keep the 1-2-3 gaps under churn.
+ *
+ * prints one line per kind, exits with 1 on the first mismatch.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/skiplist.h"
+
+#define CHECK_N 3000
+#define CHECK_ROUNDS 4
+#define CHECK_DET 13	/* 2^12 >= CHECK_N */
+
+enum checkKind_e {
+	KIND_PLAIN = 0,
+	KIND_SUM,
+	KIND_LAZY,
+	KIND_DET,
+	KIND_DESC,
+	KIND_MAX
+};
+
+static const char *kindNames[KIND_MAX] = {"plain", "sum", "lazy", "det", "desc"};
+
+/* udata is id + 1, so equal scores are ordered by id, not by address */
+static slNode_t *nodes[CHECK_N];
+static int kind;
+static const char *step;
+
+static void fail(const char *what, long a, long b)
+{
+	printf("FAIL %s after %s: %s (%ld, %ld)\n", kindNames[kind], step, what, a, b);
+	exit(1);
+}
+
+#define EXPECT(cond, what, a, b) do { if (!(cond)) fail(what, (long)(a), (long)(b)); } while (0)
+
+static int idOf(slNode_t *node)
+{
+	return (int)((size_t)node->udata - 1);
+}
+
+static void initList(sl_t *sl)
+{
+	slInit(sl);
+	switch (kind) {
+	case KIND_SUM:
+		sl->sum = 1;
+		break;
+	case KIND_LAZY:
+		slSetLazySpans(sl, 1);
+		break;
+	case KIND_DET:
+		slSetDeterministic(sl, CHECK_DET);
+		break;
+	case KIND_DESC:
+		slSetDescending(sl, 1);
+		break;
+	}
+}
+
+static slNode_t *newNode(int id)
+{
+	int level = kind == KIND_DET ? CHECK_DET : slRandomLevel();
+	/* small integer scores: many ties, and sums stay exact */
+	double score = rand() % (CHECK_N / 4);
+	void *udata = (void *)(size_t)(id + 1);
+	return kind == KIND_SUM ? slCreateSumNode(level, udata, score)
+		: slCreateNode(level, udata, score);
+}
+
+/**
+ * walk level 0 from p, count nodes and scores up to and including q
+ */
+static void walk(slNode_t *p, slNode_t *q, size_t *pSpan, double *pSum)
+{
+	*pSpan = 0;
+	*pSum = 0.0;
+	do {
+		p = p->level[0].next;
+		EXPECT(p != NULL, "link skips past the tail", *pSpan, 0);
+		(*pSpan)++;
+		*pSum += p->score;
+	} while (p != q);
+}
+
+static void checkList(sl_t *sl, int members)
+{
+	slNode_t *head = SL_HEAD(sl);
+	slNode_t *p;
+	slNode_t *prev = NULL;
+	size_t k = 0;
+	int i;
+
+	/* level 0: order, prev, tail, size */
+	for (p = SL_FIRST(sl); p != NULL; prev = p, p = SL_NEXT(p)) {
+		k++;
+		EXPECT(p->prev == prev, "prev", k, 0);
+		EXPECT(p->levelSize >= 1 && p->levelSize <= sl->level, "levelSize", k, p->levelSize);
+		EXPECT(p->levelSize <= p->levelCap, "levelCap", k, p->levelCap);
+		if (prev != NULL)
+			EXPECT(sl->comp(prev, p, sl, NULL) < 0, "order", k, 0);
+	}
+	EXPECT(sl->tail == prev, "tail", k, 0);
+	EXPECT(sl->size == k, "size", sl->size, k);
+	if (members >= 0)
+		EXPECT((int)k == members, "members", k, members);
+	for (i = sl->level; i < SKIPLIST_MAXLEVEL; i++)
+		EXPECT(head->level[i].next == NULL, "link above level", i, 0);
+
+	/* every link against level 0; the last link of a level is not kept */
+	for (i = 1; i < sl->level; i++) {
+		for (p = head; p->level[i].next != NULL; p = p->level[i].next) {
+			size_t span;
+			double sum;
+			walk(p, p->level[i].next, &span, &sum);
+			if (!sl->lazy || p->level[i].span != 0)
+				EXPECT(p->level[i].span == span, "span", i, span);
+			if (sl->sum)
+				EXPECT(SL_SUM(sl, p)[i] == sum, "sum", i, sum);
+		}
+	}
+	if (sl->sum) {
+		for (p = head; p->level[0].next != NULL; p = p->level[0].next)
+			EXPECT(SL_SUM(sl, p)[0] == p->level[0].next->score, "sum", 0, 0);
+	}
+
+	/* ranks through the API, this also fixes lazy spans */
+	k = 0;
+	for (p = SL_FIRST(sl); p != NULL; p = SL_NEXT(p)) {
+		k++;
+		EXPECT(slGetRank(sl, p, NULL) == k, "slGetRank", slGetRank(sl, p, NULL), k);
+		EXPECT(slGetNodeByRank(sl, (int)k) == p, "slGetNodeByRank", k, 0);
+		EXPECT(slGetRevRank(sl, p) == (int)(sl->size - k + 1), "slGetRevRank",
+		       slGetRevRank(sl, p), sl->size - k + 1);
+		if (sl->sum)
+			EXPECT(slSumByRankRange(sl, (int)k, (int)k) == p->score, "slSumByRankRange", k, 0);
+	}
+	EXPECT(slGetNodeByRank(sl, (int)k + 1) == NULL, "slGetNodeByRank past the tail", k, 0);
+}
+
+/* most nodes of height h between two taller ones, see slSetDeterministic */
+static void checkGaps(sl_t *sl)
+{
+	slNode_t *p;
+	int h;
+	for (h = 1; h < sl->level; h++) {
+		int gap = 0;
+		for (p = SL_FIRST(sl); p != NULL; p = SL_NEXT(p)) {
+			if (p->levelSize > h)
+				gap = 0;
+			else if (p->levelSize == h)
+				EXPECT(++gap <= 3, "det gap", h, gap);
+		}
+	}
+}
+
+static int countMembers(void)
+{
+	int i;
+	int n = 0;
+	for (i = 0; i < CHECK_N; i++)
+		n += nodes[i] != NULL;
+	return n;
+}
+
+static void moved(slNode_t *from, slNode_t *to, void *ctx)
+{
+	(void)ctx;
+	EXPECT(nodes[idOf(from)] == from, "moveCb of a node not in sl", idOf(from), 0);
+	nodes[idOf(to)] = to;
+}
+
+static void churn(sl_t *sl, int ops)
+{
+	int r;
+	for (r = 0; r < ops; r++) {
+		int id = rand() % CHECK_N;
+		if (nodes[id] != NULL) {
+			EXPECT(slDeleteNode(sl, nodes[id], NULL, NULL) == 0, "slDeleteNode", id, 0);
+			nodes[id] = NULL;
+		} else {
+			nodes[id] = newNode(id);
+			slInsertNode(sl, nodes[id], NULL);
+		}
+	}
+}
+
+static void checkBatch(sl_t *sl)
+{
+	slNode_t *batch[CHECK_N];
+	int n = 0;
+	int i;
+	for (i = 0; i < CHECK_N; i++) {
+		if (nodes[i] != NULL && rand() % 3 == 0)
+			batch[n++] = nodes[i];
+	}
+	EXPECT(slSortNodes(sl, batch, n, NULL) == 0, "slSortNodes", n, 0);
+	EXPECT(slDeleteNodes(sl, batch, n, NULL) == n, "slDeleteNodes", n, 0);
+	step = "slDeleteNodes";
+	checkList(sl, countMembers() - n);
+	for (i = 0; i < n; i++)
+		batch[i]->score = rand() % (CHECK_N / 4);
+	slSortNodes(sl, batch, n, NULL);
+	slInsertNodes(sl, batch, n, NULL);
+	step = "slInsertNodes";
+	checkList(sl, countMembers());
+}
+
+static void checkExpire(sl_t *sl)
+{
+	slNode_t *due[CHECK_N];
+	double now = CHECK_N / 16;
+	int budget = sl->size > 4 ? (int)sl->size / 4 : 1;
+	int n;
+	int i;
+	step = "slExpire";
+	n = slExpire(sl, now, budget, due);
+	for (i = 0; i < n; i++) {
+		EXPECT(due[i]->score <= now, "past now", i, due[i]->score);
+		if (i > 0)
+			EXPECT(sl->comp(due[i - 1], due[i], sl, NULL) < 0, "order of due nodes", i, 0);
+	}
+	if (n < budget && sl->size > 0)
+		EXPECT(SL_FIRST(sl)->score > now, "a due node is left", n, budget);
+	for (i = 0; i < n; i++) {
+		nodes[idOf(due[i])] = NULL;
+		slReleaseNode(sl, due[i], NULL, NULL);
+	}
+	checkList(sl, countMembers());
+}
+
+static void checkSplit(sl_t *sl)
+{
+	sl_t out;
+	size_t size = sl->size;
+	int rank = size > 0 ? rand() % (int)size : 0;
+	initList(&out);
+	EXPECT(slSplitAtRank(sl, rank, &out) == 0, "slSplitAtRank", rank, 0);
+	step = "slSplitAtRank";
+	checkList(sl, -1);
+	EXPECT((int)sl->size == rank, "split size", sl->size, rank);
+	checkList(&out, -1);
+	EXPECT(out.size == size - rank, "split out size", out.size, size - rank);
+	EXPECT(slConcat(sl, &out, NULL) == 0, "slConcat", 0, 0);
+	step = "slConcat";
+	checkList(sl, countMembers());
+	checkList(&out, 0);
+	slDestroy(&out, NULL, NULL);
+}
+
+static void checkCompact(sl_t *sl)
+{
+	int budget = 64;
+	int ret;
+	while ((ret = slCompact(sl, budget, moved, NULL)) > 0)
+		;
+	EXPECT(ret == 0, "slCompact", ret, 0);
+	step = "slCompact";
+	checkList(sl, countMembers());
+	/* churn the compacted list: chunked nodes are freed by sl */
+	churn(sl, CHECK_N);
+	step = "churn after slCompact";
+	checkList(sl, countMembers());
+}
+
+static void checkKind(void)
+{
+	sl_t sl;
+	int round;
+	int i;
+	initList(&sl);
+	for (i = 0; i < CHECK_N; i++)
+		nodes[i] = NULL;
+	for (round = 0; round < CHECK_ROUNDS; round++) {
+		churn(&sl, CHECK_N * 2);
+		step = "slInsertNode and slDeleteNode";
+		checkList(&sl, countMembers());
+		/* split and concat keep their own heights, the seams may stay wide */
+		if (kind == KIND_DET && round == 0)
+			checkGaps(&sl);
+		checkBatch(&sl);
+		if (kind != KIND_DESC)
+			checkExpire(&sl);
+		checkSplit(&sl);
+	}
+	checkCompact(&sl);
+
+	/* the members tracked by id are the ones in sl */
+	for (i = 0; i < CHECK_N; i++) {
+		if (nodes[i] != NULL)
+			EXPECT(slGetNodeByRank(&sl, slGetRank(&sl, nodes[i], NULL)) == nodes[i],
+			       "member", i, 0);
+	}
+	printf("%s ok, %d members\n", kindNames[kind], countMembers());
+	slDestroy(&sl, NULL, NULL);
+}
+
+int main(void)
+{
+	srand(1);
+	for (kind = 0; kind < KIND_MAX; kind++)
+		checkKind();
+	return 0;
+}
@@ -0,0 +1,217 @@
+/**
+ * threaded consistency check of sllf_t, make check
+ *
+ * writers insert, delete and pop a few shared keys, so that most ops
+ * race on the same nodes, while readers walk the set; each thread
+ * counts the ops that succeeded on every key. after the join:
+ *
+ *	a key is in the set iff its inserts outnumber deletes and pops
+ *	by one, else they are equal;
+ *	a walk sees every member once, in order, and the size agrees;
+ *	after sllfFree, freeCb ran once on every inserted entry that was
+ *	not handed out by sllfPopFirst.
+ *
+ * readers check the order of what they see during the run, too.
+ * exits with 1 on the first mismatch.
+ */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "../src/sllockfree.h"
+
+#define LF_KEYS 48
+#define LF_WRITERS 6
+#define LF_READERS 2
+#define LF_OPS 300000
+
+/* udata of key k is k + 1, its score is k % 5, so scores tie often */
+#define LF_UDATA(k) ((void *)(size_t)((k) + 1))
+#define LF_KEY(udata) ((int)((size_t)(udata) - 1))
+#define LF_SCORE(k) ((double)((k) % 5))
+
+typedef struct lfWorker_s {
+	pthread_t th;
+	unsigned int seed;
+	long inserted[LF_KEYS];
+	long deleted[LF_KEYS];	/* by sllfDelete and sllfPopFirst */
+	long popped[LF_KEYS];
+	int bad;		/* readers: out of order walks seen */
+} lfWorker_t;
+
+static sllf_t *l;
+static long freed[LF_KEYS];
+static volatile int writersLeft;
+
+static void freeCb(void *udata, void *ctx)
+{
+	(void)ctx;
+	__atomic_add_fetch(&freed[LF_KEY(udata)], 1, __ATOMIC_RELAXED);
+}
+
+static unsigned int lfRand(unsigned int *seed)
+{
+	*seed = *seed * 1103515245u + 12345u;
+	return *seed >> 8;
+}
+
+static void *writer(void *arg)
+{
+	lfWorker_t *w = arg;
+	int tid = sllfThreadRegister(l);
+	int i;
+	for (i = 0; i < LF_OPS; i++) {
+		unsigned int r = lfRand(&w->seed);
+		int k = (int)(r % LF_KEYS);
+		void *udata;
+		double score;
+		switch ((r >> 12) % 8) {
+		case 0:
+			if (sllfPopFirst(l, tid, &udata, &score) == 0) {
+				k = LF_KEY(udata);
+				w->deleted[k]++;
+				w->popped[k]++;
+			}
+			break;
+		case 1:
+		case 2:
+		case 3:
+			w->deleted[k] += sllfDelete(l, tid, LF_UDATA(k), LF_SCORE(k)) == 0;
+			break;
+		default:
+			w->inserted[k] += sllfInsert(l, tid, LF_UDATA(k), LF_SCORE(k)) == 0;
+			break;
+		}
+	}
+	sllfThreadUnregister(l, tid);
+	__atomic_sub_fetch(&writersLeft, 1, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+struct lfWalk_s {
+	int n;
+	int last;		/* key visited last, -1 before the first */
+	int bad;
+	int seen[LF_KEYS];
+};
+
+static int visit(void *udata, double score, void *ctx)
+{
+	struct lfWalk_s *walk = ctx;
+	int k = LF_KEY(udata);
+	if (k < 0 || k >= LF_KEYS || score != LF_SCORE(k))
+		walk->bad++;
+	else if (walk->last >= 0 && (LF_SCORE(walk->last) > score ||
+		 (LF_SCORE(walk->last) == score && walk->last >= k)))
+		walk->bad++;
+	else
+		walk->seen[k]++;
+	walk->last = k;
+	walk->n++;
+	return 0;
+}
+
+static void *reader(void *arg)
+{
+	lfWorker_t *w = arg;
+	int tid = sllfThreadRegister(l);
+	while (__atomic_load_n(&writersLeft, __ATOMIC_ACQUIRE) > 0) {
+		struct lfWalk_s walk;
+		walk.n = 0;
+		walk.last = -1;
+		walk.bad = 0;
+		sllfForRange(l, tid, -1.0, LF_KEYS, visit, &walk);
+		w->bad += walk.bad;
+	}
+	sllfThreadUnregister(l, tid);
+	return NULL;
+}
+
+int main(void)
+{
+	lfWorker_t workers[LF_WRITERS + LF_READERS];
+	struct lfWalk_s walk;
+	long inserted[LF_KEYS];
+	long deleted[LF_KEYS];
+	long popped[LF_KEYS];
+	long members = 0;
+	int tid;
+	int i;
+	int k;
+	int bad = 0;
+
+	l = sllfCreate(freeCb, NULL);
+	writersLeft = LF_WRITERS;
+	for (i = 0; i < LF_WRITERS + LF_READERS; i++) {
+		lfWorker_t *w = &workers[i];
+		for (k = 0; k < LF_KEYS; k++) {
+			w->inserted[k] = 0;
+			w->deleted[k] = 0;
+			w->popped[k] = 0;
+		}
+		w->seed = 2463534242u + i * 2654435761u;
+		w->bad = 0;
+		if (pthread_create(&w->th, NULL, i < LF_WRITERS ? writer : reader, w) != 0) {
+			printf("FAIL pthread_create\n");
+			return 1;
+		}
+	}
+	for (i = 0; i < LF_WRITERS + LF_READERS; i++)
+		pthread_join(workers[i].th, NULL);
+
+	for (k = 0; k < LF_KEYS; k++) {
+		inserted[k] = deleted[k] = popped[k] = 0;
+		for (i = 0; i < LF_WRITERS; i++) {
+			inserted[k] += workers[i].inserted[k];
+			deleted[k] += workers[i].deleted[k];
+			popped[k] += workers[i].popped[k];
+		}
+	}
+	for (i = LF_WRITERS; i < LF_WRITERS + LF_READERS; i++) {
+		if (workers[i].bad != 0) {
+			printf("FAIL reader %d saw %d entries out of order\n", i, workers[i].bad);
+			bad = 1;
+		}
+	}
+
+	tid = sllfThreadRegister(l);
+	walk.n = 0;
+	walk.last = -1;
+	walk.bad = 0;
+	for (k = 0; k < LF_KEYS; k++)
+		walk.seen[k] = 0;
+	sllfForRange(l, tid, -1.0, LF_KEYS, visit, &walk);
+	for (k = 0; k < LF_KEYS; k++) {
+		long net = inserted[k] - deleted[k];
+		int in = sllfContains(l, tid, LF_UDATA(k), LF_SCORE(k));
+		if (net != 0 && net != 1) {
+			printf("FAIL key %d inserted %ld deleted %ld\n", k, inserted[k], deleted[k]);
+			bad = 1;
+		}
+		if (in != (net == 1) || walk.seen[k] != (net == 1)) {
+			printf("FAIL key %d net %ld, contains %d, walked %d\n", k, net, in, walk.seen[k]);
+			bad = 1;
+		}
+		members += net;
+	}
+	if (walk.bad != 0 || walk.n != members || sllfGetSize(l) != (unsigned long)members) {
+		printf("FAIL walk %d (%d out of order), size %lu, members %ld\n",
+		       walk.n, walk.bad, sllfGetSize(l), members);
+		bad = 1;
+	}
+	sllfThreadUnregister(l, tid);
+	sllfFree(l);
+
+	for (k = 0; k < LF_KEYS; k++) {
+		if (freed[k] != inserted[k] - popped[k]) {
+			printf("FAIL key %d freed %ld, inserted %ld, popped %ld\n",
+			       k, freed[k], inserted[k], popped[k]);
+			bad = 1;
+		}
+	}
+	if (bad)
+		return 1;
+	printf("sllf ok, %d writers and %d readers, %ld members\n", LF_WRITERS, LF_READERS, members);
+	return 0;
+}
@@ -1,60 +1,1109 @@
+/**
+ * benchmark harness
+ *
+ * prefill a structure with -n members, then run -o operations drawn from
+ * the -m mix, timing every operation; one csv row per (impl, op) with
+ * throughput, latency percentiles and the bytes the impl holds after the
+ * run is written to stdout.
+ *
+ * usage: test/test [-n size] [-o ops] [-d uniform|zipf|seq]
+ *                  [-m op[:weight],...] [-i skiplist,array,rbtree,det,frozen,buffered,multi,embedded,lazy]
+ *                  [-r range] [-S seed] [-H]
+ *
+ * det is the skiplist in deterministic mode (slSetDeterministic), compare
+ * its p999/max with skiplist under delete churn, e.g.
+ * -m insert:4,delete:4,rank_of:2 -i skiplist,det; its bytes show the
+ * price, every node carries the full det levels
+ *
+ * frozen is the skiplist read through slFreeze, refrozen on the first
+ * query after a change; the refreeze is its own refresh row, the query
+ * rows time only the reads, for mixes like -m rank_of:1,score_range:1
+ *
+ * buffered is the skiplist behind a slwb_t write buffer, try it with
+ * -d zipf -m update:9,rank_of:1 to see hot-key updates coalesced
+ *
+ * multi is the skiplist as the score index of slmi_t entries with two
+ * more indices, the cost of keeping them in step on every write
+ *
+ * embedded is the skiplist with nodes inside of the member structs
+ * (slSetEmbedded), comp reads the member id next to the links
+ *
+ * lazy is the skiplist with slSetLazySpans, for write-heavy mixes with
+ * rare rank reads like -m insert:5,delete:5,rank_of:1
+ *
+ * ops: insert update delete rank_of get_by_rank score_range rank_range
+ */
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
 #include "../src/skiplist.h"
+#include "../src/slbuffer.h"
+#include "../src/slfreeze.h"
+#include "../src/slmulti.h"
+#include "baseline.h"
+
+#define SCORE_MAX 1e6
+#define ZIPF_S 0.99
+
+enum benchOp_e {
+	OP_INSERT = 0,
+	OP_UPDATE,
+	OP_DELETE,
+	OP_RANK_OF,
+	OP_GET_BY_RANK,
+	OP_SCORE_RANGE,
+	OP_RANK_RANGE,
+	OP_MAX,
+	/* not in a mix, the refresh before a read, timed apart from it */
+	OP_REFRESH = OP_MAX,
+	OP_ROWS
+};
+
+static const char *opNames[OP_ROWS] = {
+	"insert", "update", "delete", "rank_of",
+	"get_by_rank", "score_range", "rank_range", "refresh",
+};
+
+enum benchDist_e {
+	DIST_UNIFORM = 0,
+	DIST_ZIPF,
+	DIST_SEQ
+};
+
+static const char *distNames[] = {"uniform", "zipf", "seq"};
+
+typedef struct member_s {
+	double score;
+	int present;
+} member_t;
+
+/**
+ * one structure under test, members are ordered by (score, id)
+ */
+typedef struct benchImpl_s {
+	const char *name;
+	void *(*create)(int cap);
+	void (*destroy)(void *ud);
+	/* bulk load members [0, n), not timed */
+	void (*prefill)(void *ud, member_t *members, int n);
+	void (*insert)(void *ud, int id, double score);
+	void (*remove)(void *ud, int id, double score);
+	/* NULL for remove + insert */
+	void (*update)(void *ud, int id, double oldScore, double score);
+	int (*rankOf)(void *ud, int id, double score);
+	double (*byRank)(void *ud, int rank);
+	double (*scoreRange)(void *ud, double min, double max);
+	double (*rankRange)(void *ud, int rankMin, int rankMax);
+	int (*size)(void *ud);
+	/* NULL if reads need no preparing, else return 1 if it did work */
+	int (*refresh)(void *ud);
+	/* memory held for the members, id lookup tables not included */
+	size_t (*bytes)(void *ud);
+} benchImpl_t;
+
+typedef struct benchConf_s {
+	int size;
+	int ops;
+	int dist;
+	int range;
+	unsigned int seed;
+	int header;
+	int weights[OP_MAX];
+	char impls[256];
+} benchConf_t;
 
-#include <sys/time.h>
+static unsigned int rngState = 2463534242u;
 
-double timenow()
+static unsigned int rngNext(void)
 {
-	struct timeval tm;
-	gettimeofday(&tm, NULL);
-	return tm.tv_sec * 1.0 + tm.tv_usec * 1e-6;
+	unsigned int x = rngState;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return rngState = x;
 }
 
-int main(int argc, char **argv)
+/* [0, 1) */
+static double rngDouble(void)
+{
+	return (rngNext() >> 8) * (1.0 / 16777216.0) + (rngNext() >> 8) * (1.0 / 16777216.0 / 16777216.0);
+}
+
+static double timenow(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* members and key distribution shared by every impl */
+static member_t *members;
+static int memberCap;
+static int memberNext;
+static double *zipfCdf;
+static double seqScore;
+
+static void zipfInit(int n)
 {
 	int i;
-	slNode_t *pNode;
-	sl_t *sl = slCreate();
-	int totalSize = 1000000;
+	double sum = 0.0;
+	zipfCdf = malloc(sizeof(double) * n);
+	for (i = 0; i < n; i++) {
+		sum += 1.0 / pow(i + 1, ZIPF_S);
+		zipfCdf[i] = sum;
+	}
+	for (i = 0; i < n; i++)
+		zipfCdf[i] /= sum;
+}
+
+static int zipfNext(int n)
+{
+	double u = rngDouble();
+	int lo = 0;
+	int hi = n - 1;
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		if (zipfCdf[mid] < u)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
 
-	double s;
-	s = timenow();
-	for (i = 0; i < totalSize; i++) {
-		slNode_t *p = slCreateNode(slRandomLevel(), NULL, rand() % 10000000 * 0.01);
-		slInsertNode(sl, p, NULL);
+static double nextScore(int dist)
+{
+	if (dist == DIST_SEQ)
+		return seqScore += 1.0;
+	return rngDouble() * SCORE_MAX;
+}
+
+/* a present member picked by dist, -1 if none */
+static int pickMember(int dist, int n)
+{
+	int i;
+	int id;
+	if (n <= 0)
+		return -1;
+	switch (dist) {
+	case DIST_ZIPF:
+		/* hot players are scattered over ids */
+		id = (int)(((unsigned int)zipfNext(n) * 2654435761u) % (unsigned int)n);
+		break;
+	case DIST_SEQ:
+		id = memberNext % n;
+		memberNext++;
+		break;
+	default:
+		id = (int)(rngNext() % (unsigned int)n);
+		break;
 	}
-	printf("insert %d time=%f\n", totalSize, timenow() - s);
-	printf("size of node %lu\n", sizeof(*pNode));
-	printf("sl size=%d\n", slGetSize(sl));
-	SL_FOREACH_RANGE(sl, 1, 4, pNode, i) {
-		printf("i=%d, p=%p %lf\n", i, (void *)pNode, pNode->score);
+	for (i = 0; i < n; i++) {
+		int j = (id + i) % n;
+		if (members[j].present)
+			return j;
 	}
+	return -1;
+}
+
+/* skiplist */
+typedef struct slBench_s {
+	sl_t *sl;
+	slNode_t **nodes;
+	int level;		/* of new nodes, 0 for slRandomLevel */
+} slBench_t;
+
+static void *slbCreate(int cap)
+{
+	slBench_t *b = malloc(sizeof(*b));
+	b->sl = slCreate();
+	b->nodes = calloc(cap, sizeof(slNode_t *));
+	b->level = 0;
+	return b;
+}
+
+/* deterministic mode, nodes with the levels cap members need */
+static void *detCreate(int cap)
+{
+	slBench_t *b = slbCreate(cap);
+	for (b->level = 2; b->level < SKIPLIST_MAXLEVEL && (1L << (b->level - 1)) < cap; b->level++)
+		;
+	slSetDeterministic(b->sl, b->level);
+	return b;
+}
+
+/* lazy spans, fixed by the first rank read after writes */
+static void *lazyCreate(int cap)
+{
+	slBench_t *b = slbCreate(cap);
+	slSetLazySpans(b->sl, 1);
+	return b;
+}
+
+/**
+ * members embedded with their node, comp orders equal scores by the id
+ * stored next to the links instead of by the udata pointer
+ */
+typedef struct embMember_s {
+	int id;
+	slNode_t node;		/* keep it last, the tower follows */
+} embMember_t;
+
+static int embComp(slNode_t *nodeA, slNode_t *nodeB, sl_t *sl, void *ctx)
+{
+	int a = SL_CONTAINER_OF(nodeA, embMember_t, node)->id;
+	int b = SL_CONTAINER_OF(nodeB, embMember_t, node)->id;
+	(void)sl;
+	(void)ctx;
+	if (nodeA->score != nodeB->score)
+		return nodeA->score < nodeB->score ? -1 : 1;
+	return a == b ? 0 : (a < b ? -1 : 1);
+}
+
+static void *embCreate(int cap)
+{
+	slBench_t *b = slbCreate(cap);
+	slSetEmbedded(b->sl, 1);
+	slSetCompareCb(b->sl, embComp);
+	return b;
+}
+
+static void embInsert(void *ud, int id, double score)
+{
+	slBench_t *b = ud;
+	embMember_t *m = SL_CREATE_EMBEDDED(b->sl, embMember_t, node, slRandomLevel(), score);
+	m->id = id;
+	b->nodes[id] = &m->node;
+	slInsertNode(b->sl, &m->node, NULL);
+}
+
+static void embPrefill(void *ud, member_t *m, int n)
+{
+	int i;
+	for (i = 0; i < n; i++)
+		embInsert(ud, i, m[i].score);
+}
+
+static void slbDestroy(void *ud)
+{
+	slBench_t *b = ud;
+	slFree(b->sl, NULL, NULL);
+	free(b->nodes);
+	free(b);
+}
+
+static void slbInsert(void *ud, int id, double score)
+{
+	slBench_t *b = ud;
+	/* udata orders equal scores by id, see internalComp */
+	slNode_t *node = slCreateNode(b->level > 0 ? b->level : slRandomLevel(), &members[id], score);
+	b->nodes[id] = node;
+	slInsertNode(b->sl, node, NULL);
+}
+
+static void slbPrefill(void *ud, member_t *m, int n)
+{
+	int i;
+	for (i = 0; i < n; i++)
+		slbInsert(ud, i, m[i].score);
+}
+
+static void slbRemove(void *ud, int id, double score)
+{
+	slBench_t *b = ud;
+	(void)score;
+	slDeleteNode(b->sl, b->nodes[id], NULL, NULL);
+	b->nodes[id] = NULL;
+}
+
+static int slbRankOf(void *ud, int id, double score)
+{
+	slBench_t *b = ud;
+	(void)score;
+	return slGetRank(b->sl, b->nodes[id], NULL);
+}
+
+static double slbByRank(void *ud, int rank)
+{
+	slBench_t *b = ud;
+	slNode_t *node = slGetNodeByRank(b->sl, rank);
+	return node == NULL ? 0.0 : node->score;
+}
 
-	pNode = slGetNodeByRank(sl, 2);
-	printf("to delete i=2, p=%p %lf\n", (void *)pNode, pNode->score);
-	printf("rank = %d\n", slGetRank(sl, pNode, NULL));
-	slDeleteNode(sl, pNode, NULL, NULL);
-	SL_FOREACH_RANGE(sl, 1, 5, pNode, i) {
-		printf("i=%d, p=%p %lf\n", i, (void *)pNode, pNode->score);
+static double slbScoreRange(void *ud, double min, double max)
+{
+	slBench_t *b = ud;
+	double sum = 0.0;
+	slNode_t *node;
+	for (node = slFirstGEThan(b->sl, min);
+	     node != NULL && node->score <= max;
+	     node = SL_NEXT(node))
+		sum += node->score;
+	return sum;
+}
+
+static double slbRankRange(void *ud, int rankMin, int rankMax)
+{
+	slBench_t *b = ud;
+	double sum = 0.0;
+	slNode_t *node;
+	int n;
+	SL_FOREACH_RANGE(b->sl, rankMin, rankMax, node, n) {
+		sum += node->score;
 	}
+	return sum;
+}
+
+static int slbSize(void *ud)
+{
+	slBench_t *b = ud;
+	return slGetSize(b->sl);
+}
+
+static size_t slbBytes(void *ud)
+{
+	slBench_t *b = ud;
+	struct slStats_s st;
+	slGetStats(b->sl, &st);
+	return st.nodeBytes + st.towerBytes;
+}
+
+/* skiplist behind a write buffer */
+#define WB_THRESHOLD 1024
+
+typedef struct wbBench_s {
+	slBench_t base;		/* keep it first, slb* take it */
+	slwb_t wb;
+} wbBench_t;
+
+static void *wbbCreate(int cap)
+{
+	wbBench_t *b = malloc(sizeof(*b));
+	b->base.sl = slCreate();
+	b->base.nodes = calloc(cap, sizeof(slNode_t *));
+	b->base.level = 0;
+	slwbInit(&b->wb, b->base.sl, WB_THRESHOLD, 0.0);
+	return b;
+}
+
+static void wbbDestroy(void *ud)
+{
+	wbBench_t *b = ud;
+	slwbDestroy(&b->wb, NULL);
+	slFree(b->base.sl, NULL, NULL);
+	free(b->base.nodes);
+	free(b);
+}
+
+static void wbbRemove(void *ud, int id, double score)
+{
+	wbBench_t *b = ud;
+	(void)score;
+	slwbDelete(&b->wb, b->base.nodes[id], NULL, NULL);
+	b->base.nodes[id] = NULL;
+}
+
+static void wbbUpdate(void *ud, int id, double oldScore, double score)
+{
+	wbBench_t *b = ud;
+	(void)oldScore;
+	slwbUpdate(&b->wb, b->base.nodes[id], score, NULL);
+}
+
+static int wbbRankOf(void *ud, int id, double score)
+{
+	wbBench_t *b = ud;
+	(void)score;
+	return slwbGetRank(&b->wb, b->base.nodes[id], NULL);
+}
+
+static double wbbByRank(void *ud, int rank)
+{
+	wbBench_t *b = ud;
+	slNode_t *node = slwbGetNodeByRank(&b->wb, rank, NULL);
+	return node == NULL ? 0.0 : node->score;
+}
+
+static double wbbScoreRange(void *ud, double min, double max)
+{
+	slwbFlush(&((wbBench_t *)ud)->wb, NULL);
+	return slbScoreRange(ud, min, max);
+}
+
+static double wbbRankRange(void *ud, int rankMin, int rankMax)
+{
+	slwbFlush(&((wbBench_t *)ud)->wb, NULL);
+	return slbRankRange(ud, rankMin, rankMax);
+}
+
+static size_t wbbBytes(void *ud)
+{
+	wbBench_t *b = ud;
+	return slbBytes(ud) + b->wb.cap * sizeof(struct slwbEntry_s);
+}
+
+/* skiplist, queries read a frozen copy taken after the last change */
+typedef struct fzBench_s {
+	slBench_t base;		/* keep it first, slb* take it */
+	slfz_t *fz;
+} fzBench_t;
+
+static void *fzbCreate(int cap)
+{
+	fzBench_t *b = malloc(sizeof(*b));
+	b->base.sl = slCreate();
+	b->base.nodes = calloc(cap, sizeof(slNode_t *));
+	b->base.level = 0;
+	b->fz = NULL;
+	return b;
+}
+
+static void fzbDestroy(void *ud)
+{
+	fzBench_t *b = ud;
+	slfzFree(b->fz);
+	slFree(b->base.sl, NULL, NULL);
+	free(b->base.nodes);
+	free(b);
+}
+
+/* refreeze after a change, the bench times it as its own row */
+static int fzbRefresh(void *ud)
+{
+	fzBench_t *b = ud;
+	if (b->fz != NULL && slfzIsCurrent(b->fz, b->base.sl))
+		return 0;
+	slfzFree(b->fz);
+	b->fz = slFreeze(b->base.sl);
+	return 1;
+}
+
+static int fzbRankOf(void *ud, int id, double score)
+{
+	return slfzGetRank(((fzBench_t *)ud)->fz, &members[id], score);
+}
+
+static double fzbByRank(void *ud, int rank)
+{
+	double score = 0.0;
+	slfzGetByRank(((fzBench_t *)ud)->fz, rank, NULL, &score);
+	return score;
+}
+
+static double fzbScoreRange(void *ud, double min, double max)
+{
+	slfz_t *fz = ((fzBench_t *)ud)->fz;
+	double sum = 0.0;
+	int i;
+	for (i = slfzLowerBound(fz, min) - 1; i < (int)fz->size && fz->scores[i] <= max; i++)
+		sum += fz->scores[i];
+	return sum;
+}
+
+static double fzbRankRange(void *ud, int rankMin, int rankMax)
+{
+	slfz_t *fz = ((fzBench_t *)ud)->fz;
+	double sum = 0.0;
+	int i;
+	for (i = rankMin - 1; i < rankMax && i < (int)fz->size; i++)
+		sum += fz->scores[i];
+	return sum;
+}
+
+/* the list and its frozen copy */
+static size_t fzbBytes(void *ud)
+{
+	fzBench_t *b = ud;
+	return slbBytes(ud) + (b->fz != NULL ? b->fz->hdr->blobSize : 0);
+}
+
+/**
+ * skiplist entries with two more indices in the same allocation, by id
+ * (like a player level) and by last change (like last-active time);
+ * queries read the score index
+ */
+#define MB_INDICES 3
 
-	s = timenow();
-	slDeleteByRankRange(sl, 1, 10000, NULL, NULL);
-	printf("delete [1, 10000] time=%f\n", timenow() - s);
+typedef struct mBench_s {
+	slBench_t base;		/* keep it first, slb* read the score index */
+	slmi_t m;
+	slmiEntry_t **entries;
+	double tick;
+} mBench_t;
 
-	s = timenow();
-	for (i = 0; i < 10000; i++) {
-		int rank = rand() % totalSize;
-		slGetNodeByRank(sl, rank);
+/* order equal scores by id like slbInsert, udata of a tower is its entry */
+static int mbComp(slNode_t *nodeA, slNode_t *nodeB, sl_t *sl, void *ctx)
+{
+	const char *a = SLMI_ENTRY(nodeA)->udata;
+	const char *b = SLMI_ENTRY(nodeB)->udata;
+	(void)sl;
+	(void)ctx;
+	if (nodeA->score != nodeB->score)
+		return nodeA->score < nodeB->score ? -1 : 1;
+	return a == b ? 0 : (a < b ? -1 : 1);
+}
+
+static void *mbCreate(int cap)
+{
+	mBench_t *b = malloc(sizeof(*b));
+	slmiInit(&b->m, MB_INDICES);
+	slSetCompareCb(SLMI_INDEX(&b->m, 0), mbComp);
+	b->base.sl = SLMI_INDEX(&b->m, 0);
+	b->base.nodes = NULL;
+	b->base.level = 0;
+	b->entries = calloc(cap, sizeof(slmiEntry_t *));
+	b->tick = 0.0;
+	return b;
+}
+
+static void mbDestroy(void *ud)
+{
+	mBench_t *b = ud;
+	slmiDestroy(&b->m, NULL, NULL);
+	free(b->entries);
+	free(b);
+}
+
+static void mbInsert(void *ud, int id, double score)
+{
+	mBench_t *b = ud;
+	double scores[MB_INDICES];
+	scores[0] = score;
+	scores[1] = id;
+	scores[2] = b->tick += 1.0;
+	b->entries[id] = slmiCreateEntry(&b->m, &members[id], scores);
+	slmiInsert(&b->m, b->entries[id], NULL);
+}
+
+static void mbPrefill(void *ud, member_t *m, int n)
+{
+	int i;
+	for (i = 0; i < n; i++)
+		mbInsert(ud, i, m[i].score);
+}
+
+static void mbRemove(void *ud, int id, double score)
+{
+	mBench_t *b = ud;
+	(void)score;
+	slmiDelete(&b->m, b->entries[id], NULL, NULL);
+	b->entries[id] = NULL;
+}
+
+static void mbUpdate(void *ud, int id, double oldScore, double score)
+{
+	mBench_t *b = ud;
+	double scores[MB_INDICES];
+	(void)oldScore;
+	scores[0] = score;
+	scores[1] = id;
+	scores[2] = b->tick += 1.0;
+	slmiUpdate(&b->m, b->entries[id], scores, NULL);
+}
+
+static int mbRankOf(void *ud, int id, double score)
+{
+	mBench_t *b = ud;
+	(void)score;
+	return slmiGetRank(&b->m, b->entries[id], 0, NULL);
+}
+
+/* every tower of an entry, plus its header */
+static size_t mbBytes(void *ud)
+{
+	mBench_t *b = ud;
+	struct slStats_s st;
+	size_t bytes = slGetSize(b->base.sl) * sizeof(slmiEntry_t);
+	int i;
+	for (i = 0; i < MB_INDICES; i++) {
+		slGetStats(SLMI_INDEX(&b->m, i), &st);
+		bytes += st.nodeBytes + st.towerBytes;
+	}
+	return bytes;
+}
+
+/* sorted array */
+static void *saCreate(int cap)
+{
+	sortedArray_t *sa = malloc(sizeof(*sa));
+	saInit(sa, cap);
+	return sa;
+}
+
+static void saBenchDestroy(void *ud)
+{
+	saDestroy(ud);
+	free(ud);
+}
+
+static void saPrefill(void *ud, member_t *m, int n)
+{
+	sortedArray_t *sa = ud;
+	int i;
+	for (i = 0; i < n; i++) {
+		sa->arr[i].score = m[i].score;
+		sa->arr[i].id = i;
 	}
-	printf("random slGetNodeByRank [1, 10000] time=%f\n", timenow() - s);
+	saBuild(sa, n);
+}
+
+static void saBenchInsert(void *ud, int id, double score)
+{
+	saInsert(ud, score, id);
+}
+
+static void saBenchRemove(void *ud, int id, double score)
+{
+	saDelete(ud, score, id);
+}
+
+static int saRankOf(void *ud, int id, double score)
+{
+	return saRank(ud, score, id);
+}
+
+static double saByRank(void *ud, int rank)
+{
+	sortedArray_t *sa = ud;
+	return (rank < 1 || rank > sa->size) ? 0.0 : sa->arr[rank - 1].score;
+}
+
+static double saScoreRange(void *ud, double min, double max)
+{
+	sortedArray_t *sa = ud;
+	double sum = 0.0;
+	int i;
+	for (i = saFirstGE(sa, min); i < sa->size && sa->arr[i].score <= max; i++)
+		sum += sa->arr[i].score;
+	return sum;
+}
+
+static double saRankRange(void *ud, int rankMin, int rankMax)
+{
+	sortedArray_t *sa = ud;
+	double sum = 0.0;
+	int i;
+	for (i = rankMin - 1; i < rankMax && i < sa->size; i++)
+		sum += sa->arr[i].score;
+	return sum;
+}
+
+static int saSize(void *ud)
+{
+	return ((sortedArray_t *)ud)->size;
+}
+
+static size_t saBytes(void *ud)
+{
+	return ((sortedArray_t *)ud)->cap * sizeof(saEntry_t);
+}
+
+/* red-black tree */
+typedef struct rbBench_s {
+	rbTree_t tree;
+	rbNode_t **nodes;
+} rbBench_t;
+
+static void *rbbCreate(int cap)
+{
+	rbBench_t *b = malloc(sizeof(*b));
+	rbInit(&b->tree);
+	b->nodes = calloc(cap, sizeof(rbNode_t *));
+	return b;
+}
+
+static void rbbDestroy(void *ud)
+{
+	rbBench_t *b = ud;
+	int i;
+	for (i = 0; i < memberCap; i++)
+		free(b->nodes[i]);
+	free(b->nodes);
+	free(b);
+}
+
+static void rbbInsert(void *ud, int id, double score)
+{
+	rbBench_t *b = ud;
+	rbNode_t *node = malloc(sizeof(*node));
+	node->score = score;
+	node->id = id;
+	b->nodes[id] = node;
+	rbInsert(&b->tree, node);
+}
+
+static void rbbPrefill(void *ud, member_t *m, int n)
+{
+	int i;
+	for (i = 0; i < n; i++)
+		rbbInsert(ud, i, m[i].score);
+}
+
+static void rbbRemove(void *ud, int id, double score)
+{
+	rbBench_t *b = ud;
+	(void)score;
+	rbDelete(&b->tree, b->nodes[id]);
+	free(b->nodes[id]);
+	b->nodes[id] = NULL;
+}
+
+static int rbbRankOf(void *ud, int id, double score)
+{
+	rbBench_t *b = ud;
+	(void)score;
+	return rbRank(&b->tree, b->nodes[id]);
+}
+
+static double rbbByRank(void *ud, int rank)
+{
+	rbBench_t *b = ud;
+	rbNode_t *node = rbByRank(&b->tree, rank);
+	return node == NULL ? 0.0 : node->score;
+}
+
+static double rbbScoreRange(void *ud, double min, double max)
+{
+	rbBench_t *b = ud;
+	double sum = 0.0;
+	rbNode_t *node;
+	for (node = rbFirstGE(&b->tree, min, NULL);
+	     node != NULL && node->score <= max;
+	     node = rbNext(&b->tree, node))
+		sum += node->score;
+	return sum;
+}
+
+static double rbbRankRange(void *ud, int rankMin, int rankMax)
+{
+	rbBench_t *b = ud;
+	double sum = 0.0;
+	rbNode_t *node;
+	int n;
+	for (node = rbByRank(&b->tree, rankMin), n = rankMin;
+	     node != NULL && n <= rankMax;
+	     node = rbNext(&b->tree, node), n++)
+		sum += node->score;
+	return sum;
+}
+
+static int rbbSize(void *ud)
+{
+	return (int)((rbBench_t *)ud)->tree.root->size;
+}
+
+static size_t rbbBytes(void *ud)
+{
+	return ((rbBench_t *)ud)->tree.root->size * sizeof(rbNode_t);
+}
+
+static benchImpl_t impls[] = {
+	{"skiplist", slbCreate, slbDestroy, slbPrefill, slbInsert, slbRemove, NULL,
+	 slbRankOf, slbByRank, slbScoreRange, slbRankRange, slbSize, NULL, slbBytes},
+	{"array", saCreate, saBenchDestroy, saPrefill, saBenchInsert, saBenchRemove, NULL,
+	 saRankOf, saByRank, saScoreRange, saRankRange, saSize, NULL, saBytes},
+	{"rbtree", rbbCreate, rbbDestroy, rbbPrefill, rbbInsert, rbbRemove, NULL,
+	 rbbRankOf, rbbByRank, rbbScoreRange, rbbRankRange, rbbSize, NULL, rbbBytes},
+	{"det", detCreate, slbDestroy, slbPrefill, slbInsert, slbRemove, NULL,
+	 slbRankOf, slbByRank, slbScoreRange, slbRankRange, slbSize, NULL, slbBytes},
+	{"frozen", fzbCreate, fzbDestroy, slbPrefill, slbInsert, slbRemove, NULL,
+	 fzbRankOf, fzbByRank, fzbScoreRange, fzbRankRange, slbSize, fzbRefresh, fzbBytes},
+	{"buffered", wbbCreate, wbbDestroy, slbPrefill, slbInsert, wbbRemove, wbbUpdate,
+	 wbbRankOf, wbbByRank, wbbScoreRange, wbbRankRange, slbSize, NULL, wbbBytes},
+	{"lazy", lazyCreate, slbDestroy, slbPrefill, slbInsert, slbRemove, NULL,
+	 slbRankOf, slbByRank, slbScoreRange, slbRankRange, slbSize, NULL, slbBytes},
+	{"embedded", embCreate, slbDestroy, embPrefill, embInsert, slbRemove, NULL,
+	 slbRankOf, slbByRank, slbScoreRange, slbRankRange, slbSize, NULL, slbBytes},
+	{"multi", mbCreate, mbDestroy, mbPrefill, mbInsert, mbRemove, mbUpdate,
+	 mbRankOf, slbByRank, slbScoreRange, slbRankRange, slbSize, NULL, mbBytes},
+};
+
+static int doubleComp(const void *a, const void *b)
+{
+	double da = *(const double *)a;
+	double db = *(const double *)b;
+	return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+static double percentile(double *sorted, int n, double p)
+{
+	int i;
+	if (n == 0)
+		return 0.0;
+	i = (int)(p * n);
+	return sorted[i >= n ? n - 1 : i];
+}
+
+static int pickOp(const benchConf_t *conf, int totalWeight)
+{
+	int i;
+	int w = (int)(rngNext() % (unsigned int)totalWeight);
+	for (i = 0; i < OP_MAX; i++) {
+		if (w < conf->weights[i])
+			return i;
+		w -= conf->weights[i];
+	}
+	return OP_MAX - 1;
+}
+
+static void runImpl(const benchConf_t *conf, const benchImpl_t *impl)
+{
+	int i;
+	int totalWeight = 0;
+	int cnt[OP_ROWS];
+	double *lat[OP_ROWS];
+	double total[OP_ROWS];
+	double sink = 0.0;
+	size_t bytes;
+	void *ud;
+
+	/* same members and op sequence for every impl */
+	rngState = conf->seed;
+	memberNext = 0;
+	seqScore = 0.0;
+	for (i = 0; i < memberCap; i++) {
+		members[i].present = i < conf->size;
+		members[i].score = i < conf->size ? nextScore(conf->dist) : 0.0;
+	}
+	for (i = 0; i < OP_ROWS; i++) {
+		totalWeight += i < OP_MAX ? conf->weights[i] : 0;
+		cnt[i] = 0;
+		total[i] = 0.0;
+		lat[i] = malloc(sizeof(double) * (conf->ops > 0 ? conf->ops : 1));
+	}
+
+	ud = impl->create(memberCap);
+	impl->prefill(ud, members, conf->size);
+
+	for (i = 0; i < conf->ops; i++) {
+		int op = pickOp(conf, totalWeight);
+		int live = impl->size(ud);
+		int id = -1;
+		int rank;
+		double score = 0.0;
+		double s;
+		double e;
+
+		/* draw arguments outside of the timed region */
+		switch (op) {
+		case OP_INSERT:
+			if (conf->size + i >= memberCap)
+				continue;
+			id = conf->size + i;
+			score = nextScore(conf->dist);
+			break;
+		case OP_UPDATE:
+		case OP_DELETE:
+		case OP_RANK_OF:
+			if ((id = pickMember(conf->dist, memberCap)) < 0)
+				continue;
+			score = op == OP_UPDATE ? nextScore(conf->dist) : members[id].score;
+			break;
+		default:
+			if (live <= 0)
+				continue;
+			break;
+		}
+		rank = live > 0 ? (int)(rngNext() % (unsigned int)live) + 1 : 0;
+
+		if (op >= OP_RANK_OF && impl->refresh != NULL) {
+			s = timenow();
+			if (impl->refresh(ud)) {
+				e = timenow();
+				lat[OP_REFRESH][cnt[OP_REFRESH]++] = e - s;
+				total[OP_REFRESH] += e - s;
+			}
+		}
+
+		s = timenow();
+		switch (op) {
+		case OP_INSERT:
+			impl->insert(ud, id, score);
+			break;
+		case OP_UPDATE:
+			if (impl->update != NULL) {
+				impl->update(ud, id, members[id].score, score);
+			} else {
+				impl->remove(ud, id, members[id].score);
+				impl->insert(ud, id, score);
+			}
+			members[id].score = score;
+			break;
+		case OP_DELETE:
+			impl->remove(ud, id, score);
+			break;
+		case OP_RANK_OF:
+			sink += impl->rankOf(ud, id, score);
+			break;
+		case OP_GET_BY_RANK:
+			sink += impl->byRank(ud, rank);
+			break;
+		case OP_SCORE_RANGE:
+			score = rngDouble() * SCORE_MAX;
+			sink += impl->scoreRange(ud, score, score + SCORE_MAX * conf->range / (live + 1));
+			break;
+		case OP_RANK_RANGE:
+			sink += impl->rankRange(ud, rank, rank + conf->range - 1);
+			break;
+		}
+		e = timenow();
+
+		if (op == OP_INSERT) {
+			members[id].score = score;
+			members[id].present = 1;
+		} else if (op == OP_DELETE) {
+			members[id].present = 0;
+		}
+		lat[op][cnt[op]++] = e - s;
+		total[op] += e - s;
+	}
+
+	bytes = impl->bytes(ud);
+	for (i = 0; i < OP_ROWS; i++) {
+		if (cnt[i] == 0)
+			continue;
+		qsort(lat[i], cnt[i], sizeof(double), doubleComp);
+		printf("%s,%s,%d,%s,%d,%.0f,%.0f,%.0f,%.0f,%.0f,%lu\n",
+		       impl->name, distNames[conf->dist], conf->size, opNames[i], cnt[i],
+		       total[i] > 0.0 ? cnt[i] * 1e9 / total[i] : 0.0,
+		       percentile(lat[i], cnt[i], 0.50),
+		       percentile(lat[i], cnt[i], 0.99),
+		       percentile(lat[i], cnt[i], 0.999),
+		       lat[i][cnt[i] - 1], (unsigned long)bytes);
+		free(lat[i]);
+	}
+	for (i = 0; i < OP_ROWS; i++) {
+		if (cnt[i] == 0)
+			free(lat[i]);
+	}
+	impl->destroy(ud);
+	if (sink == 42.0)
+		fprintf(stderr, "\n");
+}
+
+static int parseMix(benchConf_t *conf, const char *arg)
+{
+	char buf[256];
+	char *tok;
+	int total = 0;
+	memset(conf->weights, 0, sizeof(conf->weights));
+	strncpy(buf, arg, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = '\0';
+	for (tok = strtok(buf, ","); tok != NULL; tok = strtok(NULL, ",")) {
+		int i;
+		int w = 1;
+		char *colon = strchr(tok, ':');
+		if (colon != NULL) {
+			*colon = '\0';
+			w = atoi(colon + 1);
+		}
+		for (i = 0; i < OP_MAX; i++) {
+			if (strcmp(tok, opNames[i]) == 0)
+				break;
+		}
+		if (i == OP_MAX || w < 0) {
+			fprintf(stderr, "unknown op %s\n", tok);
+			return -1;
+		}
+		conf->weights[i] += w;
+		total += w;
+	}
+	return total > 0 ? 0 : -1;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-n size] [-o ops] [-d uniform|zipf|seq]\n"
+		"          [-m op[:weight],...] [-i skiplist,array,rbtree,det,frozen,buffered,multi,embedded,lazy]\n"
+		"          [-r range] [-S seed] [-H]\n"
+		"ops: insert update delete rank_of get_by_rank score_range rank_range\n",
+		prog);
+}
+
+int main(int argc, char **argv)
+{
+	int i;
+	int c;
+	benchConf_t conf;
+
+	conf.size = 100000;
+	conf.ops = 10000;
+	conf.dist = DIST_UNIFORM;
+	conf.range = 50;
+	conf.seed = 2463534242u;
+	conf.header = 1;
+	strcpy(conf.impls, "skiplist,array,rbtree");
+	parseMix(&conf, "insert,update,delete,rank_of,get_by_rank,score_range,rank_range");
+
+	while ((c = getopt(argc, argv, "n:o:d:m:i:r:S:Hh")) != -1) {
+		switch (c) {
+		case 'n':
+			conf.size = atoi(optarg);
+			break;
+		case 'o':
+			conf.ops = atoi(optarg);
+			break;
+		case 'd':
+			for (i = 0; i < 3; i++) {
+				if (strcmp(optarg, distNames[i]) == 0)
+					conf.dist = i;
+			}
+			break;
+		case 'm':
+			if (parseMix(&conf, optarg) != 0) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'i':
+			strncpy(conf.impls, optarg, sizeof(conf.impls) - 1);
+			conf.impls[sizeof(conf.impls) - 1] = '\0';
+			break;
+		case 'r':
+			conf.range = atoi(optarg);
+			break;
+		case 'S':
+			conf.seed = (unsigned int)strtoul(optarg, NULL, 10);
+			if (conf.seed == 0)
+				conf.seed = 1;
+			break;
+		case 'H':
+			conf.header = 0;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (conf.size < 0 || conf.ops < 0 || conf.range <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	memberCap = conf.size + conf.ops;
+	members = calloc(memberCap > 0 ? memberCap : 1, sizeof(member_t));
+	zipfInit(memberCap > 0 ? memberCap : 1);
 
-	printf("after delete rank range[2, 3]\n");
-	printf("sl size=%d\n", slGetSize(sl));
-	SL_FOREACH_RANGE(sl, 1, 5, pNode, i) {
-		printf("i=%d, p=%p %lf\n", i, (void *)pNode, pNode->score);
+	if (conf.header)
+		printf("impl,dist,size,op,count,ops_per_sec,p50_ns,p99_ns,p999_ns,max_ns,bytes\n");
+	for (i = 0; i < (int)(sizeof(impls) / sizeof(impls[0])); i++) {
+		char buf[256];
+		char *tok;
+		strcpy(buf, conf.impls);
+		for (tok = strtok(buf, ","); tok != NULL; tok = strtok(NULL, ",")) {
+			if (strcmp(tok, impls[i].name) == 0) {
+				runImpl(&conf, &impls[i]);
+				break;
+			}
+		}
 	}
-	slFree(sl, NULL, NULL);
+	free(zipfCdf);
+	free(members);
 	return 0;
 }
@@ -0,0 +1,531 @@
+/**
+ * multi-threaded scaling benchmark
+ *
+ * runs each workload with 1, 2, 4, ... up to -t threads and writes one
+ * csv row per (workload, impl, threads) with total throughput.
+ *
+ * usage: test/scaling [-t maxThreads] [-n keys] [-o opsPerThread]
+ *                     [-w workload,...] [-H]
+ *
+ * workloads:
+ *	set	20% insert, 20% delete, 60% contains on random keys,
+ *		sllf_t against a sl_t behind a mutex
+ *	shard	random score updates from the same number of producers
+ *		into a sls_t with one shard per thread (update, until flushed),
+ *		then global rank queries from one reader (rank_query)
+ *	build	slBuildParallel of -n unsorted rows (parallel),
+ *		against -n slInsertNode calls on one thread (insert)
+ *	scan	score sum and tier counts over all -n ranks by
+ *		slParallelReduceRange (parallel), against one level-0 walk (walk),
+ *		walks again after -n deletes and inserts (aged) and after
+ *		slCompact passes over it (compact, compacted)
+ *	shm	reader processes (threads is the process count) query ranks
+ *		of a slshm_t in a shared mapping (read), while this process
+ *		keeps updating scores until they are done (write)
+ */
+#define _POSIX_C_SOURCE 200112L
+#define _DEFAULT_SOURCE		/* MAP_ANONYMOUS */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "../src/skiplist.h"
+#include "../src/sllockfree.h"
+#include "../src/slshard.h"
+#include "../src/slbuild.h"
+#include "../src/slparallel.h"
+#include "../src/slshm.h"
+
+typedef struct scalingConf_s {
+	int maxThreads;
+	int keys;
+	int ops;
+	int header;
+	char workloads[256];
+} scalingConf_t;
+
+typedef struct worker_s {
+	pthread_t th;
+	int idx;
+	unsigned int rng;
+	const scalingConf_t *conf;
+	void *ud;
+	double sink;
+} worker_t;
+
+typedef void *(*workerFn)(void *);
+
+static double timenow(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned int rngNext(unsigned int *state)
+{
+	unsigned int x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+/**
+ * start n workers running fn on ud, return seconds until all joined
+ */
+static double runWorkers(const scalingConf_t *conf, int n, workerFn fn, void *ud)
+{
+	int i;
+	double s;
+	worker_t *workers = calloc(n, sizeof(worker_t));
+	s = timenow();
+	for (i = 0; i < n; i++) {
+		workers[i].idx = i;
+		workers[i].rng = 2463534242u + i * 2654435761u;
+		workers[i].conf = conf;
+		workers[i].ud = ud;
+		pthread_create(&workers[i].th, NULL, fn, &workers[i]);
+	}
+	for (i = 0; i < n; i++)
+		pthread_join(workers[i].th, NULL);
+	s = timenow() - s;
+	free(workers);
+	return s;
+}
+
+static void report(const char *workload, const char *impl, int threads, double ops, double secs)
+{
+	printf("%s,%s,%d,%.0f,%.0f\n", workload, impl, threads, ops, secs > 0.0 ? ops / secs : 0.0);
+}
+
+/* set: lock-free */
+static void *setLockFreeWorker(void *arg)
+{
+	worker_t *w = arg;
+	sllf_t *l = w->ud;
+	int tid = sllfThreadRegister(l);
+	int i;
+	for (i = 0; i < w->conf->ops; i++) {
+		unsigned int r = rngNext(&w->rng);
+		size_t key = r % (unsigned int)w->conf->keys + 1;
+		/* keys double as udata, scores tie on purpose now and then */
+		double score = (double)(key / 4);
+		switch ((r >> 24) % 10) {
+		case 0:
+		case 1:
+			sllfInsert(l, tid, (void *)key, score);
+			break;
+		case 2:
+		case 3:
+			sllfDelete(l, tid, (void *)key, score);
+			break;
+		default:
+			w->sink += sllfContains(l, tid, (void *)key, score);
+			break;
+		}
+	}
+	sllfThreadUnregister(l, tid);
+	return NULL;
+}
+
+/* set: sl_t behind one mutex */
+typedef struct lockedSl_s {
+	pthread_mutex_t lock;
+	sl_t *sl;
+	slNode_t **nodes;	/* by key */
+} lockedSl_t;
+
+static void *setLockedWorker(void *arg)
+{
+	worker_t *w = arg;
+	lockedSl_t *ls = w->ud;
+	int i;
+	for (i = 0; i < w->conf->ops; i++) {
+		unsigned int r = rngNext(&w->rng);
+		size_t key = r % (unsigned int)w->conf->keys + 1;
+		double score = (double)(key / 4);
+		slNode_t *node;
+		pthread_mutex_lock(&ls->lock);
+		switch ((r >> 24) % 10) {
+		case 0:
+		case 1:
+			if (ls->nodes[key] == NULL) {
+				node = slCreateNode(slRandomLevel(), (void *)key, score);
+				slInsertNode(ls->sl, node, NULL);
+				ls->nodes[key] = node;
+			}
+			break;
+		case 2:
+		case 3:
+			if (ls->nodes[key] != NULL) {
+				slDeleteNode(ls->sl, ls->nodes[key], NULL, NULL);
+				ls->nodes[key] = NULL;
+			}
+			break;
+		default:
+			/* search like sllfContains would, not the O(1) array lookup */
+			node = slFirstGEThan(ls->sl, score);
+			while (node != NULL && node->score == score && node->udata != (void *)key)
+				node = SL_NEXT(node);
+			w->sink += node != NULL && node->udata == (void *)key;
+			break;
+		}
+		pthread_mutex_unlock(&ls->lock);
+	}
+	return NULL;
+}
+
+static void workloadSet(const scalingConf_t *conf, int threads)
+{
+	int i;
+	double secs;
+	double ops = (double)conf->ops * threads;
+	sllf_t *l = sllfCreate(NULL, NULL);
+	lockedSl_t ls;
+	int tid = sllfThreadRegister(l);
+
+	/* prefill half of the keys */
+	for (i = 1; i <= conf->keys; i += 2)
+		sllfInsert(l, tid, (void *)(size_t)i, (double)(i / 4));
+	sllfThreadUnregister(l, tid);
+	secs = runWorkers(conf, threads, setLockFreeWorker, l);
+	report("set", "lockfree", threads, ops, secs);
+	sllfFree(l);
+
+	pthread_mutex_init(&ls.lock, NULL);
+	ls.sl = slCreate();
+	ls.nodes = calloc(conf->keys + 1, sizeof(slNode_t *));
+	for (i = 1; i <= conf->keys; i += 2) {
+		ls.nodes[i] = slCreateNode(slRandomLevel(), (void *)(size_t)i, (double)(i / 4));
+		slInsertNode(ls.sl, ls.nodes[i], NULL);
+	}
+	secs = runWorkers(conf, threads, setLockedWorker, &ls);
+	report("set", "mutex", threads, ops, secs);
+	slFree(ls.sl, NULL, NULL);
+	free(ls.nodes);
+	pthread_mutex_destroy(&ls.lock);
+}
+
+/* shard */
+static void *shardUpdateWorker(void *arg)
+{
+	worker_t *w = arg;
+	sls_t *s = w->ud;
+	int i;
+	for (i = 0; i < w->conf->ops; i++) {
+		unsigned int r = rngNext(&w->rng);
+		size_t key = r % (unsigned int)w->conf->keys + 1;
+		slsUpdate(s, (void *)key, (double)(rngNext(&w->rng) % 1000000));
+	}
+	return NULL;
+}
+
+static void workloadShard(const scalingConf_t *conf, int threads)
+{
+	int i;
+	double secs;
+	double sink = 0.0;
+	unsigned int rng = 2463534242u;
+	int queries = conf->ops < 100000 ? conf->ops : 100000;
+	sls_t *s = slsCreate(threads < SLS_MAX_SHARDS ? threads : SLS_MAX_SHARDS, NULL, NULL);
+	slsReader_t rd;
+
+	secs = timenow();
+	runWorkers(conf, threads, shardUpdateWorker, s);
+	slsFlush(s);
+	secs = timenow() - secs;
+	report("shard", "update", threads, (double)conf->ops * threads, secs);
+
+	slsReaderRegister(s, &rd);
+	secs = timenow();
+	for (i = 0; i < queries; i++) {
+		size_t key = rngNext(&rng) % (unsigned int)conf->keys + 1;
+		sink += slsGetRank(s, &rd, (void *)key, (double)(rngNext(&rng) % 1000000));
+	}
+	secs = timenow() - secs;
+	report("shard", "rank_query", threads, queries, secs);
+	slsReaderUnregister(s, &rd);
+	slsFree(s);
+	if (sink < 0.0)
+		printf("%f\n", sink);
+}
+
+/* build */
+static void workloadBuild(const scalingConf_t *conf, int threads)
+{
+	int i;
+	double secs;
+	unsigned int rng = 2463534242u;
+	void **udataArr = malloc(sizeof(void *) * conf->keys);
+	double *scoreArr = malloc(sizeof(double) * conf->keys);
+	sl_t *sl;
+
+	for (i = 0; i < conf->keys; i++) {
+		udataArr[i] = (void *)(size_t)(i + 1);
+		scoreArr[i] = (double)(rngNext(&rng) % 1000000);
+	}
+	sl = slCreate();
+	secs = timenow();
+	slBuildParallel(sl, udataArr, scoreArr, conf->keys, threads, NULL);
+	secs = timenow() - secs;
+	report("build", "parallel", threads, conf->keys, secs);
+	slFree(sl, NULL, NULL);
+
+	if (threads == 1) {
+		sl = slCreate();
+		secs = timenow();
+		for (i = 0; i < conf->keys; i++)
+			slInsertNode(sl, slCreateNode(slRandomLevel(), udataArr[i], scoreArr[i]), NULL);
+		secs = timenow() - secs;
+		report("build", "insert", threads, conf->keys, secs);
+		slFree(sl, NULL, NULL);
+	}
+	free(udataArr);
+	free(scoreArr);
+}
+
+/* scan */
+#define SCAN_TIERS 4
+
+typedef struct scanCtx_s {
+	int n;
+	double sum;
+	int tiers[SCAN_TIERS];
+} scanCtx_t;
+
+static int scanVisit(slNode_t *node, int rank, void *partial, void *ctx)
+{
+	scanCtx_t *p = partial;
+	int n = ((scanCtx_t *)ctx)->n;
+	p->sum += node->score;
+	p->tiers[rank <= n / 100 ? 0 : rank <= n / 10 ? 1 : rank <= n / 2 ? 2 : 3]++;
+	return 0;
+}
+
+static void scanReduce(void *partial, int chunk, void *ctx)
+{
+	scanCtx_t *p = partial;
+	scanCtx_t *total = ctx;
+	int i;
+	(void)chunk;
+	total->sum += p->sum;
+	for (i = 0; i < SCAN_TIERS; i++)
+		total->tiers[i] += p->tiers[i];
+}
+
+static double scanWalk(sl_t *sl, scanCtx_t *walk, scanCtx_t *total)
+{
+	slNode_t *node;
+	int i;
+	double secs;
+	memset(walk, 0, sizeof(*walk));
+	secs = timenow();
+	for (node = SL_FIRST(sl), i = 1; node != NULL; node = SL_NEXT(node), i++)
+		scanVisit(node, i, walk, total);
+	return timenow() - secs;
+}
+
+static void workloadScan(const scalingConf_t *conf, int threads)
+{
+	int i;
+	double secs;
+	unsigned int rng = 2463534242u;
+	void **udataArr = malloc(sizeof(void *) * conf->keys);
+	double *scoreArr = malloc(sizeof(double) * conf->keys);
+	scanCtx_t total;
+	scanCtx_t walk;
+	sl_t *sl = slCreate();
+
+	for (i = 0; i < conf->keys; i++) {
+		udataArr[i] = (void *)(size_t)(i + 1);
+		scoreArr[i] = (double)(rngNext(&rng) % 1000000);
+	}
+	slBuildParallel(sl, udataArr, scoreArr, conf->keys, threads, NULL);
+	memset(&total, 0, sizeof(total));
+	total.n = conf->keys;
+	secs = timenow();
+	slParallelReduceRange(sl, 1, conf->keys, threads, scanVisit,
+			      sizeof(scanCtx_t), scanReduce, &total);
+	secs = timenow() - secs;
+	report("scan", "parallel", threads, conf->keys, secs);
+
+	if (threads == 1) {
+		secs = scanWalk(sl, &walk, &total);
+		report("scan", "walk", threads, conf->keys, secs);
+		if (walk.sum != total.sum || walk.tiers[0] != total.tiers[0])
+			fprintf(stderr, "scan: parallel and walk differ\n");
+
+		/* churn every member once, then compact the aged list */
+		for (i = 0; i < conf->keys; i++) {
+			int rank = (int)(rngNext(&rng) % conf->keys) + 1;
+			slDeleteByRank(sl, rank, NULL, NULL);
+			slInsertNode(sl, slCreateNode(slRandomLevel(), udataArr[i],
+						      (double)(rngNext(&rng) % 1000000)), NULL);
+		}
+		secs = scanWalk(sl, &walk, &total);
+		report("scan", "aged", threads, conf->keys, secs);
+		secs = timenow();
+		while (slCompact(sl, 4096, NULL, NULL) > 0)
+			;
+		secs = timenow() - secs;
+		report("scan", "compact", threads, conf->keys, secs);
+		secs = scanWalk(sl, &walk, &total);
+		report("scan", "compacted", threads, conf->keys, secs);
+	}
+	slFree(sl, NULL, NULL);
+	free(udataArr);
+	free(scoreArr);
+}
+
+/* shm */
+static void shmReader(const scalingConf_t *conf, void *base, size_t size, int idx)
+{
+	slshm_t sm;
+	unsigned int rng = 2463534242u + idx * 2654435761u;
+	unsigned long key;
+	double score;
+	double sink = 0.0;
+	int i;
+	if (slshmAttach(&sm, base, size) != 0)
+		_exit(1);
+	for (i = 0; i < conf->ops; i++) {
+		if (slshmGetByRank(&sm, rngNext(&rng) % (unsigned int)conf->keys + 1, &key, &score) == 0)
+			sink += slshmGetRank(&sm, key, score);
+	}
+	_exit(sink < 0.0);
+}
+
+static void workloadShm(const scalingConf_t *conf, int threads)
+{
+	int i;
+	int alive;
+	double secs;
+	double updates = 0.0;
+	unsigned int rng = 2463534242u;
+	size_t size = sizeof(struct slshmRegion_s) + slshmNodeBytes(2) * 2 * conf->keys;
+	slshmOff_t *offs = malloc(sizeof(slshmOff_t) * conf->keys);
+	pid_t *pids = malloc(sizeof(pid_t) * threads);
+	void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	slshm_t sm;
+
+	if (base == MAP_FAILED) {
+		fprintf(stderr, "shm: mmap failed\n");
+		goto finished;
+	}
+	slshmCreate(&sm, base, size);
+	for (i = 0; i < conf->keys; i++)
+		offs[i] = slshmInsert(&sm, i + 1, (double)(rngNext(&rng) % 1000000));
+
+	secs = timenow();
+	for (i = 0; i < threads; i++) {
+		if ((pids[i] = fork()) == 0)
+			shmReader(conf, base, size, i);
+	}
+	for (alive = threads; alive > 0; ) {
+		for (i = 0; i < 1000; i++) {
+			int k = rngNext(&rng) % (unsigned int)conf->keys;
+			slshmUpdate(&sm, offs[k], (double)(rngNext(&rng) % 1000000));
+		}
+		updates += 1000;
+		for (i = 0; i < threads; i++) {
+			if (pids[i] > 0 && waitpid(pids[i], NULL, WNOHANG) == pids[i]) {
+				pids[i] = 0;
+				alive--;
+			}
+		}
+	}
+	secs = timenow() - secs;
+	report("shm", "read", threads, (double)conf->ops * threads, secs);
+	report("shm", "write", threads, updates, secs);
+	munmap(base, size);
+finished:
+	free(offs);
+	free(pids);
+}
+
+static struct {
+	const char *name;
+	void (*run)(const scalingConf_t *conf, int threads);
+} workloads[] = {
+	{"set", workloadSet},
+	{"shard", workloadShard},
+	{"build", workloadBuild},
+	{"scan", workloadScan},
+	{"shm", workloadShm},
+};
+
+static int hasWorkload(const scalingConf_t *conf, const char *name)
+{
+	char buf[256];
+	char *tok;
+	strcpy(buf, conf->workloads);
+	for (tok = strtok(buf, ","); tok != NULL; tok = strtok(NULL, ",")) {
+		if (strcmp(tok, name) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int c;
+	int i;
+	int threads;
+	scalingConf_t conf;
+
+	conf.maxThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	conf.keys = 100000;
+	conf.ops = 200000;
+	conf.header = 1;
+	strcpy(conf.workloads, "set,shard,build,scan,shm");
+	while ((c = getopt(argc, argv, "t:n:o:w:H")) != -1) {
+		switch (c) {
+		case 't':
+			conf.maxThreads = atoi(optarg);
+			break;
+		case 'n':
+			conf.keys = atoi(optarg);
+			break;
+		case 'o':
+			conf.ops = atoi(optarg);
+			break;
+		case 'w':
+			strncpy(conf.workloads, optarg, sizeof(conf.workloads) - 1);
+			conf.workloads[sizeof(conf.workloads) - 1] = '\0';
+			break;
+		case 'H':
+			conf.header = 0;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-t maxThreads] [-n keys] [-o opsPerThread] [-w workload,...] [-H]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (conf.maxThreads < 1)
+		conf.maxThreads = 1;
+	if (conf.maxThreads > SLLF_MAX_THREADS)
+		conf.maxThreads = SLLF_MAX_THREADS;
+	if (conf.keys < 1)
+		conf.keys = 1;
+
+	if (conf.header)
+		printf("workload,impl,threads,ops,ops_per_sec\n");
+	for (i = 0; i < (int)(sizeof(workloads) / sizeof(workloads[0])); i++) {
+		if (!hasWorkload(&conf, workloads[i].name))
+			continue;
+		for (threads = 1; ; threads *= 2) {
+			if (threads > conf.maxThreads)
+				threads = conf.maxThreads;
+			workloads[i].run(&conf, threads);
+			if (threads == conf.maxThreads)
+				break;
+		}
+	}
+	return 0;
+}